@@ -0,0 +1,473 @@
+/**
+ * @file bench.c
+ * @brief Measures how quickly libbitmapsteg encodes and decodes synthetic
+ *        bitmaps, timing each phase on its own. Run with make bench.
+ *
+ * Copyright:
+ *  @author Alan Barr
+ *  @date April 2012
+ *
+ * @section License
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "bitmap_steganography_private.h"
+
+/** Number of layouts in benchLayouts. */
+#define BENCH_LAYOUTS               5
+
+/** Longest path of a bitmap the benchmark writes. */
+#define BENCH_NAME_SIZE             4096
+
+/** Bits per channel of each layout benchmarked, see tPixelLayout. */
+static const uint64_t benchLayouts[BENCH_LAYOUTS] = { 0, 1, 2, 4, 8 };
+
+
+/** @brief Seconds since a given time.
+ *  @param pStart The time to measure from.
+ *  @return Seconds elapsed. */
+static double secondsSince(IN const struct timespec * pStart)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - pStart->tv_sec) + (now.tv_nsec - pStart->tv_nsec) / 1e9;
+}
+
+
+/** @brief Prints the result of one phase as a line of key=value pairs.
+ *  @param operation "encode" or "decode".
+ *  @param phase The phase timed.
+ *  @param pLayout Layout of the bitmap.
+ *  @param bytes Number of bytes the phase worked on.
+ *  @param seconds Time the phase took. */
+static void report(IN const char * operation,
+                   IN const char * phase,
+                   IN const tPixelLayout * pLayout,
+                   uint64_t bytes,
+                   double seconds)
+{
+    printf("op=%s phase=%s kernel=%s bpp=%" PRIu64 " bits=%" PRIu64 " alpha=%" PRIu64
+           " width=%" PRIu64 " height=%" PRIu64 " padding=%" PRIu64 " bytes=%" PRIu64 
+           " seconds=%.6f mb_per_s=%.1f ns_per_byte=%.3f\n",
+           operation, phase, simdLevelNames[simdLevel()], pLayout->bytesPerPixel * 8, 
+           pLayout->bitsPerChannel, pLayout->alpha, pLayout->width, 
+           pLayout->height, pLayout->padding, bytes, seconds,
+           seconds > 0 ? bytes / seconds / 1e6 : 0.0,
+           bytes > 0 ? seconds * 1e9 / bytes : 0.0);
+}
+
+
+/** @brief Fills memory with pseudo random bytes.
+ *  @param pBytes The memory to fill.
+ *  @param count Number of bytes.
+ *  @param seed Starting state, which must not be zero. */
+static void fillRandom(OUT uint8_t * pBytes, uint64_t count, uint64_t seed)
+{
+    uint64_t index = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        pBytes[index] = (uint8_t)seed;
+    }
+}
+
+
+/** @brief Writes a bitmap full of random pixels.
+ *  @param fileName Name of the bitmap to create.
+ *  @param width Width in pixels.
+ *  @param height Height in pixels.
+ *  @param bitsPerPixel 24 or 32.
+ *  @return An error value from enum eErrors. */
+static tError createCover(IN const char * fileName, uint32_t width, uint32_t height,
+                          uint16_t bitsPerPixel)
+{
+    tError errRtn = errorDefault;
+    tBitmapFileHeader fileHeader;
+    tBitmapInfoHeader infoHeader;
+    tPixelLayout layout;
+    uint8_t * pData = NULL;
+
+    memset(&fileHeader, 0, sizeof(tBitmapFileHeader));
+    memset(&infoHeader, 0, sizeof(tBitmapInfoHeader));
+
+    infoHeader.size         = INFO_HEADER_SIZE;
+    infoHeader.width        = width;
+    infoHeader.height       = height;
+    infoHeader.planes       = 1;
+    infoHeader.bitsPerPixel = bitsPerPixel;
+
+    fileHeader.type       = BITMAP_FILE_TYPE;
+    fileHeader.offsetbits = PIXEL_DATA_OFFSET;
+
+    pixelLayout(&fileHeader, &infoHeader, &layout);
+    infoHeader.imageDataSize = layout.sizeOfData;
+    fileHeader.size          = PIXEL_DATA_OFFSET + layout.sizeOfData;
+
+    if ((pData = malloc(layout.sizeOfData)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        fillRandom(pData, layout.sizeOfData, width * 2654435761u + height);
+
+        if ((errRtn = createOutputBitmap(fileName, &fileHeader, &infoHeader, pData,
+                                         layout.sizeOfData, NULL)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    free(pData);
+
+    return errRtn;
+}
+
+
+/** @brief Times reading and parsing a bitmap.
+ *  @param operation "encode" or "decode", for the report.
+ *  @param fileName Name of the bitmap.
+ *  @param pFileHeader Returns the file header.
+ *  @param pInfoHeader Returns the info header.
+ *  @param pLayout Returns the layout of the pixels.
+ *  @param ppData Returns the pixel data. Free with free().
+ *  @return An error value from enum eErrors. */
+static tError benchLoad(IN const char * operation,
+                        IN const char * fileName,
+                        OUT tBitmapFileHeader * pFileHeader,
+                        OUT tBitmapInfoHeader * pInfoHeader,
+                        OUT tPixelLayout * pLayout,
+                        OUT uint8_t ** ppData)
+{
+    tError errRtn = errorDefault;
+    FILE * fpBitmap = NULL;
+    struct timespec start;
+
+    *ppData = NULL;
+
+    if ((fpBitmap = fopen(fileName, "rb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if ((errRtn = parseBitmap(fpBitmap, pFileHeader, pInfoHeader, pLayout)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            report(operation, "parseBitmap", pLayout, pLayout->headerSize,
+                   secondsSince(&start));
+        }
+    }
+
+    if (errRtn == success)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if ((errRtn = copyBitmapData(fpBitmap, ppData, pLayout->dataOffset, 
+                                     pLayout->sizeOfData)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            report(operation, "copyBitmapData", pLayout, pLayout->sizeOfData,
+                   secondsSince(&start));
+        }
+    }
+
+    if (fpBitmap != NULL && fclose(fpBitmap) != success)
+    {
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Times encoding a cover: reading it, hiding as much data as it holds
+ *         and writing the result.
+ *  @param coverFileName Name of the cover bitmap.
+ *  @param stegoFileName Name of the bitmap to write.
+ *  @param bitsPerChannel Layout to hide the data with, see tPixelLayout.
+ *  @param alpha Non zero to hide data in the alpha bytes too.
+ *  @return An error value from enum eErrors. */
+static tError benchEncode(IN const char * coverFileName, 
+                          IN const char * stegoFileName,
+                          uint64_t bitsPerChannel,
+                          int alpha)
+{
+    tError errRtn = errorDefault;
+    tBitmapFileHeader fileHeader;
+    tBitmapInfoHeader infoHeader;
+    tPixelLayout layout;
+    uint8_t * pData = NULL;
+    uint8_t * pPayload = NULL;
+    uint64_t payloadSize = 0;
+    uint8_t header[HEADER_SIZE];
+    uint8_t checksum[CHECKSUM_SIZE];
+    struct timespec start;
+
+    if ((errRtn = benchLoad("encode", coverFileName, &fileHeader, &infoHeader,
+                            &layout, &pData)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = chooseLayout(&layout, bitsPerChannel, alpha, 0, 0)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        payloadSize = hiddenBytesInRows(&layout, layout.height) - streamOverhead(&layout);
+
+        if ((pPayload = malloc(payloadSize)) == NULL)
+        {
+            errRtn = errorMalloc;
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    if (errRtn == success)
+    {
+        fillRandom(pPayload, payloadSize, payloadSize | 1);
+        packHeader(header, payloadSize, layoutFlags(&layout), "dat");
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        embedRows(&layout, pData, 0, header, HEADER_SIZE);
+        embedRows(&layout, pData, HEADER_SIZE, pPayload, payloadSize);
+        report("encode", "embed", &layout, HEADER_SIZE + payloadSize,
+               secondsSince(&start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        packChecksum(checksum, crc32c(0, pPayload, payloadSize));
+        report("encode", "crc32c", &layout, payloadSize, secondsSince(&start));
+        embedRows(&layout, pData, HEADER_SIZE + payloadSize, checksum, CHECKSUM_SIZE);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if ((errRtn = createOutputBitmap(stegoFileName, &fileHeader, &infoHeader,
+                                         pData, layout.sizeOfData, NULL)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            report("encode", "createOutputBitmap", &layout,
+                   layout.dataOffset + layout.sizeOfData, secondsSince(&start));
+        }
+    }
+
+    free(pData);
+    free(pPayload);
+
+    return errRtn;
+}
+
+
+/** @brief Times decoding a bitmap: reading it and recovering everything it
+ *         holds, in whatever layout its header gives.
+ *  @param stegoFileName Name of the bitmap.
+ *  @return An error value from enum eErrors. */
+static tError benchDecode(IN const char * stegoFileName)
+{
+    tError errRtn = errorDefault;
+    tBitmapFileHeader fileHeader;
+    tBitmapInfoHeader infoHeader;
+    tPixelLayout layout;
+    uint8_t * pData = NULL;
+    uint8_t * pBytes = NULL;
+    uint64_t count = 0;
+    uint64_t position = 0;
+    char extension[EXTENSION_SIZE + 1] = {0};
+    struct timespec start;
+
+    if ((errRtn = benchLoad("decode", stegoFileName, &fileHeader, &infoHeader,
+                            &layout, &pData)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = parseEncodedData(pData, &layout, &position, extension, 
+                                        &count)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pBytes = malloc(count + checksumSize(&layout))) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        extractRows(&layout, pData, position, pBytes, count + checksumSize(&layout));
+        report("decode", "extract", &layout, count, secondsSince(&start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (crc32c(0, pBytes, count) != unpackChecksum(&pBytes[count]))
+        {
+            errRtn = errorChecksum;
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            report("decode", "crc32c", &layout, count, secondsSince(&start));
+        }
+    }
+
+    free(pData);
+    free(pBytes);
+
+    return errRtn;
+}
+
+
+/** @brief Writes a cover and benchmarks each layout on it. 32 bit covers are
+ *         also tried with data split across all four bytes of each pixel.
+ *  @param coverFileName Name of the cover bitmap to write.
+ *  @param stegoFileName Name of the bitmap to encode to.
+ *  @param width Width in pixels.
+ *  @param height Height in pixels.
+ *  @param bitsPerPixel 24 or 32.
+ *  @return An error value from enum eErrors. */
+static tError benchCover(IN const char * coverFileName, 
+                         IN const char * stegoFileName,
+                         uint32_t width, 
+                         uint32_t height,
+                         uint16_t bitsPerPixel)
+{
+    tError errRtn = errorDefault;
+    uint32_t layout = 0;
+    int alpha = 0;
+
+    if ((errRtn = createCover(coverFileName, width, height, bitsPerPixel)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    for (layout = 0; layout < BENCH_LAYOUTS && errRtn == success; layout++)
+    {
+        for (alpha = 0; alpha < (bitsPerPixel == 32 && layout == 0 ? 2 : 1) && 
+                        errRtn == success; alpha++)
+        {
+            if ((errRtn = benchEncode(coverFileName, stegoFileName, 
+                                      benchLayouts[layout], alpha)) != success ||
+                (errRtn = benchDecode(stegoFileName)) != success)
+            {
+                ERROR_PRINT(errRtn);
+            }
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Benchmarks each size given, once for each of the four amounts of
+ *         row padding of a 24 bit bitmap and once as a 32 bit bitmap, with 
+ *         each layout.
+ *  @param argv[1] Directory to write the bitmaps in.
+ *  @param argv[2...] Sizes of bitmap to try, in megapixels. */
+int main(int argc, char ** argv)
+{
+    tError errRtn = success;
+    char coverFileName[BENCH_NAME_SIZE];
+    char stegoFileName[BENCH_NAME_SIZE];
+    double megapixels = 0;
+    uint64_t side = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t padding = 0;
+    int size = 0;
+    const char * levelName = getenv("BENCH_SIMD");
+
+    if (argc < 3)
+    {
+        printf("Useage: %s directory megapixels...\n", argv[0]);
+        return errorDefault;
+    }
+
+    /* Lets each instruction set level be timed on the one machine */
+    if (levelName != NULL && levelName[0] != '\0' && simdForce(levelName) != success)
+    {
+        printf("No instruction set level %s on this CPU\n", levelName);
+        return errorSimd;
+    }
+
+    snprintf(coverFileName, BENCH_NAME_SIZE, "%s/bench_cover.bmp", argv[1]);
+    snprintf(stegoFileName, BENCH_NAME_SIZE, "%s/bench_stego.bmp", argv[1]);
+
+    for (size = 2; size < argc && errRtn == success; size++)
+    {
+        megapixels = strtod(argv[size], NULL);
+        side = 1;
+
+        while ((side + 1) * (side + 1) <= megapixels * 1e6)
+        {
+            side++;
+        }
+
+        /* A width of 4n + p pads each row by p bytes */
+        for (padding = 0; padding < 4 && errRtn == success; padding++)
+        {
+            width  = (side & ~(uint64_t)3) + padding + 4;
+            height = megapixels * 1e6 / width;
+            height = height > 0 ? height : 1;
+
+            if ((errRtn = benchCover(coverFileName, stegoFileName, width, height, 
+                                     24)) != success)
+            {
+                ERROR_PRINT(errRtn);
+            }
+        }
+
+        /* 32 bit rows are never padded */
+        if (errRtn == success &&
+            (errRtn = benchCover(coverFileName, stegoFileName, width, height, 32)) 
+            != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    remove(coverFileName);
+    remove(stegoFileName);
+
+    return errRtn;
+}
@@ -1,7 +1,7 @@
 /**
  * @file bitmap_steganography.c 
  * @brief Contains all functions used to encode and decode data into a bitmap
- *        image.
+ *        image. Built as libbitmapsteg, with encoder.c as its command line.
  *
  * Copyright:
  *  @author Alan Barr
@@ -23,117 +23,191 @@
  *
  */
 
-#include "bitmap_steganography.h"
+/* For copy_file_range */
+#define _GNU_SOURCE
 
+#include "bitmap_steganography_private.h"
 
-/** @brief Determines whether encoding or decoding a bitmap is desired.
- *         If argc is 2 decoding is chosen. If argc is 3 encoding is chosen.
- *  @param argv[1] Bitmap file to be decoded/encoded.
- *  @param argv[2] For encoding only - Data file to be encoded. */
-int main(int argc, char ** argv)
+
+#undef ERROR
+/** Defines error to stringify list for debug. */
+#define ERROR(x) #x,
+/** Holds the error names in strings. Compliments eErrors. */
+static const char * errorString[] = { ERRORS };
+
+/** Told of each error as it is met, NULL to say nothing. */
+static tErrorReporter errorReporter = NULL;
+
+#undef SIMD_LEVEL
+/** Defines level to list its name. */
+#define SIMD_LEVEL(level, name) name,
+/** Holds the level names in strings. Compliments tSimdLevel. */
+const char * simdLevelNames[] = { SIMD_LEVELS };
+
+/** Instruction set level the kernels are picked by. */
+static tSimdLevel simdLevelInUse = simdScalar;
+/** Kernels of simdLevelInUse. The portable ones until the library loads. */
+static tSimdKernels simdKernels = {
+    {embedBytesSwar}, {extractBytesSwar}, {NULL}, {NULL}, {NULL}, crc32cScalar
+};
+
+
+/** @brief Gives the name of an error, as printed in messages.
+ *  @param err The error.
+ *  @return The name, or "errorUnknown" for a value outside enum eErrors. */
+const char * errorText(tError err)
 {
-    tError errRtn = errorDefault;
+    const char * text = "errorUnknown";
 
-    if (argc == 2)
+    if ((uint64_t)err < sizeof(errorString) / sizeof(errorString[0]))
     {
-        errRtn = decoding(argv);
+        text = errorString[err];
     }
 
-    else if (argc == 3)
-    {
-        errRtn = encoding(argv);
-    }
+    return text;
+}
 
-    else
-    {
-        printf("Useage:\n"
-               "To decode a file pass the BMP file in as an arugment.\n"
-               "To encode a file pass in the destination BMP and data\n"
-               "in that order as arugments.\n");
-    }
-    
-    if (errRtn == success)
+
+/** @brief Sets the function told of each error the library meets, which it
+ *         otherwise keeps quiet about. Set it before anything else is called,
+ *         as it is read without a lock.
+ *  @param reporter The function, or NULL to stop reporting. */
+void setErrorReporter(tErrorReporter reporter)
+{
+    errorReporter = reporter;
+}
+
+
+/** @brief Passes an error to the reporter set by setErrorReporter, if any. 
+ *         Called through ERROR_PRINT and ERROR_ERRNO_PRINT.
+ *  @param fileName Source file the error was met in.
+ *  @param line Line of the source file.
+ *  @param err The error.
+ *  @param errnoValue errno describing the error, or zero when it doesn't. */
+void reportError(IN const char * fileName, int line, tError err, int errnoValue)
+{
+    if (errorReporter != NULL)
     {
-        printf("Success\n");
+        errorReporter(fileName, line, err, errnoValue);
     }
-
-    return errRtn;
 }
 
 
-/** @brief Handles all the retrieving of encoded information from a bitmap and
- *         saves it in a file. Bitmap file name is retrieved from argv.
- *  @param argv[0] - Filename of the bitmap file to decode.
+/** @brief Retrieves the hidden data from a bitmap and saves it in a file,
+ *         or with the verify option only checks it against its checksum. A
+ *         bitmap on standard input is streamed as the stream option does, or
+ *         with the pipeline option as that does, and can't have a range 
+ *         taken from it.
+ *  @param bitmapFileName Name of the bitmap file to decode, or 
+ *         STDIO_FILE_NAME.
+ *  @param outputFileName Name of the file to save the data in, 
+ *         STDIO_FILE_NAME, or NULL to name it "decoded" plus its original
+ *         extension.
+ *  @param pOptions Options given on the command line.
+ *  @param pBuffers Working buffers, kept for the next call.
  *  @return An error value from enum eErrors. */
-tError decoding(IN char ** argv)
+tError decodeFile(IN const char * bitmapFileName,
+                  IN const char * outputFileName,
+                  IN const tOptions * pOptions,
+                  IN_OUT tBuffers * pBuffers)
 {
     tError errRtn = errorDefault;
     FILE * fpBitmap = NULL;
     char extension[EXTENSION_SIZE + 1] = {0};
     uint64_t encodedDataSize = 0;
-    uint64_t imageDataSize = 0;
     tBitmapFileHeader fileHeader;
     tBitmapInfoHeader infoHeader;
-    uint8_t * pImageData = NULL;
-    uint8_t padding = 0;
+    tPixelLayout layout;
+    tImageData image = {0};
     uint8_t * pEncodedData = NULL;
-    uint64_t encodedDataIndex = 0;
+    uint64_t encodedDataPixel = 0;
 
-    if ((fpBitmap = fopen(argv[BITMAP_FILE], "rb")) == NULL)
+    if (pOptions->range && !stdioFileName(bitmapFileName))
     {
-        errRtn = errorFopen;
-        ERROR_ERRNO_PRINT(errRtn);
+        /* Only the rows holding the range are read */
+        return extractRange(bitmapFileName, pOptions->rangeOffset, pOptions->rangeLength,
+                            outputFileName, pOptions->passphrase, pBuffers);
     }
 
-    else if (fgetc(fpBitmap) != 'B' || fgetc(fpBitmap) != 'M')
+    /* Standard input can only be read front to back */
+    if (pOptions->range)
     {
         errRtn = errorFileType;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = parseBitmap(fpBitmap, &fileHeader, &infoHeader, &padding, 
-                                   &imageDataSize)) != success)
+    else if ((fpBitmap = stdioOpen(bitmapFileName, "rb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = parseBitmap(fpBitmap, &fileHeader, &infoHeader, &layout)) != success)
     {
         ERROR_PRINT(errRtn);
     }
     
-    else if (infoHeader.bitsPerPixel != 24)
+    else if (!supportedBitmap(&infoHeader))
     {   
         errRtn = errorFileType;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = copyBitmapData(fpBitmap, &pImageData, imageDataSize)) != success)
+    else if (pOptions->verify)
     {
-        ERROR_PRINT(errRtn);
+        if ((errRtn = decodeStream(fpBitmap, &layout, NULL, NULL, 1, pBuffers)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
     }
 
-    else if (pImageData == NULL)
+    else if (pOptions->pipeline)
+    {
+        if ((errRtn = decodePipeline(fpBitmap, &layout, outputFileName, pOptions->passphrase,
+                                     pBuffers)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    else if (pOptions->stream || stdioFileName(bitmapFileName))
+    {
+        if ((errRtn = decodeStream(fpBitmap, &layout, outputFileName, pOptions->passphrase,
+                                   0, pBuffers)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    else if ((errRtn = loadImageData(fpBitmap, &layout, 0, &image)) != success)
     {
-        errRtn = errorNull;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = parseEncodedData(pImageData, imageDataSize, padding, 
-                       infoHeader.width, &encodedDataIndex, extension, 
-                       &encodedDataSize)) != success)
+    else if ((errRtn = parseEncodedData(image.pData, &layout, &encodedDataPixel, 
+                                        extension, &encodedDataSize)) != success)
     {
         ERROR_PRINT(errRtn);
     }
 
-    else if ((pEncodedData = malloc(encodedDataSize)) == NULL)
+    else if ((pEncodedData = malloc(encodedDataSize + checksumSize(&layout))) == NULL)
     {
         errRtn = errorMalloc;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = decodeData(pImageData, encodedDataSize, encodedDataIndex, 
-                                  infoHeader.width, padding, pEncodedData)) != success)
+    /* The checksum is recovered along with the data */
+    else if ((errRtn = decodeData(image.pData, &layout, 
+                                  encodedDataSize + checksumSize(&layout), 
+                                  encodedDataPixel, pEncodedData, pOptions->pPool)) 
+             != success)
     {
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = createOutputFile(extension, pEncodedData, encodedDataSize)) != success)
+    else if ((errRtn = createOutputFile(outputFileName, extension, pEncodedData, 
+                                        encodedDataSize, &layout, pOptions->passphrase)) 
+             != success)
     {
         ERROR_PRINT(errRtn);
     }
@@ -145,7 +219,7 @@ tError decoding(IN char ** argv)
     
     if (fpBitmap != NULL)
     {
-        if (fclose(fpBitmap) != success) 
+        if (stdioClose(fpBitmap) != success) 
         {
             errRtn = errorFclose;
             ERROR_ERRNO_PRINT(errRtn);
@@ -153,103 +227,233 @@ tError decoding(IN char ** argv)
         }
     }
 
+    releaseImageData(&image);
+
+    if (pEncodedData != NULL)
+    {
+        free(pEncodedData);
+    }
+
     return errRtn;
 }
 
 
-/** @brief Handles all the encoding of data into a bitmap file. The data is 
- *         pulled from the third argument of argv and placed into the bitmap 
- *         file which should be the second argument.
- *  @param argv[0] Bitmap file to copy and hide data in.
- *  @param argv[1] Data file to be hidden.
+
+/** @brief Hides a data file in a copy of a bitmap. A cover on standard input
+ *         or an output to standard output is streamed as the stream option 
+ *         does, or with the pipeline option as that does, and can't be cloned
+ *         or changed in place. Data on standard input is read into memory, 
+ *         see openDataFile.
+ *  @param bitmapFileName Name of the bitmap to copy and hide data in, or
+ *         STDIO_FILE_NAME.
+ *  @param dataFileName Name of the data file to be hidden, or 
+ *         STDIO_FILE_NAME. Data from standard input is recorded with no
+ *         extension.
+ *  @param outputFileName Name of the bitmap to create, or STDIO_FILE_NAME.
+ *  @param pOptions Options given on the command line.
+ *  @param pBuffers Working buffers, kept for the next call.
  *  @return An error value from enum eErrors. */
-tError encoding(IN char ** argv)
+tError encodeFile(IN const char * bitmapFileName,
+                  IN const char * dataFileName,
+                  IN const char * outputFileName,
+                  IN const tOptions * pOptions,
+                  IN_OUT tBuffers * pBuffers)
 {
     tError errRtn = errorDefault;
     FILE * fpBitmap = NULL;
     FILE * fpDataFile = NULL;
     tBitmapFileHeader fileHeader;
     tBitmapInfoHeader infoHeader;
-    uint8_t padding = 0;
-    uint8_t * pImageData = NULL;
-    uint64_t imageDataSize = 0;
+    tPixelLayout layout;
+    tImageData coverImage = {0};
+    tImageData outputImage = {0};
+    tCipher cipher;
+    tCipher * pCipher = pOptions->passphrase != NULL ? &cipher : NULL;
+    uint64_t prefixSize = pCipher != NULL ? CIPHER_PREFIX_SIZE : 0;
     uint64_t dataToEncodeSize = 0;
     uint64_t bitmapFileSize = 0;
+    uint8_t * pDataBuffer = NULL;
+    int piped = stdioFileName(bitmapFileName) || stdioFileName(outputFileName);
 
     memset(&fileHeader, 0, sizeof(tBitmapFileHeader));
     memset(&infoHeader, 0, sizeof(tBitmapInfoHeader));
     
-    if ((fpBitmap = fopen(argv[BITMAP_FILE], "rb")) == NULL)
-    {
-        errRtn = errorFopen;
-        ERROR_ERRNO_PRINT(errRtn);
-    }
-    
-    else if (fgetc(fpBitmap) != 'B' || fgetc(fpBitmap) != 'M')
+    /* Standard input can only carry one file, and neither it nor standard 
+     * output can be cloned or changed in place */
+    if ((stdioFileName(bitmapFileName) && stdioFileName(dataFileName)) ||
+        (piped && (pOptions->clone || pOptions->inPlace)))
     {
         errRtn = errorFileType;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((fpDataFile = fopen(argv[ENCODE_FILE], "rb")) == NULL)
+    else if ((fpBitmap = stdioOpen(bitmapFileName, "rb")) == NULL)
     {
         errRtn = errorFopen;
         ERROR_ERRNO_PRINT(errRtn);
     }
+    
+    else if ((errRtn = openDataFile(dataFileName, &fpDataFile, &pDataBuffer)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
 
-    else if ((errRtn = parseBitmap(fpBitmap, &fileHeader, &infoHeader, &padding, 
-                                   &imageDataSize)) != success)
+    else if ((errRtn = parseBitmap(fpBitmap, &fileHeader, &infoHeader, &layout)) != success)
     {
         ERROR_PRINT(errRtn);
     }
 
-    else if (infoHeader.bitsPerPixel != 24)
+    else if (!supportedBitmap(&infoHeader))
     {   
         errRtn = errorFileType;
         ERROR_PRINT(errRtn);
     }
     
-    else if ((errRtn = copyBitmapData(fpBitmap, &pImageData, imageDataSize)) != success)
+    else if ((errRtn = fileSize(fpDataFile, &dataToEncodeSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* A pipe can't be sized, so is only found to be short once read */
+    else if (!stdioFileName(bitmapFileName) && 
+             (errRtn = fileSize(fpBitmap, &bitmapFileSize)) != success)
     {
         ERROR_PRINT(errRtn);
     }
     
-    else if (pImageData == NULL)
+    else if (!stdioFileName(bitmapFileName) &&
+             (errRtn = validateSizes(bitmapFileSize, layout.dataOffset, 
+                                     layout.rowBytes * layout.height,
+                                     layout.padding * layout.height)) != success)
     {
-        errRtn = errorNull;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = fileSize(fpDataFile, &dataToEncodeSize)) != success)
+    else if ((errRtn = chooseLayout(&layout, pOptions->bitsPerChannel, pOptions->alpha, 
+                                    pOptions->compress, pCipher != NULL)) != success)
     {
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = fileSize(fpBitmap, &bitmapFileSize)) != success)
+    /* Compressed data is only known not to fit once it has been compressed */
+    else if ((pOptions->compress ? 0 : dataToEncodeSize) + streamOverhead(&layout) > 
+             hiddenBytesInRows(&layout, layout.height))
     {
+        errRtn = errorSize;
         ERROR_PRINT(errRtn);
     }
-    
-    else if ((errRtn = validateSizes(bitmapFileSize, infoHeader.width * infoHeader.height * 3,
-                                     padding * infoHeader.height)) != success)
+
+    /* The rows compressed data ends in aren't known until it has been hidden,
+     * so it is always hidden in a copy of the whole bitmap held in memory 
+     * below, whether asked to stream the bitmap or not, and can't be hidden
+     * in the cover or a clone of it */
+    else if (pOptions->compress && (pOptions->inPlace || pOptions->clone))
     {
+        errRtn = errorLayout;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((imageDataSize - (padding * infoHeader.height) - EXTENSION_SIZE - DATA_SIZE) < dataToEncodeSize)
+    else if (pCipher != NULL && (errRtn = cipherCreate(pCipher, pOptions->passphrase)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* The clone replaces the output before the data has been read */
+    else if (pOptions->clone && sameFile(fileno(fpDataFile), outputFileName))
+    {
+        errRtn = errorSameFile;
+        ERROR_PRINT(errRtn);
+    }
+
+    /* The paths below take the size of what is hidden after the header */
+    else if (pOptions->clone)
+    {
+        if ((errRtn = cloneFile(bitmapFileName, outputFileName)) != success ||
+            (errRtn = encodeInPlace(outputFileName, fpDataFile, dataFileName, &layout,
+                                    dataToEncodeSize + prefixSize, pCipher, pBuffers)) 
+            != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    else if (pOptions->inPlace)
+    {
+        if ((errRtn = encodeInPlace(bitmapFileName, fpDataFile, dataFileName, &layout,
+                                    dataToEncodeSize + prefixSize, pCipher, pBuffers)) 
+            != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    else if (pOptions->pipeline && !pOptions->compress)
+    {
+        if ((errRtn = encodePipeline(fpBitmap, fpDataFile, dataFileName, &fileHeader,
+                                     &infoHeader, &layout, dataToEncodeSize + prefixSize, 
+                                     pCipher, outputFileName, pBuffers)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    else if ((pOptions->stream || piped) && !pOptions->compress)
+    {
+        if ((errRtn = encodeStream(fpBitmap, fpDataFile, dataFileName, &fileHeader,
+                                   &infoHeader, &layout, dataToEncodeSize + prefixSize, 
+                                   pCipher, outputFileName, pBuffers)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    else if ((errRtn = loadImageData(fpBitmap, &layout, pOptions->compress, 
+                                     &coverImage)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* The output is created at its full size before the cover or data has
+     * been read, or with -z truncated while the cover's unchanged pixels are
+     * still mapped from it, so can't be either of them */
+    else if (sameFile(fileno(fpBitmap), outputFileName) || 
+             sameFile(fileno(fpDataFile), outputFileName))
+    {
+        errRtn = errorSameFile;
+        ERROR_PRINT(errRtn);
+    }
+
+    /* Compressed data is only known to fit once it has been hidden, so it is
+     * hidden in the cover's own copy on write pixels and the output is only 
+     * written once it has been, leaving any file already there alone if not */
+    else if (!pOptions->compress &&
+             (errRtn = createOutputImage(outputFileName, &coverImage, 
+                                         &outputImage)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = encodeDataFileContents(fpDataFile, dataFileName, 
+                                              pOptions->compress ? coverImage.pData :
+                                                                   outputImage.pData, 
+                                              &layout, pCipher, pOptions->pPool, 
+                                              pBuffers)) != success)
     {
-        errRtn = errorSize;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = encodeDataFileContents(fpDataFile, argv[ENCODE_FILE], pImageData, 
-                                              imageDataSize, infoHeader.width, padding)) != success)
+    else if (pOptions->compress && coverImage.pMapping != NULL &&
+             (errRtn = writeWholeFile(outputFileName, coverImage.pMapping, 
+                                      coverImage.mappingSize)) != success)
     {
         ERROR_PRINT(errRtn);
     }
 
-    else if ((errRtn = createOutputBitmap(&fileHeader, &infoHeader, pImageData,
-                                          imageDataSize)) != success)
+    /* A mapped output is already in the file, a copied one needs writing */
+    else if (coverImage.pMapping == NULL &&
+             (errRtn = createOutputBitmap(outputFileName, &fileHeader, &infoHeader, 
+                                          coverImage.pData, layout.sizeOfData, 
+                                          fpBitmap)) != success)
     {
         ERROR_PRINT(errRtn);
     }
@@ -261,14 +465,14 @@ tError encoding(IN char ** argv)
 
     if (fpBitmap != NULL)
     {
-        if (fclose(fpBitmap) != success)
+        if (stdioClose(fpBitmap) != success)
         {
             errRtn = errorFclose;
             ERROR_ERRNO_PRINT(errRtn);
         }
     }
     
-    if (fpBitmap != NULL)
+    if (fpDataFile != NULL)
     {
         if (fclose(fpDataFile) != success)
         {
@@ -277,638 +481,7680 @@ tError encoding(IN char ** argv)
         }
     }
 
-    if (pImageData != NULL)
+    free(pDataBuffer);
+
+    if (releaseImageData(&outputImage) != success)
     {
-        free(pImageData);
+        errRtn = errorMmap;
+        ERROR_ERRNO_PRINT(errRtn);
     }
 
-    return success;
+    releaseImageData(&coverImage);
+
+    return errRtn;
 }
 
 
-/** @brief Returns the file size of an open file
- *  @param fpFile File to get the size of.
- *  @param size Returns the file size.
- *  @return An error value from enum eErrors. */
-tError fileSize(IN FILE * fpFile, OUT uint64_t * size)
+/** @brief Checks whether a file name stands for standard input or output.
+ *  @param fileName The file name, may be NULL.
+ *  @return Non zero if it is STDIO_FILE_NAME. */
+int stdioFileName(IN const char * fileName)
 {
-    tError errRtn = errorDefault;
+    return fileName != NULL && strcmp(fileName, STDIO_FILE_NAME) == 0;
+}
 
-    if (fpFile == NULL || size == NULL)
+
+/** @brief Checks whether a file name names a file already open, so that an
+ *         output isn't created over the file it is being made from.
+ *  @param fdInput The open file, or -1.
+ *  @param fileName Name of the output, or STDIO_FILE_NAME.
+ *  @return Non zero if fileName names the file open as fdInput. */
+int sameFile(int fdInput, IN const char * fileName)
+{
+    struct stat inputStatus;
+    struct stat fileStatus;
+
+    return !stdioFileName(fileName) && fdInput >= 0 &&
+           fstat(fdInput, &inputStatus) == success &&
+           stat(fileName, &fileStatus) == success &&
+           inputStatus.st_dev == fileStatus.st_dev && 
+           inputStatus.st_ino == fileStatus.st_ino;
+}
+
+
+/** @brief Opens a file as fopen does, but gives standard input or output for
+ *         STDIO_FILE_NAME.
+ *  @param fileName Name of the file, or STDIO_FILE_NAME.
+ *  @param mode Mode to open the file with, as fopen. Standard input is given
+ *         for a mode which reads, standard output otherwise.
+ *  @return The open file, or NULL with errno set. Close with stdioClose. */
+FILE * stdioOpen(IN const char * fileName, IN const char * mode)
+{
+    FILE * fpFile = NULL;
+
+    if (stdioFileName(fileName))
     {
-        errRtn = errorNull;
-        ERROR_PRINT(errRtn);
+        fpFile = mode[0] == 'r' ? stdin : stdout;
     }
 
     else
     {
-        fseek(fpFile, 0, SEEK_END);
-        *size = ftell(fpFile);
-        errRtn = success;
+        fpFile = fopen(fileName, mode);
     }
 
-    return errRtn;
+    return fpFile;
 }
 
 
-/** @brief Validates the file sizes are correct when encoding information to a
- *         bitmap.
- *  @param bitmapFileSizeBytes Size of the bitmap in bytes.
- *  @param pixelSizeBytes Size of all valid pixels in bytes.
- *  @param filePaddingSizeBytes Total padding size in bytes.
- *  @return An error value from enum eErrors. */
-tError validateSizes(uint64_t bitmapFileSizeBytes, uint64_t pixelSizeBytes,
-                     uint64_t filePaddingSizeBytes)
+/** @brief Closes a file opened with stdioOpen. Standard input and output are
+ *         left open, with standard output flushed.
+ *  @param fpFile The file.
+ *  @return 0, or EOF with errno set, as fclose. */
+int stdioClose(IN FILE * fpFile)
 {
-    tError errRtn = errorDefault;
-    uint64_t total = pixelSizeBytes + sizeof(tBitmapFileHeader) + 
-                     sizeof(tBitmapInfoHeader) + filePaddingSizeBytes;
-    
-    if (bitmapFileSizeBytes != total)
-    {
-        printf("pixelSizeBytes       = %llu\n"
-               "headerSizeBytes      = %u\n"
-               "filePaddingSizeBytes = %llu\n"
-               "---------------------------\n"
-               "Total                = %llu\n"
-               "File Size            = %llu\n",
-                pixelSizeBytes,
-                sizeof(tBitmapFileHeader) + sizeof(tBitmapInfoHeader),
-                filePaddingSizeBytes, total, bitmapFileSizeBytes);
+    int rtn = 0;
 
-        errRtn = errorSize;
+    if (fpFile == stdout)
+    {
+        rtn = fflush(fpFile);
     }
 
-    else
+    else if (fpFile != stdin)
     {
-        errRtn = success;
+        rtn = fclose(fpFile);
     }
 
-    return errRtn;
+    return rtn;
 }
 
 
-/** @brief Creates the output bitmap from the two header files and image data 
- *         containing hidden information. 
- *  @param pFileHeader Pointer to the file header. 
- *  @param pInfoHeader Pointer to the info header.
- *  @param pData Pointer to image data with hidden information. 
- *  @param dataSize The size of the image data.
- *  @return An error value from enum eErrors. */
-tError createOutputBitmap(IN const tBitmapFileHeader * pFileHeader, 
-                          IN const tBitmapInfoHeader * pInfoHeader,
-                          IN const uint8_t * pData,
-                          IN uint64_t dataSize)
+/** @brief Closes a decoded output opened with stdioOpen, removing it again if
+ *         decoding into it failed, so data found part way through to have the
+ *         wrong passphrase or checksum leaves no partial file behind. What 
+ *         went to standard output can't be taken back.
+ *  @param fpOutput The output, or NULL if it was never opened.
+ *  @param outputFileName Name it was opened with.
+ *  @param errRtn Result of decoding into it.
+ *  @return errRtn, or errorFclose if the output couldn't be closed. */
+tError stdioFinish(IN FILE * fpOutput, IN const char * outputFileName, tError errRtn)
 {
-    tError errRtn = errorDefault;
-    FILE * fpOutputBitmap = NULL;
-    
-    if (pFileHeader == NULL || pInfoHeader == NULL || pData == NULL)
+    if (fpOutput != NULL && stdioClose(fpOutput) != success)
     {
-        errRtn = errorNull;
-        PRINT("NULL");
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
     }
 
-    else if ((fpOutputBitmap = fopen("out.bmp", "wb")) == NULL)
+    if (fpOutput != NULL && errRtn != success && !stdioFileName(outputFileName))
     {
-        errRtn = errorFopen;
-        ERROR_ERRNO_PRINT(errRtn);
+        unlink(outputFileName);
     }
 
-    else if (fseek(fpOutputBitmap, 0, SEEK_SET) != success)
+    return errRtn;
+}
+
+
+/** @brief Opens the data to hide. Standard input, which may be a pipe, is 
+ *         read into memory and opened from there so it can be sized and read
+ *         from the start again like any other data file.
+ *  @param fileName Name of the data file, or STDIO_FILE_NAME.
+ *  @param pfpDataFile Returns the open file. Close with fclose.
+ *  @param ppBuffer Returns the memory standard input was read into, or NULL.
+ *         Free with free() once the file is closed.
+ *  @return An error value from enum eErrors. */
+tError openDataFile(IN const char * fileName, 
+                    OUT FILE ** pfpDataFile, 
+                    OUT uint8_t ** ppBuffer)
+{
+    tError errRtn = errorDefault;
+    uint64_t size = 0;
+
+    *pfpDataFile = NULL;
+    *ppBuffer = NULL;
+
+    if (!stdioFileName(fileName) && (*pfpDataFile = fopen(fileName, "rb")) == NULL)
     {
-        errRtn = errorFseek;
+        errRtn = errorFopen;
         ERROR_ERRNO_PRINT(errRtn);
     }
 
-    else if (fwrite(pFileHeader, sizeof(tBitmapFileHeader), 1, fpOutputBitmap) != 1)
+    else if (!stdioFileName(fileName))
     {
-        errRtn = errorFwrite;
-        ERROR_ERRNO_PRINT(errRtn); 
+        errRtn = success;
     }
 
-    else if (fwrite(pInfoHeader, sizeof(tBitmapInfoHeader), 1, fpOutputBitmap) != 1)
+    else if ((errRtn = readWholeFile(fileName, ppBuffer, &size)) != success)
     {
-        errRtn = errorFwrite;
-        ERROR_ERRNO_PRINT(errRtn); 
+        ERROR_PRINT(errRtn);
     }
 
-    else if (fwrite(pData, dataSize, 1, fpOutputBitmap) != 1)
+    else if ((*pfpDataFile = fmemopen(*ppBuffer, size, "rb")) == NULL)
     {
-        errRtn = errorFwrite;
-        ERROR_ERRNO_PRINT(errRtn); 
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
     }
 
     else
     {
         errRtn = success;
     }
-    
-    if (fpOutputBitmap != NULL)
-    {
-        if (fclose(fpOutputBitmap) != success)
-        { 
-            errRtn = errorFclose;
-            ERROR_ERRNO_PRINT(errRtn);
-        }
-    }
+
     return errRtn;
 }
 
 
-/** @brief Reads the data from fpDataFile and stores it into the bitmap image 
- *         data, pData.
- *  @param fpDataFile File pointer to data to "hide" in image.
- *  @param dataFileName File name of data file to "hide" - used to get extension.
- *  @param pData Image data pointer returned with hidden data.
- *  @param dataSize Size of the data to hide in bytes.
- *  @param width Image width in bytes.
- *  @param padding Size of padding on line.
+/** @brief Moves a parsed bitmap on to offset bytes from its start. A pipe 
+ *         can't seek, but is only ever read through once: parseBitmap leaves
+ *         it at the end of the headers and it is read forward from there.
+ *  @param fpBitmap The bitmap, already parsed.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param offset Offset to move to, no less than the size of the headers.
  *  @return An error value from enum eErrors. */
-tError encodeDataFileContents(IN FILE * fpDataFile, 
-                              IN const char * dataFileName,
-                              IN_OUT uint8_t * pData, 
-                              uint64_t dataSize, 
-                              uint32_t width, 
-                              uint8_t padding)
+tError seekBitmap(IN FILE * fpBitmap, IN const tPixelLayout * pLayout, uint64_t offset)
 {
-    tError errRtn = errorDefault;
-    char * extension = NULL;
-    uint64_t dataIndex = 0;
-    uint8_t * pDataToEncode = NULL;
-    uint8_t * pDataToEncodeTemp = NULL;
-    uint8_t bitShift = 0;
-    uint64_t sizeOfDataToEncode = 0;
-    uint32_t extensionIndex = 0;
-    uint64_t encodedBytes = 0;
-    
-    if ((extension = strrchr(dataFileName, '.')) == NULL)
-    {
-        extension = ".\0\0\0";
-    }
+    tError errRtn = success;
+    uint8_t gap[GAP_COPY_SIZE];
+    uint64_t left = offset - pLayout->headerSize;
+    uint64_t count = 0;
 
-    if (fpDataFile == NULL || pData == NULL)
+    if (fseek(fpBitmap, offset, SEEK_SET) == success)
     {
-        errRtn = errorNull;
-        ERROR_PRINT(errRtn);
+        left = 0;
     }
 
-    else if ((errRtn = fileSize(fpDataFile, &sizeOfDataToEncode)) != success)
-    {
-        ERROR_PRINT(errRtn);
-    }
-    
-    else if (fseek(fpDataFile, 0, SEEK_SET) != success)
+    else if (errno != ESPIPE)
     {
         errRtn = errorFseek;
-        ERROR_PRINT(errRtn);
-    }
-    
-    else if (pData == NULL)
-    {
-        errRtn = errorNull;
-        ERROR_PRINT(errRtn);
+        ERROR_ERRNO_PRINT(errRtn);
     }
 
-    else if ((pDataToEncodeTemp = pDataToEncode = malloc(dataSize)) == NULL)
+    while (errRtn == success && left > 0)
     {
-        errRtn = errorMalloc;
-        ERROR_PRINT(errRtn);
-    }
+        count = left < sizeof(gap) ? left : sizeof(gap);
 
-    else if (fread(pDataToEncode, sizeof(uint8_t), sizeOfDataToEncode, fpDataFile)
-             != sizeOfDataToEncode)
-    {
-        errRtn = errorMalloc;
-        ERROR_PRINT(errRtn);
-    }
+        if (fread(gap, count, 1, fpBitmap) != 1)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
 
-    
-    else
-    {
-        bitShift = 0;
-        
-        /* Remove decimal point from extension */
-        extension = &extension[1];
+        left -= count;
+    }
 
-        while (dataIndex < PIXELS_TO_STORE_DATA_LEN)
-        { 
-            checkPadding(&dataIndex, width, padding);
+    return errRtn;
+}
 
-            /* Zero bits on pixel */
-            pData[dataIndex + BLUE]  &= ~BLUE_BITMASK;
-            pData[dataIndex + GREEN] &= ~GREEN_BITMASK;
-            pData[dataIndex + RED]   &= ~RED_BITMASK;
 
-            pData[dataIndex + BLUE]  |= (sizeOfDataToEncode >> bitShift) & BLUE_BITMASK;
-            bitShift += BLUE_BITS;
-            pData[dataIndex + GREEN] |= (sizeOfDataToEncode >> bitShift) & GREEN_BITMASK;
-            bitShift += GREEN_BITS;
-            pData[dataIndex + RED]   |= (sizeOfDataToEncode >> bitShift) & RED_BITMASK;
-            bitShift += RED_BITS;
+/** @brief Reads the whole of a file into memory. Works on pipes, which can't
+ *         be sized up front, by growing the buffer as data arrives.
+ *  @param fileName Name of the file, or STDIO_FILE_NAME for standard input.
+ *  @param ppData Returns the contents. Free with free().
+ *  @param pSize Returns the size of the contents in bytes.
+ *  @return An error value from enum eErrors. */
+tError readWholeFile(IN const char * fileName, OUT uint8_t ** ppData, OUT uint64_t * pSize)
+{
+    tError errRtn = success;
+    FILE * fpInput = stdin;
+    uint8_t * pData = NULL;
+    uint8_t * pGrown = NULL;
+    uint64_t allocated = 0;
+    uint64_t size = 0;
 
-            dataIndex += BYTES_IN_PIXEL;
-        }
+    if (!stdioFileName(fileName) && (fpInput = fopen(fileName, "rb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
 
-        encodedBytes = 0;
-        while (encodedBytes < EXTENSION_SIZE)
+    while (errRtn == success && !feof(fpInput))
+    {
+        if (size == allocated)
         {
-            checkPadding(&dataIndex, width, padding);
+            allocated = allocated > 0 ? allocated * 2 : DATA_CHUNK_SIZE;
 
-            pData[dataIndex + BLUE]  &= ~BLUE_BITMASK;
-            pData[dataIndex + GREEN] &= ~GREEN_BITMASK;
-            pData[dataIndex + RED]   &= ~RED_BITMASK;
-
-            /* If there are characters in extension string, copy the next 
-             * character to the current pixel */
-            if (extension[extensionIndex])
-            {    
-                pData[dataIndex + BLUE]  |=  extension[extensionIndex]                & BLUE_BITMASK;
-                pData[dataIndex + GREEN] |= (extension[extensionIndex] >> BLUE_BITS)  & GREEN_BITMASK;
-                pData[dataIndex + RED]   |= (extension[extensionIndex] >> (BLUE_BITS + GREEN_BITS)) & RED_BITMASK;
+            if ((pGrown = realloc(pData, allocated)) == NULL)
+            {
+                errRtn = errorMalloc;
+                ERROR_PRINT(errRtn);
             }
-             
-            dataIndex += BYTES_IN_PIXEL;
-            extensionIndex++;
-            encodedBytes++;
 
+            else
+            {
+                pData = pGrown;
+            }
         }
 
-        encodedBytes = 0;
-        while (encodedBytes < sizeOfDataToEncode)
+        if (errRtn == success)
         {
-            checkPadding(&dataIndex, width, padding);
-            
-            pData[dataIndex + BLUE]  &= ~BLUE_BITMASK;
-            pData[dataIndex + GREEN] &= ~GREEN_BITMASK;
-            pData[dataIndex + RED]   &= ~RED_BITMASK;
-
-            pData[dataIndex + BLUE]  |=  *pDataToEncode               & BLUE_BITMASK;
-            pData[dataIndex + GREEN] |= (*pDataToEncode >> BLUE_BITS) & GREEN_BITMASK;
-            pData[dataIndex + RED]   |= (*pDataToEncode >> (BLUE_BITS + GREEN_BITS))  & RED_BITMASK;
-
-            dataIndex += BYTES_IN_PIXEL;
+            size += fread(&pData[size], sizeof(uint8_t), allocated - size, fpInput);
 
-            pDataToEncode++;
-            encodedBytes++;
+            if (ferror(fpInput))
+            {
+                errRtn = errorFread;
+                ERROR_ERRNO_PRINT(errRtn);
+            }
         }
-        
-        errRtn = success;
+    }
+
+    if (fpInput != NULL && fpInput != stdin && fclose(fpInput) != success)
+    {
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    if (errRtn == success)
+    {
+        *ppData = pData;
+        *pSize = size;
+    }
+
+    else
+    {
+        free(pData);
     }
 
     return errRtn;
 }
 
 
-/** @brief Retrieves the file and info headers from the bitmap file as well as 
- *         how much padding there is at the end of the line and the size of the 
- *         image data in bytes 
- * @param fpBitmap File pointer to bitmap file.
- * @param pFileHeader File Header Structure to be populated.
- * @param pInfoHeader Info Header Structure to be populated.
- * @param pPadding Amount of padding on each line.
- * @param pSizeOfData Size of image data - both pixels and padding.
- * @return An error value from enum eErrors. */
-tError parseBitmap(IN FILE * fpBitmap, 
-                   OUT tBitmapFileHeader * pFileHeader, 
-                   OUT tBitmapInfoHeader * pInfoHeader, 
-                   OUT uint8_t * pPadding,
-                   OUT uint64_t * pSizeOfData)
+/** @brief Reads a passphrase from a file: its first line, without the line
+ *         ending.
+ *  @param fileName Name of the file, or STDIO_FILE_NAME for standard input.
+ *  @param ppPassphrase Returns the passphrase. Free with free().
+ *  @return An error value from enum eErrors. errorPassphrase if the first 
+ *          line is empty. */
+tError readPassphrase(IN const char * fileName, OUT char ** ppPassphrase)
 {
-    uint32_t widthBytes = 0;
     tError errRtn = errorDefault;
-    
-    if (pFileHeader == NULL || pInfoHeader == NULL || fpBitmap == NULL)
+    uint8_t * pData = NULL;
+    char * pPassphrase = NULL;
+    uint64_t size = 0;
+
+    if ((errRtn = readWholeFile(fileName, &pData, &size)) != success)
     {
-        errRtn = errorNull;
         ERROR_PRINT(errRtn);
     }
 
-    else if (fseek(fpBitmap, 0, SEEK_SET) != success)
+    else if ((pPassphrase = realloc(pData, size + 1)) == NULL)
     {
-        errRtn = errorFseek;
+        free(pData);
+        errRtn = errorMalloc;
         ERROR_PRINT(errRtn);
     }
 
-    else if (fread(pFileHeader, sizeof(tBitmapFileHeader), 1, fpBitmap) != 1)
+    else
     {
-        errRtn = errorFread;
-        ERROR_PRINT(errRtn);
+        pPassphrase[size] = '\0';
+        pPassphrase[strcspn(pPassphrase, "\r\n")] = '\0';
+        errRtn = success;
     }
 
-    else if (fread(pInfoHeader, sizeof(tBitmapInfoHeader), 1, fpBitmap) != 1)
+    if (errRtn == success && pPassphrase[0] == '\0')
     {
-        errRtn = errorFread;
+        free(pPassphrase);
+        errRtn = errorPassphrase;
         ERROR_PRINT(errRtn);
     }
 
-    else
+    else if (errRtn == success)
     {
-        widthBytes = pInfoHeader->width * BYTES_IN_PIXEL;
-
-        if (widthBytes % 4 != 0)
-        {
-             widthBytes += 4 - (widthBytes % 4);
-        }
-
-        *pPadding =  widthBytes - (pInfoHeader->width * BYTES_IN_PIXEL); 
-
-        *pSizeOfData = widthBytes  * pInfoHeader->height;
-    
-        errRtn = success;
-    }   
+        *ppPassphrase = pPassphrase;
+    }
 
     return errRtn;
 }
 
 
-/** @brief Creates memory at pData for the image data and copies across the 
- *         bytes from fpBitmap.
- *  @param fpBitmap File pointer to bitmap file.
- *  @param pData Pointer to data read from bitmap.
- *  @param dataSize Size of data to read from bitmap.
+/** @brief Writes memory out to a file.
+ *  @param fileName Name of the file, or STDIO_FILE_NAME for standard output.
+ *  @param pData The data to write.
+ *  @param size Size of pData in bytes.
  *  @return An error value from enum eErrors. */
-tError copyBitmapData(IN FILE * fpBitmap, OUT uint8_t ** pData, uint64_t dataSize)
+tError writeWholeFile(IN const char * fileName, IN const uint8_t * pData, uint64_t size)
 {
     tError errRtn = errorDefault;
+    FILE * fpOutput = stdout;
 
-    if ((*pData = malloc(dataSize)) == NULL)
-    {
-        errRtn = errorNull;
-        ERROR_PRINT(errRtn);
-    }
-
-    else if (fseek(fpBitmap, sizeof(tBitmapInfoHeader) + sizeof(tBitmapFileHeader),
-             SEEK_SET) != success)
+    if (!stdioFileName(fileName) && (fpOutput = fopen(fileName, "wb")) == NULL)
     {
-        errRtn = errorFseek;
+        errRtn = errorFopen;
         ERROR_ERRNO_PRINT(errRtn);
     }
 
-    else if (fread(*pData, sizeof(uint8_t), dataSize, fpBitmap) != dataSize)
+    else if (fwrite(pData, sizeof(uint8_t), size, fpOutput) != size || 
+             fflush(fpOutput) != success)
     {
-        errRtn = errorFread;
+        errRtn = errorFwrite;
         ERROR_ERRNO_PRINT(errRtn);
     }
-    
-    else if (*pData == NULL)
-    {
-        errRtn = errorNull;
-        ERROR_PRINT(errRtn);
-    }
-    
+
     else
     {
         errRtn = success;
     }
 
+    if (fpOutput != NULL && fpOutput != stdout && fclose(fpOutput) != success)
+    {
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
     return errRtn;
 }
 
 
-/** @brief Creates the output file for the decoded data. The output file retains
- *         its original extension.
- *  @param extension The extension of the hidden data / the extension of the 
- *        output file.
- *  @param pFileData Pointer to the decoded data to be written to the file.
- *  @param dataSizeBytes The size of the decoded data.
+/** @brief Compresses and hides data where the cover, the data or the output
+ *         may be a pipe. Compressed data is always hidden in a whole bitmap 
+ *         held in memory, so the cover and data are read in whole, the data 
+ *         hidden in the cover where it lies with hideInBitmap and the result
+ *         written out once.
+ *  @param coverFileName Name of the cover bitmap, or STDIO_FILE_NAME.
+ *  @param dataFileName Name of the data to hide, or STDIO_FILE_NAME. Data 
+ *         from standard input is recorded with no extension.
+ *  @param outputFileName Name of the bitmap to create, or STDIO_FILE_NAME.
+ *  @param pOptions Options given on the command line.
  *  @return An error value from enum eErrors. */
-tError createOutputFile(IN char * extension, 
-                        IN uint8_t * pFileData,
-                        uint64_t dataSizeBytes)
+tError encodePipe(IN const char * coverFileName,
+                  IN const char * dataFileName,
+                  IN const char * outputFileName,
+                  IN const tOptions * pOptions)
 {
     tError errRtn = errorDefault;
-    FILE * fpOutput = NULL;
-    char outputFileNameAndExt[OUTPUT_NAME_SIZE] = "decoded";
-    
-    if (extension != NULL)
+    uint8_t * pCover = NULL;
+    uint8_t * pData = NULL;
+    uint64_t coverSize = 0;
+    uint64_t dataSize = 0;
+
+    if (stdioFileName(coverFileName) && stdioFileName(dataFileName))
     {
-        if (strlen(extension))
-        {
-            snprintf(outputFileNameAndExt, OUTPUT_NAME_SIZE, "decoded.%s", extension);
-        }
+        errRtn = errorFileType;
+        ERROR_PRINT(errRtn);
     }
 
-    if (pFileData == NULL)
+    /* As encodeFile, compressed data can't be hidden in place */
+    else if (pOptions->inPlace || pOptions->clone)
     {
-        errRtn = errorNull;
+        errRtn = errorLayout;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((fpOutput = fopen(outputFileNameAndExt, "wb")) == NULL)
+    else if ((errRtn = readWholeFile(coverFileName, &pCover, &coverSize)) != success)
     {
-        errRtn = errorFopen;
-        ERROR_ERRNO_PRINT(errRtn);
+        ERROR_PRINT(errRtn);
     }
 
-    else if (fwrite(pFileData, dataSizeBytes, 1, fpOutput) != 1)
+    else if ((errRtn = readWholeFile(dataFileName, &pData, &dataSize)) != success)
     {
-        errRtn = errorFwrite;
-        ERROR_ERRNO_PRINT(errRtn); 
+        ERROR_PRINT(errRtn);
     }
-    
-    else
+
+    else if ((errRtn = hideInBitmap(pCover, coverSize, pData, dataSize, 
+                                    fileExtension(dataFileName), pOptions->bitsPerChannel,
+                                    pOptions->alpha, pOptions->compress, 
+                                    pOptions->passphrase, pOptions->pPool)) != success)
     {
-        errRtn = success;
+        ERROR_PRINT(errRtn);
     }
-    
-    if (fpOutput != NULL)
+
+    else if ((errRtn = writeWholeFile(outputFileName, pCover, coverSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    free(pCover);
+    free(pData);
+
+    return errRtn;
+}
+
+
+/** @brief Hides the checksum after the data, if the layout has one.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Image data to hide the checksum in.
+ *  @param position Position in the hidden stream of the checksum.
+ *  @param crc CRC32C of what is hidden between the header and the checksum.
+ *  @return An error value from enum eErrors. errorSize if the checksum runs
+ *          off the end of the image. */
+static tError hideChecksum(IN const tPixelLayout * pLayout,
+                           IN_OUT uint8_t * pImageData,
+                           uint64_t position,
+                           uint32_t crc)
+{
+    tError errRtn = success;
+    uint8_t checksum[CHECKSUM_SIZE];
+
+    if (position + checksumSize(pLayout) > hiddenBytesInRows(pLayout, pLayout->height))
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pLayout->checksummed)
     {
-        if (fclose(fpOutput) != success)
+        packChecksum(checksum, crc);
+
+        if ((errRtn = embedRows(pLayout, pImageData, position, checksum, CHECKSUM_SIZE)) 
+            != success)
         {
-            errRtn = errorFclose;
-            ERROR_ERRNO_PRINT(errRtn);
-        }   
+            ERROR_PRINT(errRtn);
+        }
     }
+
     return errRtn;
 }
 
 
-/** @brief Decodes the hidden data from the bitmap.
- *  @param encodedData Pointer to the bitmap.
- *  @param encodedDataSize The size of the bitmap
- *  @param startOfEncodedDataIndex The index which the image data begins.
- *  @param width The width of the bitmap. Required for padding calculations.
- *  @param padding The size of the line padding.
- *  @param decodedData Pointer to the memory where the decoded data is to be 
- *         stored.
- *  @return An error value from enum eErrors. */
-tError decodeData(IN uint8_t * encodedData,
-                  uint64_t encodedDataSize, 
-                  uint64_t startOfEncodedDataIndex,
-                  uint64_t width,
-                  uint64_t padding,
-                  OUT uint8_t * decodedData)
+/** @brief Compresses a chunk of the data being hidden and hides it at the 
+ *         next position in the hidden stream, so data is compressed as it is
+ *         hidden rather than all of it first.
+ *  @param pLayout Layout of the pixels in pImageData, with compressed set.
+ *  @param pImageData Image data to hide the chunk in.
+ *  @param pData The chunk of data, at most COMPRESS_CHUNK_SIZE bytes.
+ *  @param count Size of pData in bytes.
+ *  @param pPacked Space for the compressed chunk, COMPRESS_CHUNK_HEADER +
+ *         COMPRESS_CHUNK_SIZE bytes.
+ *  @param pCipher Cipher to encrypt the compressed chunk with, or NULL. 
+ *  @param pCrc CRC32C of what is hidden after the header, returned taking in
+ *         the chunk.
+ *  @param pPosition Position in the hidden stream to hide the chunk at, 
+ *         returned moved past it.
+ *  @return An error value from enum eErrors. errorSize if the chunk runs off
+ *          the end of the image. */
+static tError hideChunk(IN const tPixelLayout * pLayout,
+                        IN_OUT uint8_t * pImageData,
+                        IN const uint8_t * pData,
+                        uint64_t count,
+                        OUT uint8_t * pPacked,
+                        IN const tCipher * pCipher,
+                        IN_OUT uint32_t * pCrc,
+                        IN_OUT uint64_t * pPosition)
 {
-    tError errRtn = errorDefault;
-    uint64_t decodedDataIndex = 0;
-    uint64_t encodedDataIndex = startOfEncodedDataIndex;
+    tError errRtn = success;
+    uint64_t stored = compressChunk(pData, count, pPacked);
 
-    if (encodedData == NULL || decodedData == NULL)
+    if (*pPosition + stored > hiddenBytesInRows(pLayout, pLayout->height))
     {
-        errRtn = errorNull;
+        errRtn = errorSize;
         ERROR_PRINT(errRtn);
     }
-    
+
     else
     {
-        while (decodedDataIndex < encodedDataSize)
+        if (pCipher != NULL)
         {
-            checkPadding(&encodedDataIndex, width, padding); 
+            cipherApply(pCipher, *pPosition - HEADER_SIZE - CIPHER_PREFIX_SIZE, pPacked, 
+                        stored);
+        }
 
-            decodedData[decodedDataIndex]  =  encodedData[encodedDataIndex + BLUE]  & BLUE_BITMASK;
-            decodedData[decodedDataIndex] |= (encodedData[encodedDataIndex + GREEN] & GREEN_BITMASK) << BLUE_BITS;
-            decodedData[decodedDataIndex] |= (encodedData[encodedDataIndex + RED]   & RED_BITMASK)   << (BLUE_BITS + GREEN_BITS);
-            decodedDataIndex++;
-            encodedDataIndex += BYTES_IN_PIXEL;
+        *pCrc = crc32c(*pCrc, pPacked, stored);
+
+        if ((errRtn = embedRows(pLayout, pImageData, *pPosition, pPacked, stored)) != success)
+        {
+            ERROR_PRINT(errRtn);
         }
 
-        errRtn = success;
+        *pPosition += stored;
     }
+
     return errRtn;
 }
 
 
-/** @brief Parses the bitmap containing hidden information and retrieves the 
- *         index where the image starts, the extension of the hidden data and 
- *         the size of the hidden data.
- *  @param pImageData Pointer to the bitmap.
- *  @param imageDataSize The size of the bitmap image.
- *  @param padding Size of the padding on each "line".
- *  @param width The width of the image.
- *  @param pStartOfEncodedDataIndex The index at which the bitmap image starts 
- *         in pImageData.
- *  @param pExtension Pointer to memory to which will hold the original extension
- *         of the hidden data.
- *  @param pEncodedDataSize The size in bytes of the hidden data.
- *  @return An error value from enum eErrors. */
-tError parseEncodedData(IN uint8_t * pImageData, 
-                        uint64_t imageDataSize,
-                        uint8_t padding,
-                        uint64_t width,
-                        OUT uint64_t * pStartOfEncodedDataIndex, 
-                        OUT char * pExtension, 
-                        OUT uint64_t * pEncodedDataSize)
+/** @brief Hides data held in memory in a bitmap held in memory, in place.
+ *  @param pBitmap The whole bitmap file, headers included.
+ *  @param bitmapSize Size of pBitmap in bytes.
+ *  @param pData The data to hide.
+ *  @param dataSize Size of pData in bytes.
+ *  @param extension Extension to record for the data, without the decimal 
+ *         point. Only the first EXTENSION_SIZE characters are kept.
+ *  @param bitsPerChannel Data bits to hide in each channel byte, see 
+ *         tPixelLayout.
+ *  @param alpha Non zero to hide data in the alpha bytes too when the bitmap
+ *         is a 32 bit bitmap.
+ *  @param compress Non zero to compress the data as it is hidden, a chunk at
+ *         a time with hideChunk. Threads aren't used then.
+ *  @param passphrase Passphrase to encrypt the data with, or NULL. The data
+ *         is encrypted a chunk at a time in a copy, so threads aren't used 
+ *         then either.
+ *  @param pPool Threads to hide the data with, or NULL to use this thread.
+ *  @return An error value from enum eErrors. The bitmap is untouched unless
+ *          success is returned, or errorSize when compressed data is found 
+ *          part way through not to fit. */
+tError hideInBitmap(IN_OUT uint8_t * pBitmap, 
+                    uint64_t bitmapSize,
+                    IN const uint8_t * pData, 
+                    uint64_t dataSize,
+                    IN const char * extension,
+                    uint64_t bitsPerChannel,
+                    int alpha,
+                    int compress,
+                    IN const char * passphrase,
+                    IN tThreadPool * pPool)
 {
     tError errRtn = errorDefault;
-    uint64_t dataIndex = 0;
-    uint8_t bitShift = 0;
-    uint32_t extensionIndex = 0;
-    uint64_t decodedBytes = 0;
+    tBitmapFileHeader fileHeader;
+    tBitmapInfoHeader infoHeader;
+    tPixelLayout layout;
+    tCipher cipher;
+    tCipher * pCipher = passphrase != NULL ? &cipher : NULL;
+    uint64_t prefixSize = passphrase != NULL ? CIPHER_PREFIX_SIZE : 0;
+    uint8_t header[HEADER_SIZE];
+    uint8_t * pPacked = NULL;
+    uint64_t position = HEADER_SIZE + prefixSize;
+    uint64_t offset = 0;
+    uint64_t count = 0;
+    uint32_t crc = 0;
+
+    if (pBitmap == NULL || (pData == NULL && dataSize != 0) || extension == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = parseBitmapMemory(pBitmap, bitmapSize, &fileHeader, &infoHeader,
+                                         &layout)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = validateSizes(bitmapSize, layout.dataOffset, 
+                                     layout.rowBytes * layout.height,
+                                     layout.padding * layout.height)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = chooseLayout(&layout, bitsPerChannel, alpha, compress, 
+                                    pCipher != NULL)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
 
-    if (imageDataSize < (sizeof(tBitmapFileHeader) + sizeof(tBitmapInfoHeader) 
-        + DATA_SIZE + EXTENSION_SIZE))
+    /* Compressed data is only known not to fit once it has been compressed */
+    else if ((compress ? 0 : dataSize) + streamOverhead(&layout) > 
+             hiddenBytesInRows(&layout, layout.height))
     {
         errRtn = errorSize;
         ERROR_PRINT(errRtn);
     }
 
-    else
+    else if ((compress || pCipher != NULL) && 
+             (pPacked = malloc(COMPRESS_CHUNK_HEADER + COMPRESS_CHUNK_SIZE)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pCipher != NULL && (errRtn = cipherCreate(pCipher, passphrase)) != success)
     {
-        *pEncodedDataSize = 0;
+        ERROR_PRINT(errRtn);
+    }
 
-        decodedBytes = 0;
-        while (decodedBytes < DATA_SIZE)
-        {   
-            checkPadding(&dataIndex, width, padding);
+    else if (compress)
+    {
+        crc = pCipher != NULL ? crc32c(0, pCipher->prefix, CIPHER_PREFIX_SIZE) : 0;
+        errRtn = success;
 
-            *pEncodedDataSize |= (pImageData[dataIndex + BLUE]  & BLUE_BITMASK)  << bitShift;
-            bitShift  += BLUE_BITS; 
-            *pEncodedDataSize |= (pImageData[dataIndex + GREEN] & GREEN_BITMASK) << bitShift;
-            bitShift  += GREEN_BITS;
-            *pEncodedDataSize |= (pImageData[dataIndex + RED]   & RED_BITMASK)   << bitShift;
-            bitShift  += RED_BITS;
+        for (offset = 0; errRtn == success && offset < dataSize; offset += count)
+        {
+            count = dataSize - offset;
+            count = count < COMPRESS_CHUNK_SIZE ? count : COMPRESS_CHUNK_SIZE;
 
-            dataIndex += BYTES_IN_PIXEL;
-            decodedBytes++;
+            errRtn = hideChunk(&layout, &pBitmap[layout.dataOffset], &pData[offset], count, 
+                               pPacked, pCipher, &crc, &position);
         }
-        
-        decodedBytes = 0;
-        while (decodedBytes < EXTENSION_SIZE)
-        {   
-            checkPadding(&dataIndex, width, padding);
+    }
+
+    else if (pCipher != NULL)
+    {
+        crc = crc32c(0, pCipher->prefix, CIPHER_PREFIX_SIZE);
+        errRtn = success;
+
+        for (offset = 0; errRtn == success && offset < dataSize; offset += count)
+        {
+            count = dataSize - offset;
+            count = count < COMPRESS_CHUNK_SIZE ? count : COMPRESS_CHUNK_SIZE;
+
+            memcpy(pPacked, &pData[offset], count);
+            cipherApply(pCipher, offset, pPacked, count);
+            crc = crc32c(crc, pPacked, count);
 
-            pExtension[extensionIndex]  = (pImageData[dataIndex + BLUE]  & BLUE_BITMASK);
-            pExtension[extensionIndex] |= (pImageData[dataIndex + GREEN] & GREEN_BITMASK) << BLUE_BITS;
-            pExtension[extensionIndex] |= (pImageData[dataIndex + RED]   & RED_BITMASK)   << (BLUE_BITS + GREEN_BITS);
-            
-            extensionIndex++;
-            dataIndex += BYTES_IN_PIXEL;
-            decodedBytes++;
+            if ((errRtn = embedRows(&layout, &pBitmap[layout.dataOffset], position, pPacked, 
+                                    count)) != success)
+            {
+                ERROR_PRINT(errRtn);
+            }
 
+            position += count;
         }
+    }
+
+    else if (pPool != NULL &&
+             (errRtn = embedRowsParallel(pPool, &layout, &pBitmap[layout.dataOffset], 
+                                         HEADER_SIZE, pData, dataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
 
+    else if (pPool == NULL &&
+             (errRtn = embedRows(&layout, &pBitmap[layout.dataOffset], HEADER_SIZE, pData, 
+                                 dataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        crc = crc32c(0, pData, dataSize);
+        position += dataSize;
         errRtn = success;
     }
 
-    *pStartOfEncodedDataIndex = dataIndex;
+    /* The checksum and header go in last as they depend on the size 
+     * compressed chunks came to */
+    if (errRtn == success && 
+        (errRtn = hideChecksum(&layout, &pBitmap[layout.dataOffset], position, crc)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (errRtn == success && pCipher != NULL &&
+             (errRtn = embedRows(&layout, &pBitmap[layout.dataOffset], HEADER_SIZE, 
+                                 pCipher->prefix, CIPHER_PREFIX_SIZE)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (errRtn == success)
+    {
+        packHeader(header, position - HEADER_SIZE, layoutFlags(&layout), extension);
+
+        if ((errRtn = embedRows(&layout, &pBitmap[layout.dataOffset], 0, header, 
+                                HEADER_SIZE)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    free(pPacked);
+
     return errRtn;
 }
 
 
-/** @brief Checks the current index against the width of the image to calculate
- *         if image padding needs to be compensated for.
- *  @param pIndex The index to be checked. Incremented by padding when required.
- *  @param width The width of the bitmap image.
- *  @param padding The size of the padding in the bitmap.
+/** @brief Hides data held in memory in a copy of a bitmap held in memory.
+ *  @param pCover The whole cover bitmap file, headers included.
+ *  @param coverSize Size of pCover in bytes.
+ *  @param pData The data to hide.
+ *  @param dataSize Size of pData in bytes.
+ *  @param extension Extension to record for the data, without the decimal 
+ *         point. Only the first EXTENSION_SIZE characters are kept.
+ *  @param bitsPerChannel Data bits to hide in each channel byte, see 
+ *         tPixelLayout.
+ *  @param alpha Non zero to hide data in the alpha bytes too when the cover
+ *         is a 32 bit bitmap.
+ *  @param compress Non zero to compress the data as it is hidden.
+ *  @param passphrase Passphrase to encrypt the data with, or NULL.
+ *  @param pPool Threads to hide the data with, or NULL to use this thread.
+ *  @param ppStego Returns the bitmap with the data hidden in it, the same size
+ *         as the cover. Free with free().
+ *  @param pStegoSize Returns the size of *ppStego in bytes.
  *  @return An error value from enum eErrors. */
-tError checkPadding(IN_OUT uint64_t * pIndex, uint64_t width, uint64_t padding)
+tError encodeMemory(IN const uint8_t * pCover, 
+                    uint64_t coverSize,
+                    IN const uint8_t * pData, 
+                    uint64_t dataSize,
+                    IN const char * extension,
+                    uint64_t bitsPerChannel,
+                    int alpha,
+                    int compress,
+                    IN const char * passphrase,
+                    IN tThreadPool * pPool,
+                    OUT uint8_t ** ppStego, 
+                    OUT uint64_t * pStegoSize)
 {
     tError errRtn = errorDefault;
+    uint8_t * pStego = NULL;
 
-    if (pIndex == NULL)
+    if (pCover == NULL || ppStego == NULL || pStegoSize == NULL)
     {
         errRtn = errorNull;
         ERROR_PRINT(errRtn);
     }
 
-    else if ((*pIndex + 1) % width == 0)
+    else if ((pStego = malloc(coverSize)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        memcpy(pStego, pCover, coverSize);
+        errRtn = hideInBitmap(pStego, coverSize, pData, dataSize, extension, 
+                              bitsPerChannel, alpha, compress, passphrase, pPool);
+    }
+
+    if (errRtn == success)
+    {
+        *ppStego = pStego;
+        *pStegoSize = coverSize;
+    }
+
+    else
     {
-        *pIndex += padding;
+        free(pStego);
     }
 
     return errRtn;
 }
 
 
-/** @brief A debug function which prints out the elements of 
- *         a tBitmapFileHeader structure.
- *  @param pFileHeader The file header structure to be
- *         printed. */
-void printFileHeader(IN const tBitmapFileHeader * pFileHeader)
+/** @brief Recovers the data hidden in a bitmap held in memory.
+ *  @param pStego The whole bitmap file, headers included.
+ *  @param stegoSize Size of pStego in bytes.
+ *  @param passphrase Passphrase the data was encrypted with, or NULL.
+ *  @param pPool Threads to recover the data with, or NULL to use this thread.
+ *  @param ppData Returns the hidden data, decrypted if it was encrypted and 
+ *         expanded if it was compressed. Free with free().
+ *  @param pDataSize Returns the size of *ppData in bytes.
+ *  @param extension Returns the extension recorded for the data, without the
+ *         decimal point.
+ *  @return An error value from enum eErrors. errorChecksum if the data 
+ *          doesn't match its checksum. */
+tError decodeMemory(IN const uint8_t * pStego, 
+                    uint64_t stegoSize,
+                    IN const char * passphrase,
+                    IN tThreadPool * pPool,
+                    OUT uint8_t ** ppData, 
+                    OUT uint64_t * pDataSize,
+                    OUT char extension[EXTENSION_SIZE + 1])
 {
-    printf("\nFILE HEADER\n");
-    printf("type: %u\n"
-           "size: %u\n"
-           "offsetbits: %u\n",
-    pFileHeader->type,
-    pFileHeader->size,
-    pFileHeader->offsetbits);
-}
+    tError errRtn = errorDefault;
+    tBitmapFileHeader fileHeader;
+    tBitmapInfoHeader infoHeader;
+    tPixelLayout layout;
+    tCipher cipher;
+    uint64_t encodedDataPixel = 0;
+    uint64_t encodedDataSize = 0;
+    uint8_t * pData = NULL;
 
+    if (pStego == NULL || ppData == NULL || pDataSize == NULL || extension == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
 
-/** @brief A debug function which prints out the elements of 
- *         a tBitmapInfoHeader structure.
- *  @param pInfoHeader The info header structure to be
- *         printed. */
-void printInfoHeader(IN const tBitmapInfoHeader * pInfoHeader)
-{
-    printf("\nINFO HEADER\n");
-    printf("size: %u\n"
-           "width: %u\n"
-           "height: %u\n"
-           "planes: %u\n"
-           "bitsPerPixel: %u\n"
-           "compressionType: %u\n"
-           "imageDataSize: %u\n"
-           "horizontalResolution: %d\n"
-           "verticalResolution: %d\n"
-           "numberOfColours: %u\n"
-           "numberOfImportantColours:%u\n",
-    pInfoHeader->size, pInfoHeader->width, pInfoHeader->height, pInfoHeader->planes,
-    pInfoHeader->bitsPerPixel,pInfoHeader->compressionType, 
-    pInfoHeader->imageDataSize, pInfoHeader->horizontalResolution,
-    pInfoHeader->verticalResolution, pInfoHeader->numberOfColours, 
-    pInfoHeader->numberOfImportantColours);
-}
+    else if ((errRtn = parseBitmapMemory(pStego, stegoSize, &fileHeader, &infoHeader,
+                                         &layout)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = parseEncodedData(&pStego[layout.dataOffset], &layout, 
+                                        &encodedDataPixel, extension, 
+                                        &encodedDataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* Never ask for nothing, so an empty result is still a valid pointer */
+    else if ((pData = malloc(encodedDataSize + checksumSize(&layout) + 1)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = decodeData(&pStego[layout.dataOffset], &layout, 
+                                  encodedDataSize + checksumSize(&layout), 
+                                  encodedDataPixel, pData, pPool)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        free(pData);
+    }
+
+    else if (layout.checksummed && 
+             crc32c(0, pData, encodedDataSize) != unpackChecksum(&pData[encodedDataSize]))
+    {
+        errRtn = errorChecksum;
+        ERROR_PRINT(errRtn);
+        free(pData);
+    }
+
+    else if (layout.encrypted && (errRtn = cipherOpen(&cipher, passphrase, pData)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        free(pData);
+    }
+
+    else
+    {
+        /* The prefix is dropped once it has keyed the cipher */
+        if (layout.encrypted)
+        {
+            encodedDataSize -= CIPHER_PREFIX_SIZE;
+            memmove(pData, &pData[CIPHER_PREFIX_SIZE], encodedDataSize);
+            cipherApply(&cipher, 0, pData, encodedDataSize);
+        }
+
+        extension[EXTENSION_SIZE] = '\0';
+
+        if (layout.compressed)
+        {
+            errRtn = expandMemory(pData, encodedDataSize, ppData, pDataSize);
+            free(pData);
+        }
+
+        else
+        {
+            *ppData = pData;
+            *pDataSize = encodedDataSize;
+
+            errRtn = success;
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Finds out what is hidden in a bitmap without reading its image. 
+ *         The headers and the first few rows, enough to hold the hidden 
+ *         header, are fetched with one read from the start of the file, or a
+ *         second if the image data starts further on, and the rest of the file
+ *         is never touched. Standard input, which may be a pipe, is read in 
+ *         whole.
+ *  @param bitmapFileName Name of the bitmap to probe, or STDIO_FILE_NAME.
+ *  @param pProbe Returns what was found.
+ *  @param pLayout Returns the layout of the bitmap and the hidden data.
+ *  @return An error value from enum eErrors. errorSize or errorLayout mean
+ *          the header doesn't describe data which fits in the bitmap, so 
+ *          there most likely isn't any. */
+tError probeBitmap(IN const char * bitmapFileName, OUT tProbe * pProbe, 
+                   OUT tPixelLayout * pLayout)
+{
+    tError errRtn = errorDefault;
+    uint8_t buffer[sizeof(tBitmapFileHeader) + sizeof(tBitmapInfoHeader) + PROBE_IMAGE_SIZE];
+    uint8_t * pImage = NULL;
+    uint8_t * pWhole = NULL;
+    uint64_t wholeSize = 0;
+    tBitmapFileHeader fileHeader;
+    tBitmapInfoHeader infoHeader;
+    struct stat fileStatus;
+    ssize_t bytesRead = 0;
+    uint64_t bytesWanted = 0;
+    uint64_t startPixel = 0;
+    int fdBitmap = -1;
+
+    memset(pProbe, 0, sizeof(tProbe));
+    memset(pLayout, 0, sizeof(tPixelLayout));
+
+    if (stdioFileName(bitmapFileName))
+    {
+        if ((errRtn = readWholeFile(bitmapFileName, &pWhole, &wholeSize)) != success ||
+            (errRtn = parseBitmapMemory(pWhole, wholeSize, &fileHeader, &infoHeader,
+                                        pLayout)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            pImage = &pWhole[pLayout->dataOffset];
+        }
+    }
+
+    else if ((fdBitmap = open(bitmapFileName, O_RDONLY)) < 0)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (fstat(fdBitmap, &fileStatus) != success)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((bytesRead = pread(fdBitmap, buffer, sizeof(buffer), 0)) < 
+             (ssize_t)PIXEL_DATA_OFFSET)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (buffer[0] != 'B' || buffer[1] != 'M' ||
+             unpackBitmapHeaders(buffer, bytesRead, &fileHeader, &infoHeader) == 0 ||
+             !supportedBitmap(&infoHeader) ||
+             pixelLayout(&fileHeader, &infoHeader, pLayout) != success)
+    {
+        errRtn = errorFileType;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((uint64_t)fileStatus.st_size < pLayout->dataOffset + 
+                                            pLayout->sizeOfData)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        bytesWanted = pLayout->sizeOfData;
+        bytesWanted = bytesWanted < PROBE_IMAGE_SIZE ? bytesWanted : PROBE_IMAGE_SIZE;
+
+        if (pLayout->dataOffset + bytesWanted <= (uint64_t)bytesRead)
+        {
+            pImage = &buffer[pLayout->dataOffset];
+        }
+
+        else if (pread(fdBitmap, buffer, bytesWanted, pLayout->dataOffset) == 
+                 (ssize_t)bytesWanted)
+        {
+            pImage = buffer;
+        }
+
+        else
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    if (pImage != NULL && 
+        (errRtn = parseEncodedData(pImage, pLayout, &startPixel, 
+                                   pProbe->extension, &pProbe->dataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pImage != NULL)
+    {
+        pProbe->capacity = hiddenBytesInRows(pLayout, pLayout->height);
+        pProbe->capacity -= pProbe->capacity > streamOverhead(pLayout) ? 
+                            streamOverhead(pLayout) : pProbe->capacity;
+        errRtn = success;
+    }
+
+    if (fdBitmap >= 0)
+    {
+        if (close(fdBitmap) != success)
+        {
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    free(pWhole);
+
+    return errRtn;
+}
+
+
+/** @brief Finds out what is hidden in a bitmap without reading its image, as
+ *         probeBitmap does.
+ *  @param bitmapFileName Name of the bitmap to probe, or STDIO_FILE_NAME.
+ *  @param pProbe Returns what was found.
+ *  @return An error value from enum eErrors, as from probeBitmap. */
+tError probeFile(IN const char * bitmapFileName, OUT tProbe * pProbe)
+{
+    tError errRtn = errorDefault;
+    tPixelLayout layout;
+
+    if (bitmapFileName == NULL || pProbe == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = probeBitmap(bitmapFileName, pProbe, &layout)) == success)
+    {
+        pProbe->bitsPerChannel = layout.bitsPerChannel;
+        pProbe->alpha = layout.alpha;
+        pProbe->compressed = layout.compressed;
+        pProbe->encrypted = layout.encrypted;
+        pProbe->checksummed = layout.checksummed;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Returns the file size of an open file
+ *  @param fpFile File to get the size of.
+ *  @param size Returns the file size.
+ *  @return An error value from enum eErrors. */
+tError fileSize(IN FILE * fpFile, OUT uint64_t * size)
+{
+    tError errRtn = errorDefault;
+
+    if (fpFile == NULL || size == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        fseek(fpFile, 0, SEEK_END);
+        *size = ftell(fpFile);
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Validates the file sizes are correct when encoding information to a
+ *         bitmap.
+ *  @param bitmapFileSizeBytes Size of the bitmap in bytes.
+ *  @param dataOffsetBytes Offset of the image data from the start of the file.
+ *  @param pixelSizeBytes Size of all valid pixels in bytes.
+ *  @param filePaddingSizeBytes Total padding size in bytes.
+ *  @return An error value from enum eErrors. */
+tError validateSizes(uint64_t bitmapFileSizeBytes, uint64_t dataOffsetBytes,
+                     uint64_t pixelSizeBytes, uint64_t filePaddingSizeBytes)
+{
+    tError errRtn = errorDefault;
+    uint64_t total = pixelSizeBytes + dataOffsetBytes + filePaddingSizeBytes;
+    
+    if (bitmapFileSizeBytes != total)
+    {
+        errRtn = errorSize;
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Writes the headers of a bitmap being created: the file and info 
+ *         headers and any colour masks after them, then whatever lies between
+ *         those and the image data, copied from the cover or written as zeros.
+ *  @param fpOutput The bitmap being created.
+ *  @param pFileHeader File header of the cover.
+ *  @param pInfoHeader Info header of the cover.
+ *  @param fpCover The cover, at the end of its headers, or NULL.
+ *  @return An error value from enum eErrors. */
+tError writeBitmapHeaders(IN FILE * fpOutput,
+                          IN const tBitmapFileHeader * pFileHeader,
+                          IN const tBitmapInfoHeader * pInfoHeader,
+                          IN FILE * fpCover)
+{
+    tError errRtn = success;
+    uint8_t gap[GAP_COPY_SIZE] = {0};
+    uint64_t headerSize = bitmapHeaderSize(pInfoHeader);
+    uint64_t left = pFileHeader->offsetbits - headerSize;
+    uint64_t count = 0;
+
+    if (fwrite(pFileHeader, sizeof(tBitmapFileHeader), 1, fpOutput) != 1 ||
+        fwrite(pInfoHeader, headerSize - sizeof(tBitmapFileHeader), 1, fpOutput) != 1)
+    {
+        errRtn = errorFwrite;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    while (errRtn == success && left > 0)
+    {
+        count = left < sizeof(gap) ? left : sizeof(gap);
+
+        if (fpCover != NULL && fread(gap, count, 1, fpCover) != 1)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if (fwrite(gap, count, 1, fpOutput) != 1)
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        left -= count;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Creates the output bitmap from the two header files and image data 
+ *         containing hidden information. Anything between the headers and
+ *         the image data, such as a colour profile, is copied from the cover 
+ *         or written as zeros.
+ *  @param outputFileName Name of the bitmap to create.
+ *  @param pFileHeader Pointer to the file header. 
+ *  @param pInfoHeader Pointer to the info header.
+ *  @param pData Pointer to image data with hidden information. 
+ *  @param dataSize The size of the image data.
+ *  @param fpCover The cover the headers were read from, or NULL.
+ *  @return An error value from enum eErrors. */
+tError createOutputBitmap(IN const char * outputFileName,
+                          IN const tBitmapFileHeader * pFileHeader, 
+                          IN const tBitmapInfoHeader * pInfoHeader,
+                          IN const uint8_t * pData,
+                          IN uint64_t dataSize,
+                          IN FILE * fpCover)
+{
+    tError errRtn = errorDefault;
+    FILE * fpOutputBitmap = NULL;
+    
+    if (pFileHeader == NULL || pInfoHeader == NULL || pData == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((fpOutputBitmap = stdioOpen(outputFileName, "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (fseek(fpOutputBitmap, 0, SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (fpCover != NULL && 
+             fseek(fpCover, bitmapHeaderSize(pInfoHeader), SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = writeBitmapHeaders(fpOutputBitmap, pFileHeader, pInfoHeader, 
+                                          fpCover)) != success)
+    {
+        ERROR_PRINT(errRtn); 
+    }
+
+    else if (fwrite(pData, dataSize, 1, fpOutputBitmap) != 1)
+    {
+        errRtn = errorFwrite;
+        ERROR_ERRNO_PRINT(errRtn); 
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+    
+    if (fpOutputBitmap != NULL)
+    {
+        if (stdioClose(fpOutputBitmap) != success)
+        { 
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+    return errRtn;
+}
+
+
+/** @brief Reads the data from fpDataFile and stores it into the bitmap image 
+ *         data, pData. The data is read and hidden DATA_CHUNK_SIZE bytes at a
+ *         time.
+ *  @param fpDataFile File pointer to data to "hide" in image.
+ *  @param dataFileName File name of data file to "hide" - used to get extension.
+ *  @param pData Image data pointer returned with hidden data.
+ *  @param pLayout Layout of the pixels in pData.
+ *  @param pCipher Cipher to encrypt the data with, or NULL. The layout says
+ *         whether to encrypt.
+ *  @param pPool Threads to hide the data with, or NULL to use this thread. 
+ *         With threads a regular data file is mapped and hidden in one go,
+ *         unless the layout says to compress or encrypt it.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. */
+tError encodeDataFileContents(IN FILE * fpDataFile, 
+                              IN const char * dataFileName,
+                              IN_OUT uint8_t * pData, 
+                              IN const tPixelLayout * pLayout,
+                              IN const tCipher * pCipher,
+                              IN tThreadPool * pPool,
+                              IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    uint8_t * pChunk = NULL;
+    uint64_t sizeOfDataToEncode = 0;
+    uint64_t prefixSize = pLayout != NULL && pLayout->encrypted ? CIPHER_PREFIX_SIZE : 0;
+    uint64_t position = 0;
+    uint64_t count = 0;
+    uint64_t hidden = 0;
+    tHiddenSource source;
+    uint8_t * pMappedData = MAP_FAILED;
+    
+    if (fpDataFile == NULL || pData == NULL || pLayout == NULL ||
+        (pLayout->encrypted && pCipher == NULL))
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = fileSize(fpDataFile, &sizeOfDataToEncode)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fseek(fpDataFile, 0, SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = reserveBuffers(pBuffers, 0, pLayout->compressed ? COMPRESS_BUFFER_SIZE :
+                                                                         DATA_CHUNK_SIZE)) 
+             != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        pChunk = pBuffers->pBytes;
+        hiddenSourceCreate(&source, fpDataFile, dataFileName, pLayout, 
+                           prefixSize + sizeOfDataToEncode, pCipher);
+
+        errRtn = success;
+    }
+
+    /* Mapping fails for anything which isn't a regular file, and for empty
+     * ones, which the chunked loop below handles instead. The mapping is 
+     * read only, so encrypted data goes through the loop too */
+    if (errRtn == success && pPool != NULL && !pLayout->compressed && !pLayout->encrypted &&
+        (pMappedData = mmap(NULL, sizeOfDataToEncode, PROT_READ, MAP_PRIVATE, 
+                            fileno(fpDataFile), 0)) != MAP_FAILED)
+    {
+        if ((errRtn = embedRows(pLayout, pData, 0, source.header, HEADER_SIZE)) != success ||
+            (errRtn = embedRowsParallel(pPool, pLayout, pData, HEADER_SIZE, pMappedData, 
+                                        sizeOfDataToEncode)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        /* The loop below then only has the checksum left to hide */
+        source.crc = crc32c(0, pMappedData, sizeOfDataToEncode);
+        munmap(pMappedData, sizeOfDataToEncode);
+        position = HEADER_SIZE + sizeOfDataToEncode;
+    }
+
+    while (errRtn == success && !pLayout->compressed && position < source.end)
+    {
+        count = source.end - position;
+        count = count < DATA_CHUNK_SIZE ? count : DATA_CHUNK_SIZE;
+
+        if ((errRtn = readHiddenBytes(&source, position, pChunk, count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if ((errRtn = embedRows(pLayout, pData, position, pChunk, count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            position += count;
+        }
+    }
+
+    /* Compressed chunks are hidden as each is read, and the checksum and the
+     * header, which holds the size they come to, once they all have been */
+    if (errRtn == success && pLayout->compressed && pLayout->encrypted &&
+        (errRtn = embedRows(pLayout, pData, HEADER_SIZE, pCipher->prefix, 
+                            CIPHER_PREFIX_SIZE)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (errRtn == success && pLayout->compressed && pLayout->encrypted)
+    {
+        source.crc = crc32c(0, pCipher->prefix, CIPHER_PREFIX_SIZE);
+    }
+
+    for (position = HEADER_SIZE + prefixSize; errRtn == success && pLayout->compressed && 
+         hidden < sizeOfDataToEncode; hidden += count)
+    {
+        count = sizeOfDataToEncode - hidden;
+        count = count < COMPRESS_CHUNK_SIZE ? count : COMPRESS_CHUNK_SIZE;
+
+        if (fread(pChunk, sizeof(uint8_t), count, fpDataFile) != count)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if ((errRtn = hideChunk(pLayout, pData, pChunk, count, &pChunk[COMPRESS_CHUNK_SIZE],
+                                     pCipher, &source.crc, &position)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    if (errRtn == success && pLayout->compressed &&
+        (errRtn = hideChecksum(pLayout, pData, position, source.crc)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (errRtn == success && pLayout->compressed)
+    {
+        packHeader(source.header, position - HEADER_SIZE, layoutFlags(pLayout), 
+                   fileExtension(dataFileName));
+
+        if ((errRtn = embedRows(pLayout, pData, 0, source.header, HEADER_SIZE)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Hides the data from fpDataFile in a copy of the bitmap, streaming
+ *         both through a block of a few rows. Only the rows holding hidden 
+ *         bytes are embedded; the rows after them are copied across as they 
+ *         are. Memory use is bounded by STREAM_BLOCK_SIZE (or a single row if
+ *         larger) whatever the size of the bitmap or data.
+ *  @param fpBitmap File pointer to the cover bitmap, already parsed.
+ *  @param fpDataFile File pointer to data to "hide" in image.
+ *  @param dataFileName File name of data file to "hide" - used to get extension.
+ *  @param pFileHeader File header of the cover bitmap.
+ *  @param pInfoHeader Info header of the cover bitmap.
+ *  @param pLayout Layout of the pixels in the cover bitmap.
+ *  @param dataSize Size of what is hidden after the header in bytes: the data,
+ *         and the cipher's prefix when encrypting.
+ *  @param pCipher Cipher to encrypt the data with, or NULL.
+ *  @param outputFileName Name of the bitmap to create.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. */
+tError encodeStream(IN FILE * fpBitmap,
+                    IN FILE * fpDataFile,
+                    IN const char * dataFileName,
+                    IN const tBitmapFileHeader * pFileHeader,
+                    IN const tBitmapInfoHeader * pInfoHeader,
+                    IN const tPixelLayout * pLayout,
+                    uint64_t dataSize,
+                    IN const tCipher * pCipher,
+                    IN const char * outputFileName,
+                    IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    FILE * fpOutput = NULL;
+    uint8_t * pBlock = NULL;
+    uint8_t * pHidden = NULL;
+    uint64_t rowsPerBlock = streamBlockRows(pLayout);
+    uint64_t rows = 0;
+    uint64_t row = 0;
+    uint64_t position = 0;
+    uint64_t count = 0;
+    tHiddenSource source;
+
+    hiddenSourceCreate(&source, fpDataFile, dataFileName, pLayout, dataSize, pCipher);
+
+    if ((errRtn = reserveBuffers(pBuffers, rowsPerBlock * pLayout->widthBytes,
+                                 rowsPerBlock * pLayout->widthBytes)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = seekBitmap(fpBitmap, pLayout, pLayout->headerSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fseek(fpDataFile, 0, SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    /* Opening the output truncates it, so it can't be what is read from */
+    else if (sameFile(fileno(fpBitmap), outputFileName) || 
+             sameFile(fileno(fpDataFile), outputFileName))
+    {
+        errRtn = errorSameFile;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((fpOutput = stdioOpen(outputFileName, "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = writeBitmapHeaders(fpOutput, pFileHeader, pInfoHeader, fpBitmap)) 
+             != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        pBlock  = pBuffers->pBlock;
+        pHidden = pBuffers->pBytes;
+        errRtn = success;
+    }
+
+    while (errRtn == success && row < pLayout->height)
+    {
+        rows = pLayout->height - row;
+        rows = rows < rowsPerBlock ? rows : rowsPerBlock;
+
+        /* Hidden bytes carry on from one block to the next. No byte is split
+         * between two blocks, see streamBlockRows. */
+        count = hiddenBytesInRows(pLayout, row + rows);
+        count = count < source.end ? count : source.end;
+        count -= position;
+
+        if (fread(pBlock, pLayout->widthBytes, rows, fpBitmap) != rows)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if (count > 0 && 
+                 (errRtn = readHiddenBytes(&source, position, pHidden, count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if (count > 0 && 
+                 (errRtn = embedBlock(pLayout, pBlock, row, position, pHidden, count)) 
+                 != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if (fwrite(pBlock, pLayout->widthBytes, rows, fpOutput) != rows)
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        position += count;
+        row += rows;
+    }
+
+    if (fpOutput != NULL)
+    {
+        if (stdioClose(fpOutput) != success)
+        {
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Hides the data from fpDataFile in a bitmap by changing the file 
+ *         itself. Only the rows holding hidden bytes are read and written 
+ *         back, a block at a time; the headers and the rest of the image are
+ *         left alone, so a small payload costs a few rows of I/O however big
+ *         the bitmap is.
+ *  @param bitmapFileName Name of the bitmap to change, already parsed.
+ *  @param fpDataFile File pointer to data to "hide" in image.
+ *  @param dataFileName File name of data file to "hide" - used to get extension.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param dataSize Size of what is hidden after the header in bytes: the data,
+ *         and the cipher's prefix when encrypting.
+ *  @param pCipher Cipher to encrypt the data with, or NULL.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. */
+tError encodeInPlace(IN const char * bitmapFileName,
+                     IN FILE * fpDataFile,
+                     IN const char * dataFileName,
+                     IN const tPixelLayout * pLayout,
+                     uint64_t dataSize,
+                     IN const tCipher * pCipher,
+                     IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    uint64_t rowsPerBlock = streamBlockRows(pLayout);
+    uint64_t usedRows = 0;
+    uint64_t rows = 0;
+    uint64_t row = 0;
+    uint64_t position = 0;
+    uint64_t count = 0;
+    tHiddenSource source;
+    int fdBitmap = -1;
+
+    hiddenSourceCreate(&source, fpDataFile, dataFileName, pLayout, dataSize, pCipher);
+
+    /* Rows up to the one holding the channel after the last hidden byte */
+    usedRows = (hiddenChannel(pLayout, source.end) + pLayout->rowBytes - 1) / 
+               pLayout->rowBytes;
+    usedRows = usedRows < pLayout->height ? usedRows : pLayout->height;
+
+    if ((errRtn = reserveBuffers(pBuffers, rowsPerBlock * pLayout->widthBytes,
+                                 rowsPerBlock * pLayout->widthBytes)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fseek(fpDataFile, 0, SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((fdBitmap = open(bitmapFileName, O_RDWR)) < 0)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    while (errRtn == success && row < usedRows)
+    {
+        rows = usedRows - row;
+        rows = rows < rowsPerBlock ? rows : rowsPerBlock;
+
+        /* As with encodeStream no byte is split between two blocks */
+        count = hiddenBytesInRows(pLayout, row + rows);
+        count = count < source.end ? count : source.end;
+        count -= position;
+
+        if (pread(fdBitmap, pBuffers->pBlock, rows * pLayout->widthBytes, 
+                  pLayout->dataOffset + row * pLayout->widthBytes) != 
+            (ssize_t)(rows * pLayout->widthBytes))
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if ((errRtn = readHiddenBytes(&source, position, pBuffers->pBytes, count)) 
+                 != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if ((errRtn = embedBlock(pLayout, pBuffers->pBlock, row, position, 
+                                      pBuffers->pBytes, count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if (pwrite(fdBitmap, pBuffers->pBlock, rows * pLayout->widthBytes, 
+                        pLayout->dataOffset + row * pLayout->widthBytes) != 
+                 (ssize_t)(rows * pLayout->widthBytes))
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        position += count;
+        row += rows;
+    }
+
+    if (fdBitmap >= 0)
+    {
+        if (close(fdBitmap) != success)
+        {
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Copies a file, leaving the copying to the kernel where possible.
+ *         Filesystems which share extents between files (btrfs, XFS) clone
+ *         it without copying any data at all. Otherwise copy_file_range 
+ *         copies it within the kernel, and if that isn't supported either it
+ *         is read and written a window at a time.
+ *  @param sourceFileName Name of the file to copy.
+ *  @param destinationFileName Name of the copy, replaced if it exists. It 
+ *         can't be the source.
+ *  @return An error value from enum eErrors. */
+tError cloneFile(IN const char * sourceFileName, IN const char * destinationFileName)
+{
+    tError errRtn = errorDefault;
+    struct stat fileStatus;
+    loff_t sourceOffset = 0;
+    loff_t destinationOffset = 0;
+    ssize_t copied = 0;
+    uint8_t * pWindow = NULL;
+    int fdSource = -1;
+    int fdDestination = -1;
+    int cloned = 0;
+
+    if ((fdSource = open(sourceFileName, O_RDONLY)) < 0)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (fstat(fdSource, &fileStatus) != success)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    /* Opening the destination truncates it, which would empty the source */
+    else if (sameFile(fdSource, destinationFileName))
+    {
+        errRtn = errorSameFile;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((fdDestination = open(destinationFileName, O_WRONLY | O_CREAT | O_TRUNC, 
+                                   0666)) < 0)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+#if defined(FICLONE)
+        cloned = ioctl(fdDestination, FICLONE, fdSource) == success;
+#endif
+        errRtn = success;
+    }
+
+    while (errRtn == success && !cloned && sourceOffset < fileStatus.st_size)
+    {
+        if ((copied = copy_file_range(fdSource, &sourceOffset, fdDestination, 
+                                      &destinationOffset, 
+                                      fileStatus.st_size - sourceOffset, 0)) <= 0)
+        {
+            /* Not supported here, copy the rest by hand */
+            break;
+        }
+    }
+
+    if (errRtn == success && !cloned && sourceOffset < fileStatus.st_size &&
+        (pWindow = malloc(COPY_WINDOW_SIZE)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    while (errRtn == success && !cloned && sourceOffset < fileStatus.st_size)
+    {
+        if ((copied = pread(fdSource, pWindow, COPY_WINDOW_SIZE, sourceOffset)) <= 0)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if (pwrite(fdDestination, pWindow, copied, sourceOffset) != copied)
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else
+        {
+            sourceOffset += copied;
+        }
+    }
+
+    free(pWindow);
+
+    if (fdSource >= 0 && close(fdSource) != success)
+    {
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    if (fdDestination >= 0 && close(fdDestination) != success)
+    {
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Works out how many rows make up one block when streaming a bitmap:
+ *         as many as fit in STREAM_BLOCK_SIZE, but at least one and no more 
+ *         than the image has. Blocks are a multiple of 8 rows, and so of 8
+ *         channel bytes, so that no hidden byte is split between two of them.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @return Number of rows in a block. */
+uint64_t streamBlockRows(IN const tPixelLayout * pLayout)
+{
+    uint64_t rows = STREAM_BLOCK_SIZE / (pLayout->widthBytes + 1);
+
+    rows = rows > 8 ? rows & ~(uint64_t)7 : 8;
+
+    return rows < pLayout->height ? rows : pLayout->height;
+}
+
+
+/** @brief Sets up a tHiddenSource to hide the contents of a data file.
+ *  @param pSource The source.
+ *  @param fpDataFile File pointer to the data being hidden, at its start.
+ *  @param dataFileName File name of the data - used to get extension.
+ *  @param pLayout Layout the data is hidden with.
+ *  @param dataSize Size of what is hidden after the header in bytes: the data,
+ *         and the cipher's prefix when encrypting.
+ *  @param pCipher Cipher to encrypt the data with, or NULL. */
+void hiddenSourceCreate(OUT tHiddenSource * pSource,
+                        IN FILE * fpDataFile,
+                        IN const char * dataFileName,
+                        IN const tPixelLayout * pLayout,
+                        uint64_t dataSize,
+                        IN const tCipher * pCipher)
+{
+    memset(pSource, 0, sizeof(tHiddenSource));
+    packHeader(pSource->header, dataSize, layoutFlags(pLayout), fileExtension(dataFileName));
+
+    pSource->pCipher = pCipher;
+    pSource->fpData = fpDataFile;
+    pSource->checksumPosition = HEADER_SIZE + dataSize;
+    pSource->end = pSource->checksumPosition + checksumSize(pLayout);
+}
+
+
+/** @brief Copies bytes of the hidden stream into pBuffer: the header, the 
+ *         cipher's prefix when encrypting, the contents of the data file and
+ *         the checksum. Data is read from the current position of the data 
+ *         file and encrypted as it is, and the checksum worked out as the 
+ *         bytes before it go by, so calls must walk the stream in order.
+ *  @param pSource The source of the stream.
+ *  @param position Offset into the hidden stream of the first byte wanted.
+ *  @param pBuffer Buffer to copy the bytes to.
+ *  @param count Number of bytes wanted, at most up to the end of the stream.
+ *  @return An error value from enum eErrors. */
+tError readHiddenBytes(IN_OUT tHiddenSource * pSource,
+                       uint64_t position,
+                       OUT uint8_t * pBuffer,
+                       uint64_t count)
+{
+    tError errRtn = success;
+    uint64_t prefixSize = pSource->pCipher != NULL ? CIPHER_PREFIX_SIZE : 0;
+    uint64_t fromHeader = 0;
+    uint64_t done = 0;
+    uint64_t part = 0;
+    uint8_t checksum[CHECKSUM_SIZE];
+
+    if (position < HEADER_SIZE)
+    {
+        fromHeader = HEADER_SIZE - position;
+        fromHeader = fromHeader < count ? fromHeader : count;
+
+        memcpy(pBuffer, &pSource->header[position], fromHeader);
+    }
+
+    done = fromHeader;
+
+    if (position + done < HEADER_SIZE + prefixSize)
+    {
+        part = HEADER_SIZE + prefixSize - position - done;
+        part = part < count - done ? part : count - done;
+
+        memcpy(&pBuffer[done], &pSource->pCipher->prefix[position + done - HEADER_SIZE], part);
+        done += part;
+    }
+
+    part = position + done < pSource->checksumPosition ? 
+           pSource->checksumPosition - position - done : 0;
+    part = part < count - done ? part : count - done;
+
+    if (fread(&pBuffer[done], sizeof(uint8_t), part, pSource->fpData) != part)
+    {
+        errRtn = errorFread;
+    }
+
+    else
+    {
+        if (pSource->pCipher != NULL)
+        {
+            cipherApply(pSource->pCipher, position + done - HEADER_SIZE - prefixSize, 
+                        &pBuffer[done], part);
+        }
+
+        done += part;
+        pSource->crc = crc32c(pSource->crc, &pBuffer[fromHeader], done - fromHeader);
+
+    }
+
+    /* Anything left is the checksum, all the bytes before it gone by */
+    if (errRtn == success && done < count)
+    {
+        packChecksum(checksum, pSource->crc);
+        memcpy(&pBuffer[done], &checksum[position + done - pSource->checksumPosition], 
+               count - done);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Finds the extension of a file name, without its decimal point.
+ *  @param fileName The file name.
+ *  @return The extension, or an empty string if there is none. */
+const char * fileExtension(IN const char * fileName)
+{
+    const char * extension = strrchr(fileName, '.');
+
+    return extension != NULL ? &extension[1] : "";
+}
+
+
+/** @brief Makes sure a set of working buffers is at least the given sizes,
+ *         growing them as needed. Existing contents are not kept.
+ *  @param pBuffers The buffers.
+ *  @param blockSize Bytes needed in the block buffer.
+ *  @param bytesSize Bytes needed in the data buffer.
+ *  @return An error value from enum eErrors. */
+tError reserveBuffers(IN_OUT tBuffers * pBuffers, uint64_t blockSize, uint64_t bytesSize)
+{
+    tError errRtn = success;
+
+    if (blockSize > pBuffers->blockSize)
+    {
+        free(pBuffers->pBlock);
+        pBuffers->blockSize = 0;
+
+        if ((pBuffers->pBlock = malloc(blockSize)) == NULL)
+        {
+            errRtn = errorMalloc;
+        }
+
+        else
+        {
+            pBuffers->blockSize = blockSize;
+        }
+    }
+
+    if (bytesSize > pBuffers->bytesSize)
+    {
+        free(pBuffers->pBytes);
+        pBuffers->bytesSize = 0;
+
+        if ((pBuffers->pBytes = malloc(bytesSize)) == NULL)
+        {
+            errRtn = errorMalloc;
+        }
+
+        else
+        {
+            pBuffers->bytesSize = bytesSize;
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Frees a set of working buffers.
+ *  @param pBuffers The buffers.
+ *  @return An error value from enum eErrors. */
+tError releaseBuffers(IN_OUT tBuffers * pBuffers)
+{
+    free(pBuffers->pBlock);
+    free(pBuffers->pBytes);
+
+    memset(pBuffers, 0, sizeof(tBuffers));
+
+    return success;
+}
+
+/** @brief Builds the hidden header which precedes the data: the size of the
+ *         data, least significant byte first, with flags in its top byte, 
+ *         followed by up to EXTENSION_SIZE characters of its extension. Unused
+ *         extension bytes are zero.
+ *  @param header The header to fill.
+ *  @param dataSize Size of the hidden data in bytes.
+ *  @param flags Value for the HEADER_FLAGS byte.
+ *  @param extension Extension of the hidden data without the decimal point.
+ *  @return An error value from enum eErrors. */
+tError packHeader(OUT uint8_t header[HEADER_SIZE], uint64_t dataSize, uint8_t flags, 
+                  IN const char * extension)
+{
+    uint32_t index = 0;
+
+    memset(header, 0, HEADER_SIZE);
+
+    for (index = 0; index < HEADER_FLAGS; index++)
+    {
+        header[index] = (uint8_t)(dataSize >> (index * 8));
+    }
+
+    header[HEADER_FLAGS] = flags;
+    memcpy(&header[DATA_SIZE], extension, strnlen(extension, EXTENSION_SIZE));
+
+    return success;
+}
+
+
+/** @brief Splits a hidden header built by packHeader into its fields.
+ *  @param header The header to read.
+ *  @param pDataSize Returns the size of the hidden data in bytes.
+ *  @param pFlags Returns the HEADER_FLAGS byte.
+ *  @param pExtension Returns the extension of the hidden data. Must hold 
+ *         EXTENSION_SIZE characters, it is not terminated here.
+ *  @return An error value from enum eErrors. */
+tError unpackHeader(IN const uint8_t header[HEADER_SIZE], OUT uint64_t * pDataSize, 
+                    OUT uint8_t * pFlags, OUT char * pExtension)
+{
+    uint32_t index = 0;
+
+    *pDataSize = 0;
+
+    for (index = 0; index < HEADER_FLAGS; index++)
+    {
+        *pDataSize |= (uint64_t)header[index] << (index * 8);
+    }
+
+    *pFlags = header[HEADER_FLAGS];
+    memcpy(pExtension, &header[DATA_SIZE], EXTENSION_SIZE);
+
+    return success;
+}
+
+
+/** @brief Builds the checksum hidden after the data, least significant byte
+ *         first.
+ *  @param checksum The checksum to fill.
+ *  @param crc CRC32C of what is hidden between the header and the checksum.*/
+void packChecksum(OUT uint8_t checksum[CHECKSUM_SIZE], uint32_t crc)
+{
+    uint32_t index = 0;
+
+    for (index = 0; index < CHECKSUM_SIZE; index++)
+    {
+        checksum[index] = (uint8_t)(crc >> (index * 8));
+    }
+}
+
+
+/** @brief Reads the CRC32C from a checksum built by packChecksum.
+ *  @param checksum The checksum.
+ *  @return The CRC32C. */
+uint32_t unpackChecksum(IN const uint8_t checksum[CHECKSUM_SIZE])
+{
+    uint32_t index = 0;
+    uint32_t crc = 0;
+
+    for (index = 0; index < CHECKSUM_SIZE; index++)
+    {
+        crc |= (uint32_t)checksum[index] << (index * 8);
+    }
+
+    return crc;
+}
+
+
+/** @brief Retrieves the file and info headers from the bitmap file, with any
+ *         colour masks after them, and works out how the pixels are laid out 
+ *         in the image data: the size of each row, how much padding there is 
+ *         at the end of the row and the size of the image data in bytes. The
+ *         file is left at the end of the headers. A pipe is read from where 
+ *         it is, which must be its start.
+ * @param fpBitmap File pointer to bitmap file.
+ * @param pFileHeader File Header Structure to be populated.
+ * @param pInfoHeader Info Header Structure to be populated.
+ * @param pLayout Pixel layout to be populated.
+ * @return An error value from enum eErrors. */
+tError parseBitmap(IN FILE * fpBitmap, 
+                   OUT tBitmapFileHeader * pFileHeader, 
+                   OUT tBitmapInfoHeader * pInfoHeader, 
+                   OUT tPixelLayout * pLayout)
+{
+    tError errRtn = errorDefault;
+    uint64_t headerSize = 0;
+    
+    if (pFileHeader == NULL || pInfoHeader == NULL || fpBitmap == NULL || 
+        pLayout == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    /* A pipe can't seek, but is read from its start */
+    else if (fseek(fpBitmap, 0, SEEK_SET) != success && errno != ESPIPE)
+    {
+        errRtn = errorFseek;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fread(pFileHeader, sizeof(tBitmapFileHeader), 1, fpBitmap) != 1)
+    {
+        errRtn = errorFread;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pFileHeader->type != BITMAP_FILE_TYPE)
+    {
+        errRtn = errorFileType;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fread(pInfoHeader, INFO_HEADER_SIZE, 1, fpBitmap) != 1)
+    {
+        errRtn = errorFread;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((headerSize = bitmapHeaderSize(pInfoHeader)) == 0)
+    {
+        errRtn = errorFileType;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (headerSize > PIXEL_DATA_OFFSET &&
+             fread(&pInfoHeader->redMask, headerSize - PIXEL_DATA_OFFSET, 1, fpBitmap) != 1)
+    {
+        errRtn = errorFread;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        /* Whatever a smaller info header doesn't hold reads as zero */
+        memset((uint8_t *)pInfoHeader + headerSize - sizeof(tBitmapFileHeader), 0,
+               sizeof(tBitmapFileHeader) + sizeof(tBitmapInfoHeader) - headerSize);
+
+        errRtn = pixelLayout(pFileHeader, pInfoHeader, pLayout);
+    }   
+
+    return errRtn;
+}
+
+
+/** @brief Retrieves the file and info headers from a bitmap held in memory and
+ *         works out how its pixels are laid out, as parseBitmap does for a 
+ *         file. Only bitmaps accepted by supportedBitmap whose pixels all lie
+ *         within bitmapSize are accepted.
+ * @param pBitmap The whole bitmap file.
+ * @param bitmapSize Size of pBitmap in bytes.
+ * @param pFileHeader File Header Structure to be populated.
+ * @param pInfoHeader Info Header Structure to be populated.
+ * @param pLayout Pixel layout to be populated.
+ * @return An error value from enum eErrors. */
+tError parseBitmapMemory(IN const uint8_t * pBitmap, 
+                         uint64_t bitmapSize,
+                         OUT tBitmapFileHeader * pFileHeader, 
+                         OUT tBitmapInfoHeader * pInfoHeader, 
+                         OUT tPixelLayout * pLayout)
+{
+    tError errRtn = errorDefault;
+
+    if (pBitmap == NULL || pFileHeader == NULL || pInfoHeader == NULL || 
+        pLayout == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (bitmapSize < PIXEL_DATA_OFFSET)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pBitmap[0] != 'B' || pBitmap[1] != 'M')
+    {
+        errRtn = errorFileType;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (unpackBitmapHeaders(pBitmap, bitmapSize, pFileHeader, pInfoHeader) == 0 ||
+             !supportedBitmap(pInfoHeader) || 
+             pixelLayout(pFileHeader, pInfoHeader, pLayout) != success)
+    {
+        errRtn = errorFileType;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (bitmapSize < pLayout->dataOffset + pLayout->sizeOfData)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Copies the file and info headers, and any colour masks after them,
+ *         out of the start of a bitmap held in memory. Whatever a smaller info
+ *         header doesn't hold is zeroed.
+ *  @param pBytes Start of the bitmap.
+ *  @param size Number of bytes at pBytes.
+ *  @param pFileHeader File Header Structure to be populated.
+ *  @param pInfoHeader Info Header Structure to be populated.
+ *  @return Size of the headers in bytes, or 0 if the info header is not of a
+ *          size known or the headers run past size. */
+uint64_t unpackBitmapHeaders(IN const uint8_t * pBytes, 
+                             uint64_t size,
+                             OUT tBitmapFileHeader * pFileHeader, 
+                             OUT tBitmapInfoHeader * pInfoHeader)
+{
+    uint64_t headerSize = 0;
+
+    memset(pInfoHeader, 0, sizeof(tBitmapInfoHeader));
+
+    if (size >= PIXEL_DATA_OFFSET)
+    {
+        memcpy(pFileHeader, pBytes, sizeof(tBitmapFileHeader));
+        memcpy(pInfoHeader, &pBytes[sizeof(tBitmapFileHeader)], INFO_HEADER_SIZE);
+        headerSize = bitmapHeaderSize(pInfoHeader);
+    }
+
+    if (headerSize > size)
+    {
+        headerSize = 0;
+    }
+
+    else if (headerSize > PIXEL_DATA_OFFSET)
+    {
+        memcpy(&pInfoHeader->redMask, &pBytes[PIXEL_DATA_OFFSET], 
+               headerSize - PIXEL_DATA_OFFSET);
+    }
+
+    return headerSize;
+}
+
+
+/** @brief Works out how many bytes of a bitmap file its headers take from the
+ *         size given in its info header: the file header, the info header and
+ *         the colour masks following a BITMAPINFOHEADER with 
+ *         COMPRESSION_BITFIELDS. Only the first INFO_HEADER_SIZE bytes of the
+ *         info header need to have been read.
+ *  @param pInfoHeader The bitmap's info header.
+ *  @return Size of the headers in bytes, or 0 if the info header is not one 
+ *          of the sizes known. */
+uint64_t bitmapHeaderSize(IN const tBitmapInfoHeader * pInfoHeader)
+{
+    uint64_t headerSize = 0;
+
+    if (pInfoHeader->size == INFO_HEADER_SIZE && 
+        pInfoHeader->compressionType == COMPRESSION_BITFIELDS)
+    {
+        headerSize = PIXEL_DATA_OFFSET + BITFIELDS_MASKS_SIZE;
+    }
+
+    else if (pInfoHeader->size == INFO_HEADER_SIZE || 
+             pInfoHeader->size == INFO_HEADER_V2_SIZE ||
+             pInfoHeader->size == INFO_HEADER_V3_SIZE ||
+             pInfoHeader->size == INFO_HEADER_V4_SIZE ||
+             pInfoHeader->size == INFO_HEADER_V5_SIZE)
+    {
+        headerSize = sizeof(tBitmapFileHeader) + pInfoHeader->size;
+    }
+
+    return headerSize;
+}
+
+
+/** @brief Checks a bitmap has pixels this program can hide data in: 24 bit,
+ *         or 32 bit either without bit fields or with masks giving plain 
+ *         blue, green, red and alpha bytes.
+ *  @param pInfoHeader The bitmap's info header, with its masks.
+ *  @return Non zero if the bitmap is supported. */
+int supportedBitmap(IN const tBitmapInfoHeader * pInfoHeader)
+{
+    int masksStandard = pInfoHeader->redMask == STANDARD_RED_MASK &&
+                        pInfoHeader->greenMask == STANDARD_GREEN_MASK &&
+                        pInfoHeader->blueMask == STANDARD_BLUE_MASK &&
+                        (pInfoHeader->alphaMask == STANDARD_ALPHA_MASK || 
+                         pInfoHeader->alphaMask == 0);
+
+    return (pInfoHeader->bitsPerPixel == 24 && 
+            pInfoHeader->compressionType == COMPRESSION_NONE) || 
+           (pInfoHeader->bitsPerPixel == 32 && 
+            pInfoHeader->compressionType == COMPRESSION_NONE) ||
+           (pInfoHeader->bitsPerPixel == 32 && 
+            pInfoHeader->compressionType == COMPRESSION_BITFIELDS &&
+            masksStandard);
+}
+
+
+/** @brief Works out how the pixels are laid out in the image data: where it 
+ *         starts, the size of each row, how much padding there is at the end 
+ *         of the row and the size of the image data in bytes. Hidden bytes are
+ *         taken to be split across the colours of each pixel until 
+ *         chooseLayout is called.
+ * @param pFileHeader The bitmap's file header.
+ * @param pInfoHeader The bitmap's info header.
+ * @param pLayout Pixel layout to be populated.
+ * @return errorFileType if the image data would start inside the headers, 
+ *         otherwise success. */
+tError pixelLayout(IN const tBitmapFileHeader * pFileHeader,
+                   IN const tBitmapInfoHeader * pInfoHeader, 
+                   OUT tPixelLayout * pLayout)
+{
+    tError errRtn = success;
+
+    pLayout->width    = pInfoHeader->width;
+    pLayout->height   = pInfoHeader->height;
+    pLayout->bytesPerPixel = pInfoHeader->bitsPerPixel == 32 ? BYTES_IN_PIXEL_ALPHA : 
+                                                               BYTES_IN_PIXEL;
+    pLayout->rowBytes = pLayout->width * pLayout->bytesPerPixel;
+
+    /* Rows are padded out to a multiple of 4 bytes */
+    pLayout->widthBytes = (pLayout->rowBytes + 3) & ~(uint64_t)3;
+    pLayout->padding    = pLayout->widthBytes - pLayout->rowBytes;
+    pLayout->sizeOfData = pLayout->widthBytes * pLayout->height;
+    pLayout->dataOffset = pFileHeader->offsetbits;
+    pLayout->headerSize = bitmapHeaderSize(pInfoHeader);
+
+    pLayout->bitsPerChannel = 0;
+    pLayout->alpha = 0;
+    pLayout->compressed = 0;
+    pLayout->encrypted = 0;
+    pLayout->checksummed = 0;
+    pLayout->legacy = 0;
+
+    if (pLayout->headerSize == 0 || pLayout->dataOffset < pLayout->headerSize)
+    {
+        errRtn = errorFileType;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Creates memory at pData for the image data and copies across the 
+ *         bytes from fpBitmap.
+ *  @param fpBitmap File pointer to bitmap file.
+ *  @param pData Pointer to data read from bitmap.
+ *  @param dataOffset Offset of the image data from the start of the file.
+ *  @param dataSize Size of data to read from bitmap.
+ *  @return An error value from enum eErrors. */
+tError copyBitmapData(IN FILE * fpBitmap, OUT uint8_t ** pData, uint64_t dataOffset,
+                      uint64_t dataSize)
+{
+    tError errRtn = errorDefault;
+
+    if ((*pData = malloc(dataSize)) == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fseek(fpBitmap, dataOffset, SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (fread(*pData, sizeof(uint8_t), dataSize, fpBitmap) != dataSize)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+    
+    else if (*pData == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+    
+    else
+    {
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Makes the pixel data of a bitmap available in memory. A regular file
+ *         is mapped read only so the pixels are used straight from the page 
+ *         cache, anything else is copied in with copyBitmapData.
+ *  @param fpBitmap File pointer to bitmap file.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param copyOnWrite Non zero to map a regular file copy on write instead, 
+ *         so the pixels can be changed without changing the file.
+ *  @param pImage Returns the pixel data. Release with releaseImageData.
+ *  @return An error value from enum eErrors. */
+tError loadImageData(IN FILE * fpBitmap, IN const tPixelLayout * pLayout, 
+                     int copyOnWrite, OUT tImageData * pImage)
+{
+    tError errRtn = errorDefault;
+    struct stat fileStatus;
+
+    memset(pImage, 0, sizeof(tImageData));
+
+    if (fstat(fileno(fpBitmap), &fileStatus) != success)
+    {
+        errRtn = errorFileType;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (!S_ISREG(fileStatus.st_mode))
+    {
+        if ((errRtn = copyBitmapData(fpBitmap, &pImage->pBuffer, pLayout->dataOffset,
+                                     pLayout->sizeOfData)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        pImage->pData = pImage->pBuffer;
+    }
+
+    else if ((uint64_t)fileStatus.st_size < pLayout->dataOffset + pLayout->sizeOfData)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pImage->pMapping = mmap(NULL, fileStatus.st_size, 
+                                      copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, 
+                                      MAP_PRIVATE, fileno(fpBitmap), 0)) == MAP_FAILED)
+    {
+        pImage->pMapping = NULL;
+        errRtn = errorMmap;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        pImage->mappingSize = fileStatus.st_size;
+        pImage->pData = &pImage->pMapping[pLayout->dataOffset];
+
+        /* Pixels are only ever walked front to back */
+        madvise(pImage->pMapping, pImage->mappingSize, MADV_SEQUENTIAL);
+
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Prepares the image that hidden data will be written into. When the
+ *         cover image is mapped the output bitmap is created at its full size,
+ *         mapped and the cover copied into it, so encoding writes straight into
+ *         the page cache of the output. The cover is copied in windows of 
+ *         COPY_WINDOW_SIZE. Otherwise the copied cover is reused
+ *         and must be written out with createOutputBitmap.
+ *  @param outputFileName Name of the output bitmap.
+ *  @param pCoverImage The cover image, from loadImageData.
+ *  @param pOutputImage Returns the image to write to. Release with 
+ *         releaseImageData, which completes a mapped output.
+ *  @return An error value from enum eErrors. */
+tError createOutputImage(IN const char * outputFileName,
+                         IN const tImageData * pCoverImage,
+                         OUT tImageData * pOutputImage)
+{
+    tError errRtn = errorDefault;
+    int fdOutput = -1;
+    uint64_t offset = 0;
+    uint64_t window = 0;
+
+    memset(pOutputImage, 0, sizeof(tImageData));
+
+    if (pCoverImage->pMapping == NULL)
+    {
+        /* Borrowed, so releasing the output image leaves it alone */
+        pOutputImage->pData = pCoverImage->pData;
+        errRtn = success;
+    }
+
+    else if ((fdOutput = open(outputFileName, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (ftruncate(fdOutput, pCoverImage->mappingSize) != success)
+    {
+        errRtn = errorFtruncate;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((pOutputImage->pMapping = mmap(NULL, pCoverImage->mappingSize, 
+                                            PROT_READ | PROT_WRITE, MAP_SHARED, 
+                                            fdOutput, 0)) == MAP_FAILED)
+    {
+        pOutputImage->pMapping = NULL;
+        errRtn = errorMmap;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        pOutputImage->mappingSize = pCoverImage->mappingSize;
+        pOutputImage->pData = &pOutputImage->pMapping[pCoverImage->pData - 
+                                                      pCoverImage->pMapping];
+
+        /* Each window is dropped from both mappings once 
+         * copied so only one window of either file is resident at a time. */
+        for (offset = 0; offset < pOutputImage->mappingSize; offset += COPY_WINDOW_SIZE)
+        {
+            window = pOutputImage->mappingSize - offset;
+            window = window < COPY_WINDOW_SIZE ? window : COPY_WINDOW_SIZE;
+
+            memcpy(&pOutputImage->pMapping[offset], &pCoverImage->pMapping[offset], window);
+
+            madvise(&pOutputImage->pMapping[offset], window, MADV_DONTNEED);
+            madvise(&pCoverImage->pMapping[offset], window, MADV_DONTNEED);
+        }
+
+        errRtn = success;
+    }
+
+    if (fdOutput >= 0)
+    {
+        if (close(fdOutput) != success)
+        {
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Releases pixel data from loadImageData or createOutputImage. Safe 
+ *         to call on a zeroed or already released image.
+ *  @param pImage The image to release.
+ *  @return An error value from enum eErrors. */
+tError releaseImageData(IN_OUT tImageData * pImage)
+{
+    tError errRtn = success;
+
+    if (pImage->pMapping != NULL)
+    {
+        if (munmap(pImage->pMapping, pImage->mappingSize) != success)
+        {
+            errRtn = errorMmap;
+        }
+    }
+
+    if (pImage->pBuffer != NULL)
+    {
+        free(pImage->pBuffer);
+    }
+
+    memset(pImage, 0, sizeof(tImageData));
+
+    return errRtn;
+}
+
+
+/** @brief Creates the output file for the decoded data. Unless a name is 
+ *         given the output file retains its original extension.
+ *  @param outputFileName Name of the file to create, or NULL to use 
+ *         decodedFileName.
+ *  @param extension The extension of the hidden data / the extension of the 
+ *        output file.
+ *  @param pFileData Pointer to the decoded data to be written to the file,
+ *         followed by its checksum when it has one.
+ *  @param dataSizeBytes The size of the decoded data, not counting the 
+ *         checksum.
+ *  @param pLayout Layout the data was hidden with, which says whether it is
+ *         to be decrypted and expanded as it is written.
+ *  @param passphrase Passphrase the data was encrypted with, or NULL.
+ *  @return An error value from enum eErrors. */
+tError createOutputFile(IN const char * outputFileName,
+                        IN char * extension, 
+                        IN uint8_t * pFileData,
+                        uint64_t dataSizeBytes,
+                        IN const tPixelLayout * pLayout,
+                        IN const char * passphrase)
+{
+    tError errRtn = errorDefault;
+    tError finishRtn = errorDefault;
+    FILE * fpOutput = NULL;
+    tExpander expander = {0};
+    char outputFileNameAndExt[OUTPUT_NAME_SIZE];
+    
+    decodedFileName(extension, outputFileNameAndExt);
+
+    if (outputFileName == NULL)
+    {
+        outputFileName = outputFileNameAndExt;
+    }
+
+    if (pFileData == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((fpOutput = stdioOpen(outputFileName, "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = expanderCreate(&expander, fpOutput, pLayout, dataSizeBytes, passphrase)) 
+             != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = expanderWrite(&expander, pFileData, 
+                                     dataSizeBytes + checksumSize(pLayout))) != success)
+    {
+        ERROR_PRINT(errRtn); 
+    }
+    
+    else
+    {
+        errRtn = success;
+    }
+
+    if ((finishRtn = expanderFinish(&expander)) != success && errRtn == success)
+    {
+        errRtn = finishRtn;
+        ERROR_PRINT(errRtn);
+    }
+    
+    errRtn = stdioFinish(fpOutput, outputFileName, errRtn);
+
+    return errRtn;
+}
+
+
+/** @brief Builds the name of the file decoded data is written to: "decoded"
+ *         followed by the original extension, if there was one.
+ *  @param extension The extension of the hidden data. May be NULL.
+ *  @param outputFileName Returns the file name.
+ *  @return An error value from enum eErrors. */
+tError decodedFileName(IN const char * extension, OUT char outputFileName[OUTPUT_NAME_SIZE])
+{
+    snprintf(outputFileName, OUTPUT_NAME_SIZE, "decoded");
+
+    if (extension != NULL)
+    {
+        if (strlen(extension))
+        {
+            snprintf(outputFileName, OUTPUT_NAME_SIZE, "decoded.%s", extension);
+        }
+    }
+
+    return success;
+}
+
+
+/** @brief Writes the length of a run of literals or of a match which doesn't
+ *         fit in its half of a token: bytes of 255 and then the remainder.
+ *  @param pOutput Where to write the length.
+ *  @param length The length, less the 15 held in the token.
+ *  @return Number of bytes written. */
+static uint64_t packLength(OUT uint8_t * pOutput, uint64_t length)
+{
+    uint64_t written = 0;
+
+    while (length >= 255)
+    {
+        pOutput[written++] = 255;
+        length -= 255;
+    }
+
+    pOutput[written++] = (uint8_t)length;
+
+    return written;
+}
+
+
+/** @brief Compresses data in the LZ4 block format: a run of sequences, each a
+ *         token giving the lengths of a run of literals and of the match 
+ *         after it, the literals, and the match as a two byte offset back 
+ *         into the data already written. The last sequence has no match. 
+ *         Matches are found greedily with a hash table of the last position
+ *         at which each hash of 4 bytes was seen.
+ *  @param pData The data.
+ *  @param size Size of pData in bytes, at most COMPRESS_CHUNK_SIZE.
+ *  @param pOutput Where to write the compressed data.
+ *  @param capacity Most bytes to write to pOutput.
+ *  @return Number of bytes written, or zero if they would be more than 
+ *          capacity. */
+static uint64_t compressBlock(IN const uint8_t * pData, 
+                              uint64_t size, 
+                              OUT uint8_t * pOutput,
+                              uint64_t capacity)
+{
+    uint16_t table[1 << COMPRESS_HASH_BITS];
+    uint64_t limit = size > COMPRESS_MATCH_LIMIT ? size - COMPRESS_MATCH_LIMIT : 0;
+    uint64_t position = 0;
+    uint64_t anchor = 0;
+    uint64_t candidate = 0;
+    uint64_t literals = 0;
+    uint64_t match = 0;
+    uint64_t written = 0;
+    uint32_t sequence = 0;
+    uint32_t earlier = 0;
+    uint32_t hash = 0;
+    uint8_t * pToken = NULL;
+
+    memset(table, 0, sizeof(table));
+
+    while (position < limit)
+    {
+        memcpy(&sequence, &pData[position], sizeof(sequence));
+        hash = (sequence * 2654435761U) >> (32 - COMPRESS_HASH_BITS);
+        candidate = table[hash];
+        table[hash] = (uint16_t)position;
+        memcpy(&earlier, &pData[candidate], sizeof(earlier));
+
+        if (candidate >= position || position - candidate > COMPRESS_MAX_OFFSET || 
+            earlier != sequence)
+        {
+            position++;
+            continue;
+        }
+
+        match = COMPRESS_MIN_MATCH;
+
+        while (position + match < size - COMPRESS_LAST_LITERALS && 
+               pData[candidate + match] == pData[position + match])
+        {
+            match++;
+        }
+
+        /* Token, literals and both lengths at their longest */
+        literals = position - anchor;
+
+        if (written + 1 + literals + literals / 255 + 1 + 2 + match / 255 + 1 > capacity)
+        {
+            return 0;
+        }
+
+        pToken = &pOutput[written++];
+        *pToken = (uint8_t)(((literals < 15 ? literals : 15) << 4) | 
+                            (match - COMPRESS_MIN_MATCH < 15 ? match - COMPRESS_MIN_MATCH : 15));
+
+        if (literals >= 15)
+        {
+            written += packLength(&pOutput[written], literals - 15);
+        }
+
+        memcpy(&pOutput[written], &pData[anchor], literals);
+        written += literals;
+
+        pOutput[written++] = (uint8_t)(position - candidate);
+        pOutput[written++] = (uint8_t)((position - candidate) >> 8);
+
+        if (match - COMPRESS_MIN_MATCH >= 15)
+        {
+            written += packLength(&pOutput[written], match - COMPRESS_MIN_MATCH - 15);
+        }
+
+        position += match;
+        anchor = position;
+    }
+
+    literals = size - anchor;
+
+    if (written + 1 + literals + literals / 255 + 1 > capacity)
+    {
+        return 0;
+    }
+
+    pOutput[written++] = (uint8_t)((literals < 15 ? literals : 15) << 4);
+
+    if (literals >= 15)
+    {
+        written += packLength(&pOutput[written], literals - 15);
+    }
+
+    memcpy(&pOutput[written], &pData[anchor], literals);
+
+    return written + literals;
+}
+
+
+/** @brief Reads the length of a run of literals or of a match which didn't 
+ *         fit in its half of a token.
+ *  @param pInput The compressed data.
+ *  @param size Size of pInput in bytes.
+ *  @param pPosition Position in pInput of the length, returned moved past it.
+ *  @param pLength The length held in the token, returned with the rest added.
+ *  @return An error value from enum eErrors. */
+static tError unpackLength(IN const uint8_t * pInput, 
+                           uint64_t size,
+                           IN_OUT uint64_t * pPosition,
+                           IN_OUT uint64_t * pLength)
+{
+    uint8_t byte = 255;
+
+    while (byte == 255)
+    {
+        if (*pPosition >= size)
+        {
+            return errorCorrupt;
+        }
+
+        byte = pInput[(*pPosition)++];
+        *pLength += byte;
+    }
+
+    return success;
+}
+
+
+/** @brief Undoes compressBlock. Every length and offset is checked against 
+ *         the buffers, so data which wasn't written by compressBlock can't 
+ *         read or write outside them.
+ *  @param pInput The compressed data.
+ *  @param size Size of pInput in bytes.
+ *  @param pData Where to write the data.
+ *  @param dataSize Size the data must come to.
+ *  @return An error value from enum eErrors. */
+static tError expandBlock(IN const uint8_t * pInput, 
+                          uint64_t size,
+                          OUT uint8_t * pData,
+                          uint64_t dataSize)
+{
+    tError errRtn = success;
+    uint64_t position = 0;
+    uint64_t written = 0;
+    uint64_t literals = 0;
+    uint64_t match = 0;
+    uint64_t offset = 0;
+    uint8_t token = 0;
+
+    while (errRtn == success && position < size)
+    {
+        token = pInput[position++];
+        literals = token >> 4;
+        match = (token & 0x0F) + COMPRESS_MIN_MATCH;
+
+        if (literals == 15 && 
+            (errRtn = unpackLength(pInput, size, &position, &literals)) != success)
+        {
+            break;
+        }
+
+        else if (literals > size - position || literals > dataSize - written)
+        {
+            errRtn = errorCorrupt;
+            break;
+        }
+
+        memcpy(&pData[written], &pInput[position], literals);
+        position += literals;
+        written += literals;
+
+        /* The last sequence ends with its literals */
+        if (position == size)
+        {
+            break;
+        }
+
+        else if (size - position < 2)
+        {
+            errRtn = errorCorrupt;
+            break;
+        }
+
+        offset = pInput[position] | ((uint64_t)pInput[position + 1] << 8);
+        position += 2;
+
+        if ((token & 0x0F) == 15 && 
+            (errRtn = unpackLength(pInput, size, &position, &match)) != success)
+        {
+            break;
+        }
+
+        else if (offset == 0 || offset > written || match > dataSize - written)
+        {
+            errRtn = errorCorrupt;
+            break;
+        }
+
+        /* A match may overlap the bytes it is writing, so copy byte by byte */
+        for (; match > 0; match--, written++)
+        {
+            pData[written] = pData[written - offset];
+        }
+    }
+
+    if (errRtn == success && written != dataSize)
+    {
+        errRtn = errorCorrupt;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Compresses a chunk of data. The chunk starts with 
+ *         COMPRESS_CHUNK_HEADER bytes holding, less one, the size of the data
+ *         and the size stored after them. When compressing wouldn't save 
+ *         anything the data is stored as it is, with both sizes the same.
+ *  @param pData The data.
+ *  @param size Size of pData in bytes, 1 to COMPRESS_CHUNK_SIZE.
+ *  @param pChunk Where to write the chunk, COMPRESS_CHUNK_HEADER + size 
+ *         bytes at most.
+ *  @return Size of the chunk in bytes. */
+uint64_t compressChunk(IN const uint8_t * pData, uint64_t size, OUT uint8_t * pChunk)
+{
+    uint64_t stored = compressBlock(pData, size, &pChunk[COMPRESS_CHUNK_HEADER], size - 1);
+
+    if (stored == 0)
+    {
+        memcpy(&pChunk[COMPRESS_CHUNK_HEADER], pData, size);
+        stored = size;
+    }
+
+    pChunk[0] = (uint8_t)(size - 1);
+    pChunk[1] = (uint8_t)((size - 1) >> 8);
+    pChunk[2] = (uint8_t)(stored - 1);
+    pChunk[3] = (uint8_t)((stored - 1) >> 8);
+
+    return COMPRESS_CHUNK_HEADER + stored;
+}
+
+
+/** @brief Reads the sizes from the front of a chunk written by compressChunk.
+ *  @param pChunk The chunk, at least its first COMPRESS_CHUNK_HEADER bytes.
+ *  @param pSize Returns the size of the data in bytes.
+ *  @param pStored Returns the number of bytes after the sizes.
+ *  @return An error value from enum eErrors. errorCorrupt if the sizes 
+ *          can't have come from compressChunk. */
+tError chunkSizes(IN const uint8_t * pChunk, OUT uint64_t * pSize, OUT uint64_t * pStored)
+{
+    *pSize   = (pChunk[0] | ((uint64_t)pChunk[1] << 8)) + 1;
+    *pStored = (pChunk[2] | ((uint64_t)pChunk[3] << 8)) + 1;
+
+    return *pSize > COMPRESS_CHUNK_SIZE || *pStored > *pSize ? errorCorrupt : success;
+}
+
+
+/** @brief Recovers the data from a chunk written by compressChunk.
+ *  @param pChunk The whole chunk.
+ *  @param pData Where to write the data, COMPRESS_CHUNK_SIZE bytes at most.
+ *  @return An error value from enum eErrors. */
+tError expandChunk(IN const uint8_t * pChunk, OUT uint8_t * pData)
+{
+    tError errRtn = errorDefault;
+    uint64_t size = 0;
+    uint64_t stored = 0;
+
+    if ((errRtn = chunkSizes(pChunk, &size, &stored)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (stored == size)
+    {
+        memcpy(pData, &pChunk[COMPRESS_CHUNK_HEADER], size);
+    }
+
+    else if ((errRtn = expandBlock(&pChunk[COMPRESS_CHUNK_HEADER], stored, pData, size)) 
+             != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Recovers the data from a run of chunks held in memory. The chunks 
+ *         are walked once to size the data, then expanded straight into it.
+ *  @param pChunks The chunks.
+ *  @param chunksSize Size of pChunks in bytes.
+ *  @param ppData Returns the data. Free with free().
+ *  @param pDataSize Returns the size of *ppData in bytes.
+ *  @return An error value from enum eErrors. */
+tError expandMemory(IN const uint8_t * pChunks, uint64_t chunksSize, 
+                    OUT uint8_t ** ppData, OUT uint64_t * pDataSize)
+{
+    tError errRtn = success;
+    uint8_t * pData = NULL;
+    uint64_t dataSize = 0;
+    uint64_t position = 0;
+    uint64_t size = 0;
+    uint64_t stored = 0;
+
+    while (errRtn == success && position < chunksSize)
+    {
+        if (chunksSize - position < COMPRESS_CHUNK_HEADER || 
+            chunkSizes(&pChunks[position], &size, &stored) != success ||
+            chunksSize - position - COMPRESS_CHUNK_HEADER < stored)
+        {
+            errRtn = errorCorrupt;
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            position += COMPRESS_CHUNK_HEADER + stored;
+            dataSize += size;
+        }
+    }
+
+    /* Never ask for nothing, so an empty result is still a valid pointer */
+    if (errRtn == success && (pData = malloc(dataSize > 0 ? dataSize : 1)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    for (position = 0, dataSize = 0; errRtn == success && position < chunksSize; 
+         position += COMPRESS_CHUNK_HEADER + stored, dataSize += size)
+    {
+        chunkSizes(&pChunks[position], &size, &stored);
+
+        if ((errRtn = expandChunk(&pChunks[position], &pData[dataSize])) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    if (errRtn == success)
+    {
+        *ppData = pData;
+        *pDataSize = dataSize;
+    }
+
+    else
+    {
+        free(pData);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Sets up a tExpander.
+ *  @param pExpander The expander.
+ *  @param fpOutput File to write the data to, or NULL to only check it 
+ *         against its checksum. Nothing is decrypted or expanded then.
+ *  @param pLayout Layout the data was hidden with, which says whether it is
+ *         encrypted, compressed and checksummed.
+ *  @param dataSize Size of the data as stored, not counting the checksum.
+ *  @param passphrase Passphrase the data was encrypted with, or NULL.
+ *  @return An error value from enum eErrors. errorPassphrase if the data is
+ *          encrypted and there is no passphrase. */
+tError expanderCreate(OUT tExpander * pExpander, 
+                      IN FILE * fpOutput, 
+                      IN const tPixelLayout * pLayout,
+                      uint64_t dataSize,
+                      IN const char * passphrase)
+{
+    tError errRtn = success;
+
+    memset(pExpander, 0, sizeof(tExpander));
+    pExpander->fpOutput = fpOutput;
+    pExpander->dataLeft = dataSize;
+    pExpander->checksummed = pLayout->checksummed;
+    pExpander->compressed = fpOutput != NULL ? pLayout->compressed : 0;
+    pExpander->passphrase = fpOutput != NULL && pLayout->encrypted ? passphrase : NULL;
+
+    if (fpOutput != NULL && pLayout->encrypted && passphrase == NULL)
+    {
+        errRtn = errorPassphrase;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pLayout->compressed && (pExpander->pChunk = malloc(COMPRESS_BUFFER_SIZE)) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pLayout->compressed)
+    {
+        pExpander->pExpanded = &pExpander->pChunk[COMPRESS_CHUNK_HEADER + COMPRESS_CHUNK_SIZE];
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Passes recovered data through an expander. The data is added to 
+ *         the checksum as it was stored and anything after it is gathered as
+ *         the checksum. Encrypted data is then decrypted in place once the 
+ *         prefix in front of it has keyed the cipher. Data which isn't 
+ *         compressed is written straight out; compressed data is written a
+ *         chunk at a time as each chunk completes.
+ *  @param pExpander The expander.
+ *  @param pBytes The next bytes of the recovered data, decrypted in place.
+ *  @param count Number of bytes.
+ *  @return An error value from enum eErrors. errorPassphrase if the data was
+ *          encrypted with another passphrase. */
+tError expanderWrite(IN_OUT tExpander * pExpander, IN_OUT uint8_t * pBytes, uint64_t count)
+{
+    tError errRtn = success;
+    uint64_t wanted = 0;
+    uint64_t size = 0;
+    uint64_t stored = 0;
+
+    if (count > pExpander->dataLeft)
+    {
+        wanted = count - pExpander->dataLeft;
+        count = pExpander->dataLeft;
+
+        if (!pExpander->checksummed || 
+            pExpander->checksumGathered + wanted > CHECKSUM_SIZE)
+        {
+            errRtn = errorCorrupt;
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            memcpy(&pExpander->checksum[pExpander->checksumGathered], &pBytes[count], wanted);
+            pExpander->checksumGathered += wanted;
+        }
+    }
+
+    pExpander->dataLeft -= count;
+
+    if (errRtn == success && pExpander->checksummed)
+    {
+        pExpander->crc = crc32c(pExpander->crc, pBytes, count);
+    }
+
+    if (errRtn == success && pExpander->passphrase != NULL && pExpander->prefixGathered < CIPHER_PREFIX_SIZE)
+    {
+        wanted = CIPHER_PREFIX_SIZE - pExpander->prefixGathered;
+        wanted = wanted < count ? wanted : count;
+
+        memcpy(&pExpander->prefix[pExpander->prefixGathered], pBytes, wanted);
+        pExpander->prefixGathered += wanted;
+        pBytes += wanted;
+        count -= wanted;
+
+        if (pExpander->prefixGathered == CIPHER_PREFIX_SIZE &&
+            (errRtn = cipherOpen(&pExpander->cipher, pExpander->passphrase, 
+                                 pExpander->prefix)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    if (errRtn == success && pExpander->passphrase != NULL && count > 0)
+    {
+        cipherApply(&pExpander->cipher, pExpander->decrypted, pBytes, count);
+        pExpander->decrypted += count;
+    }
+
+    if (errRtn == success && !pExpander->compressed && pExpander->fpOutput != NULL &&
+        fwrite(pBytes, sizeof(uint8_t), count, pExpander->fpOutput) != count)
+    {
+        errRtn = errorFwrite;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    while (errRtn == success && pExpander->compressed && count > 0)
+    {
+        /* The sizes first, then the rest of the chunk they describe */
+        wanted = COMPRESS_CHUNK_HEADER;
+
+        if (pExpander->gathered >= COMPRESS_CHUNK_HEADER &&
+            (errRtn = chunkSizes(pExpander->pChunk, &size, &stored)) != success)
+        {
+            ERROR_PRINT(errRtn);
+            break;
+        }
+
+        else if (pExpander->gathered >= COMPRESS_CHUNK_HEADER)
+        {
+            wanted += stored;
+        }
+
+        wanted -= pExpander->gathered;
+        wanted = wanted < count ? wanted : count;
+
+        memcpy(&pExpander->pChunk[pExpander->gathered], pBytes, wanted);
+        pExpander->gathered += wanted;
+        pBytes += wanted;
+        count -= wanted;
+
+        if (pExpander->gathered <= COMPRESS_CHUNK_HEADER ||
+            pExpander->gathered < COMPRESS_CHUNK_HEADER + stored)
+        {
+            continue;
+        }
+
+        else if ((errRtn = expandChunk(pExpander->pChunk, pExpander->pExpanded)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if (fwrite(pExpander->pExpanded, sizeof(uint8_t), size, pExpander->fpOutput) 
+                 != size)
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else
+        {
+            pExpander->gathered = 0;
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Frees an expander once all of the data has passed through it.
+ *  @param pExpander The expander.
+ *  @return An error value from enum eErrors. errorCorrupt if the data 
+ *          ended part way through a chunk, the prefix or the checksum, 
+ *          errorChecksum if it doesn't match its checksum. */
+tError expanderFinish(IN_OUT tExpander * pExpander)
+{
+    tError errRtn = pExpander->gathered != 0 ? errorCorrupt : success;
+
+    if (pExpander->passphrase != NULL && pExpander->prefixGathered < CIPHER_PREFIX_SIZE)
+    {
+        errRtn = errorCorrupt;
+    }
+
+    else if (pExpander->dataLeft != 0 ||
+             (pExpander->checksummed && pExpander->checksumGathered < CHECKSUM_SIZE))
+    {
+        errRtn = errorCorrupt;
+    }
+
+    else if (pExpander->checksummed && 
+             unpackChecksum(pExpander->checksum) != pExpander->crc)
+    {
+        errRtn = errorChecksum;
+    }
+
+    free(pExpander->pChunk);
+    memset(pExpander, 0, sizeof(tExpander));
+
+    return errRtn;
+}
+
+
+/** SHA-256 round constants. */
+static const uint32_t sha256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTATE_RIGHT(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTATE_LEFT(x, n)   (((x) << (n)) | ((x) >> (32 - (n))))
+
+/** @brief Mixes one block of a message into a SHA-256 state.
+ *  @param state The state.
+ *  @param pBlock SHA256_BLOCK_SIZE bytes of the message. */
+static void sha256Block(IN_OUT uint32_t state[8], IN const uint8_t * pBlock)
+{
+    uint32_t schedule[64];
+    uint32_t work[8];
+    uint32_t temp1 = 0;
+    uint32_t temp2 = 0;
+    int index = 0;
+
+    for (index = 0; index < 16; index++)
+    {
+        schedule[index] = ((uint32_t)pBlock[index * 4] << 24) | 
+                          ((uint32_t)pBlock[index * 4 + 1] << 16) |
+                          ((uint32_t)pBlock[index * 4 + 2] << 8) | 
+                           (uint32_t)pBlock[index * 4 + 3];
+    }
+
+    for (index = 16; index < 64; index++)
+    {
+        temp1 = schedule[index - 15];
+        temp2 = schedule[index - 2];
+        schedule[index] = schedule[index - 16] + schedule[index - 7] +
+                          (ROTATE_RIGHT(temp1, 7) ^ ROTATE_RIGHT(temp1, 18) ^ (temp1 >> 3)) +
+                          (ROTATE_RIGHT(temp2, 17) ^ ROTATE_RIGHT(temp2, 19) ^ (temp2 >> 10));
+    }
+
+    memcpy(work, state, sizeof(work));
+
+    for (index = 0; index < 64; index++)
+    {
+        temp1 = work[7] + (ROTATE_RIGHT(work[4], 6) ^ ROTATE_RIGHT(work[4], 11) ^ 
+                           ROTATE_RIGHT(work[4], 25)) +
+                ((work[4] & work[5]) ^ (~work[4] & work[6])) + 
+                sha256Constants[index] + schedule[index];
+        temp2 = (ROTATE_RIGHT(work[0], 2) ^ ROTATE_RIGHT(work[0], 13) ^ 
+                 ROTATE_RIGHT(work[0], 22)) +
+                ((work[0] & work[1]) ^ (work[0] & work[2]) ^ (work[1] & work[2]));
+
+        memmove(&work[1], &work[0], 7 * sizeof(uint32_t));
+        work[4] += temp1;
+        work[0] = temp1 + temp2;
+    }
+
+    for (index = 0; index < 8; index++)
+    {
+        state[index] += work[index];
+    }
+}
+
+
+/** @brief Starts hashing a message with SHA-256.
+ *  @param pHash The hash. */
+static void sha256Start(OUT tSha256 * pHash)
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(pHash->state, initial, sizeof(initial));
+    pHash->length = 0;
+}
+
+
+/** @brief Adds the next bytes of a message to a SHA-256 hash.
+ *  @param pHash The hash.
+ *  @param pBytes The bytes.
+ *  @param count Number of bytes. */
+static void sha256Add(IN_OUT tSha256 * pHash, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t used = pHash->length % SHA256_BLOCK_SIZE;
+    uint64_t take = 0;
+
+    pHash->length += count;
+
+    while (count > 0)
+    {
+        take = SHA256_BLOCK_SIZE - used;
+        take = take < count ? take : count;
+
+        memcpy(&pHash->block[used], pBytes, take);
+        pBytes += take;
+        count -= take;
+        used += take;
+
+        if (used == SHA256_BLOCK_SIZE)
+        {
+            sha256Block(pHash->state, pHash->block);
+            used = 0;
+        }
+    }
+}
+
+
+/** @brief Pads out the message of a SHA-256 hash and gives its digest.
+ *  @param pHash The hash, no use afterwards.
+ *  @param digest Returns the digest. */
+static void sha256Finish(IN_OUT tSha256 * pHash, OUT uint8_t digest[SHA256_SIZE])
+{
+    uint64_t bits = pHash->length * 8;
+    uint64_t used = pHash->length % SHA256_BLOCK_SIZE;
+    int index = 0;
+
+    /* A one bit, zeros, then the length in bits in the last 8 bytes */
+    pHash->block[used++] = 0x80;
+
+    if (used > SHA256_BLOCK_SIZE - 8)
+    {
+        memset(&pHash->block[used], 0, SHA256_BLOCK_SIZE - used);
+        sha256Block(pHash->state, pHash->block);
+        used = 0;
+    }
+
+    memset(&pHash->block[used], 0, SHA256_BLOCK_SIZE - 8 - used);
+
+    for (index = 0; index < 8; index++)
+    {
+        pHash->block[SHA256_BLOCK_SIZE - 1 - index] = (uint8_t)(bits >> (index * 8));
+    }
+
+    sha256Block(pHash->state, pHash->block);
+
+    for (index = 0; index < SHA256_SIZE; index++)
+    {
+        digest[index] = (uint8_t)(pHash->state[index / 4] >> (24 - (index % 4) * 8));
+    }
+}
+
+
+/** @brief Derives a key from a passphrase with PBKDF2-HMAC-SHA256, for one
+ *         block of output. The HMAC key only changes the inner and outer 
+ *         hashes' first blocks, so they are hashed once and copied for each
+ *         of the CIPHER_KDF_ROUNDS iterations.
+ *  @param passphrase The passphrase.
+ *  @param salt The salt.
+ *  @param key Returns the key. */
+static void deriveKey(IN const char * passphrase, 
+                      IN const uint8_t salt[CIPHER_SALT_SIZE],
+                      OUT uint8_t key[SHA256_SIZE])
+{
+    static const uint8_t blockIndex[4] = {0, 0, 0, 1};
+    uint8_t pad[SHA256_BLOCK_SIZE];
+    uint8_t round[SHA256_SIZE];
+    tSha256 inner;
+    tSha256 outer;
+    tSha256 hash;
+    uint64_t length = strlen(passphrase);
+    uint64_t iteration = 0;
+    int index = 0;
+
+    /* HMAC keys longer than a block are hashed first */
+    memset(pad, 0, sizeof(pad));
+
+    if (length > SHA256_BLOCK_SIZE)
+    {
+        sha256Start(&hash);
+        sha256Add(&hash, (const uint8_t *)passphrase, length);
+        sha256Finish(&hash, pad);
+    }
+
+    else
+    {
+        memcpy(pad, passphrase, length);
+    }
+
+    for (index = 0; index < SHA256_BLOCK_SIZE; index++)
+    {
+        pad[index] ^= 0x36;
+    }
+
+    sha256Start(&inner);
+    sha256Add(&inner, pad, SHA256_BLOCK_SIZE);
+
+    for (index = 0; index < SHA256_BLOCK_SIZE; index++)
+    {
+        pad[index] ^= 0x36 ^ 0x5c;
+    }
+
+    sha256Start(&outer);
+    sha256Add(&outer, pad, SHA256_BLOCK_SIZE);
+
+    /* U1 = HMAC(salt || 1), Un = HMAC(Un-1), key = U1 ^ U2 ^ ... */
+    hash = inner;
+    sha256Add(&hash, salt, CIPHER_SALT_SIZE);
+    sha256Add(&hash, blockIndex, sizeof(blockIndex));
+
+    for (iteration = 0; iteration < CIPHER_KDF_ROUNDS; iteration++)
+    {
+        if (iteration > 0)
+        {
+            hash = inner;
+            sha256Add(&hash, round, SHA256_SIZE);
+        }
+
+        sha256Finish(&hash, round);
+        hash = outer;
+        sha256Add(&hash, round, SHA256_SIZE);
+        sha256Finish(&hash, round);
+
+        for (index = 0; index < SHA256_SIZE; index++)
+        {
+            key[index] = iteration > 0 ? key[index] ^ round[index] : round[index];
+        }
+    }
+}
+
+
+/** @brief Keys a cipher from a passphrase and the salt in a prefix, and 
+ *         fills in the key check of the prefix.
+ *  @param pCipher The cipher.
+ *  @param passphrase The passphrase.
+ *  @param prefix The prefix, its salt filled in.
+ *  @return An error value from enum eErrors. */
+static tError cipherKey(OUT tCipher * pCipher, 
+                        IN const char * passphrase,
+                        IN const uint8_t prefix[CIPHER_PREFIX_SIZE])
+{
+    static const uint32_t constants[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    uint8_t key[SHA256_SIZE];
+    uint8_t check[SHA256_SIZE];
+    tSha256 hash;
+    int index = 0;
+
+    deriveKey(passphrase, prefix, key);
+
+    sha256Start(&hash);
+    sha256Add(&hash, key, SHA256_SIZE);
+    sha256Finish(&hash, check);
+
+    memcpy(pCipher->prefix, prefix, CIPHER_SALT_SIZE);
+    memcpy(&pCipher->prefix[CIPHER_SALT_SIZE], check, CIPHER_CHECK_SIZE);
+
+    /* The salt is random for each bitmap, so its start does as the nonce */
+    memcpy(pCipher->state, constants, sizeof(constants));
+
+    for (index = 0; index < 8; index++)
+    {
+        pCipher->state[4 + index] = key[index * 4] | ((uint32_t)key[index * 4 + 1] << 8) |
+                                    ((uint32_t)key[index * 4 + 2] << 16) | 
+                                    ((uint32_t)key[index * 4 + 3] << 24);
+    }
+
+    pCipher->state[12] = 0;
+    pCipher->state[13] = 0;
+
+    for (index = 0; index < 2; index++)
+    {
+        pCipher->state[14 + index] = prefix[index * 4] | ((uint32_t)prefix[index * 4 + 1] << 8) |
+                                     ((uint32_t)prefix[index * 4 + 2] << 16) | 
+                                     ((uint32_t)prefix[index * 4 + 3] << 24);
+    }
+
+    memset(key, 0, sizeof(key));
+
+    return success;
+}
+
+
+/** @brief Keys a cipher to encrypt data with, from a passphrase and a new 
+ *         random salt.
+ *  @param pCipher The cipher.
+ *  @param passphrase The passphrase.
+ *  @return An error value from enum eErrors. */
+tError cipherCreate(OUT tCipher * pCipher, IN const char * passphrase)
+{
+    tError errRtn = errorDefault;
+    uint8_t prefix[CIPHER_PREFIX_SIZE] = {0};
+
+    if (pCipher == NULL || passphrase == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (getrandom(prefix, CIPHER_SALT_SIZE, 0) != CIPHER_SALT_SIZE)
+    {
+        errRtn = errorIo;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        cipherKey(pCipher, passphrase, prefix);
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Keys a cipher to decrypt data with, from a passphrase and the 
+ *         prefix hidden in front of the data.
+ *  @param pCipher The cipher.
+ *  @param passphrase The passphrase. May be NULL, which fails.
+ *  @param prefix The prefix.
+ *  @return An error value from enum eErrors. errorPassphrase if there is no
+ *          passphrase or it isn't the one the data was encrypted with. */
+tError cipherOpen(OUT tCipher * pCipher, 
+                  IN const char * passphrase, 
+                  IN const uint8_t prefix[CIPHER_PREFIX_SIZE])
+{
+    tError errRtn = errorDefault;
+
+    if (passphrase == NULL)
+    {
+        errRtn = errorPassphrase;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = cipherKey(pCipher, passphrase, prefix)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (memcmp(pCipher->prefix, prefix, CIPHER_PREFIX_SIZE) != 0)
+    {
+        errRtn = errorPassphrase;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+#define CHACHA_QUARTER(a, b, c, d)                       \
+    a += b; d ^= a; d = ROTATE_LEFT(d, 16);              \
+    c += d; b ^= c; b = ROTATE_LEFT(b, 12);              \
+    a += b; d ^= a; d = ROTATE_LEFT(d, 8);               \
+    c += d; b ^= c; b = ROTATE_LEFT(b, 7);
+
+/** @brief XORs whole blocks of ChaCha20 keystream into data, one block at a
+ *         time.
+ *  @param state The cipher's input block.
+ *  @param block Number of the first block of keystream.
+ *  @param pBytes The data.
+ *  @param blocks Number of blocks. */
+void chachaXorScalar(IN const uint32_t state[16], uint64_t block, IN_OUT uint8_t * pBytes,
+                     uint64_t blocks)
+{
+    uint32_t x[16];
+    uint32_t word = 0;
+    uint64_t done = 0;
+    int index = 0;
+
+    for (done = 0; done < blocks; done++, block++)
+    {
+        memcpy(x, state, sizeof(x));
+        x[12] = (uint32_t)block;
+        x[13] = (uint32_t)(block >> 32);
+
+        for (index = 0; index < CHACHA_DOUBLE_ROUNDS; index++)
+        {
+            CHACHA_QUARTER(x[0], x[4], x[8],  x[12]);
+            CHACHA_QUARTER(x[1], x[5], x[9],  x[13]);
+            CHACHA_QUARTER(x[2], x[6], x[10], x[14]);
+            CHACHA_QUARTER(x[3], x[7], x[11], x[15]);
+            CHACHA_QUARTER(x[0], x[5], x[10], x[15]);
+            CHACHA_QUARTER(x[1], x[6], x[11], x[12]);
+            CHACHA_QUARTER(x[2], x[7], x[8],  x[13]);
+            CHACHA_QUARTER(x[3], x[4], x[9],  x[14]);
+        }
+
+        for (index = 0; index < 16; index++)
+        {
+            word = x[index] + (index == 12 ? (uint32_t)block : 
+                               index == 13 ? (uint32_t)(block >> 32) : state[index]);
+
+            pBytes[index * 4]     ^= (uint8_t)word;
+            pBytes[index * 4 + 1] ^= (uint8_t)(word >> 8);
+            pBytes[index * 4 + 2] ^= (uint8_t)(word >> 16);
+            pBytes[index * 4 + 3] ^= (uint8_t)(word >> 24);
+        }
+
+        pBytes += CHACHA_BLOCK_SIZE;
+    }
+}
+
+
+/** @brief XORs part of one block of ChaCha20 keystream into data.
+ *  @param state The cipher's input block.
+ *  @param block Number of the block of keystream.
+ *  @param skip Bytes of the block to leave out.
+ *  @param pBytes The data.
+ *  @param count Number of bytes, at most CHACHA_BLOCK_SIZE - skip. */
+static void chachaXorPart(IN const uint32_t state[16], 
+                          uint64_t block, 
+                          uint64_t skip,
+                          IN_OUT uint8_t * pBytes, 
+                          uint64_t count)
+{
+    uint8_t stream[CHACHA_BLOCK_SIZE] = {0};
+    uint64_t index = 0;
+
+    chachaXorScalar(state, block, stream, 1);
+
+    for (index = 0; index < count; index++)
+    {
+        pBytes[index] ^= stream[skip + index];
+    }
+}
+
+
+/** @brief Encrypts or decrypts part of the data of a hidden stream in place.
+ *         The widest kernel the CPU supports handles the whole blocks of 
+ *         keystream and the scalar kernel the rest; blocks only 
+ *         partly covered, at either end, are made in a buffer first.
+ *  @param pCipher The cipher.
+ *  @param offset Offset of the first byte into the encrypted data, not 
+ *         counting the prefix.
+ *  @param pBytes The bytes.
+ *  @param count Number of bytes. */
+void cipherApply(IN const tCipher * pCipher, 
+                 uint64_t offset, 
+                 IN_OUT uint8_t * pBytes, 
+                 uint64_t count)
+{
+    uint64_t block = offset / CHACHA_BLOCK_SIZE;
+    uint64_t skip = offset % CHACHA_BLOCK_SIZE;
+    uint64_t part = 0;
+    uint64_t blocks = 0;
+    uint64_t done = 0;
+    const tChachaKernel * pKernel = NULL;
+
+    if (skip != 0)
+    {
+        part = CHACHA_BLOCK_SIZE - skip;
+        part = part < count ? part : count;
+
+        chachaXorPart(pCipher->state, block++, skip, pBytes, part);
+        pBytes += part;
+        count -= part;
+    }
+
+    blocks = count / CHACHA_BLOCK_SIZE;
+
+    for (pKernel = simdKernels.chacha; *pKernel != NULL; pKernel++)
+    {
+        done += (*pKernel)(pCipher->state, block + done, &pBytes[done * CHACHA_BLOCK_SIZE], 
+                           blocks - done);
+    }
+
+    chachaXorScalar(pCipher->state, block + done, &pBytes[done * CHACHA_BLOCK_SIZE], 
+                    blocks - done);
+
+    if (count % CHACHA_BLOCK_SIZE != 0)
+    {
+        chachaXorPart(pCipher->state, block + blocks, 0, &pBytes[blocks * CHACHA_BLOCK_SIZE], 
+                      count % CHACHA_BLOCK_SIZE);
+    }
+}
+
+
+/** Tables for crc32cScalar: entry n of table k is the CRC of byte n followed
+ *  by k zero bytes. Made on first use. */
+static uint32_t crc32cTables[8][256];
+static pthread_once_t crc32cTablesOnce = PTHREAD_ONCE_INIT;
+
+/** @brief Fills in crc32cTables. */
+static void crc32cMakeTables(void)
+{
+    uint32_t crc = 0;
+    int table = 0;
+    int byte = 0;
+    int bit = 0;
+
+    for (byte = 0; byte < 256; byte++)
+    {
+        crc = byte;
+
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+
+        crc32cTables[0][byte] = crc;
+    }
+
+    for (table = 1; table < 8; table++)
+    {
+        for (byte = 0; byte < 256; byte++)
+        {
+            crc = crc32cTables[table - 1][byte];
+            crc32cTables[table][byte] = (crc >> 8) ^ crc32cTables[0][crc & 0xFF];
+        }
+    }
+}
+
+
+/** @brief Works out the CRC32C of some bytes, 8 bytes at a time with a table
+ *         for each and then a byte at a time.
+ *  @param crc CRC32C of the bytes before these, zero for none.
+ *  @param pBytes The bytes.
+ *  @param count Number of bytes.
+ *  @return CRC32C of the bytes before and these. */
+uint32_t crc32cScalar(uint32_t crc, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t word = 0;
+
+    pthread_once(&crc32cTablesOnce, crc32cMakeTables);
+    crc = ~crc;
+
+    while (count >= sizeof(uint64_t))
+    {
+        /* The words are little endian, as is everything else read here */
+        memcpy(&word, pBytes, sizeof(uint64_t));
+        word ^= crc;
+
+        crc = crc32cTables[7][word & 0xFF]         ^ crc32cTables[6][(word >> 8) & 0xFF]  ^
+              crc32cTables[5][(word >> 16) & 0xFF] ^ crc32cTables[4][(word >> 24) & 0xFF] ^
+              crc32cTables[3][(word >> 32) & 0xFF] ^ crc32cTables[2][(word >> 40) & 0xFF] ^
+              crc32cTables[1][(word >> 48) & 0xFF] ^ crc32cTables[0][word >> 56];
+
+        pBytes += sizeof(uint64_t);
+        count -= sizeof(uint64_t);
+    }
+
+    while (count > 0)
+    {
+        crc = (crc >> 8) ^ crc32cTables[0][(crc ^ *pBytes) & 0xFF];
+
+        pBytes++;
+        count--;
+    }
+
+    return ~crc;
+}
+
+
+/** @brief Works out the CRC32C of some bytes with the fastest kernel the 
+ *         CPU supports. Called on each piece of the data in turn,
+ *         the CRC comes out as if of all of it at once.
+ *  @param crc CRC32C of the bytes before these, zero for none.
+ *  @param pBytes The bytes.
+ *  @param count Number of bytes.
+ *  @return CRC32C of the bytes before and these. */
+uint32_t crc32c(uint32_t crc, IN const uint8_t * pBytes, uint64_t count)
+{
+    return simdKernels.crc32c(crc, pBytes, count);
+}
+
+
+/** @brief Retrieves the hidden data from a bitmap, streaming it through a 
+ *         block of a few rows. The header is parsed from the first block, 
+ *         which always holds at least HEADER_SIZE pixels, and the output file
+ *         is then written a block at a time. Reading stops at the last block 
+ *         holding hidden data. Memory use is bounded as for encodeStream.
+ *         Encrypted data is decrypted and compressed data expanded as it is
+ *         written, and the data is checked against its checksum.
+ *  @param fpBitmap File pointer to the bitmap, already parsed.
+ *  @param pBitmapLayout Layout of the pixels in the bitmap.
+ *  @param outputFileName Name of the file to create, or NULL to use 
+ *         decodedFileName.
+ *  @param passphrase Passphrase the data was encrypted with, or NULL.
+ *  @param verify Non zero to only check the data against its checksum, 
+ *         without writing it out. Data with no checksum fails the check.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. errorChecksum if the data 
+ *          doesn't match its checksum. */
+tError decodeStream(IN FILE * fpBitmap, 
+                    IN const tPixelLayout * pBitmapLayout,
+                    IN const char * outputFileName,
+                    IN const char * passphrase,
+                    int verify,
+                    IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    tError finishRtn = errorDefault;
+    FILE * fpOutput = NULL;
+    tExpander expander = {0};
+    uint8_t * pBlock = NULL;
+    uint8_t * pDecoded = NULL;
+    tPixelLayout layout = *pBitmapLayout;
+    tPixelLayout * pLayout = &layout;
+    uint64_t rowsPerBlock = streamBlockRows(pLayout);
+    uint64_t position = 0;
+    uint64_t end = 0;
+    uint64_t count = 0;
+    uint64_t rows = 0;
+    uint64_t row = 0;
+    uint64_t dataSize = 0;
+    char extension[EXTENSION_SIZE + 1] = {0};
+    char decodedName[OUTPUT_NAME_SIZE];
+
+    if ((errRtn = reserveBuffers(pBuffers, rowsPerBlock * pLayout->widthBytes,
+                                 rowsPerBlock * pLayout->widthBytes)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pBlock = pBuffers->pBlock) == NULL || (pDecoded = pBuffers->pBytes) == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = seekBitmap(fpBitmap, pLayout, pLayout->dataOffset)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fread(pBlock, pLayout->widthBytes, rowsPerBlock, fpBitmap) != rowsPerBlock)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = parseEncodedData(pBlock, pLayout, &position, extension, 
+                                        &dataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* The original encoder's walk isn't row by row, see extractLegacy */
+    else if (pLayout->legacy)
+    {
+        errRtn = errorLayout;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (verify && !pLayout->checksummed)
+    {
+        errRtn = errorChecksum;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = decodedFileName(extension, decodedName)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (!verify &&
+             (fpOutput = stdioOpen(outputFileName != NULL ? outputFileName : decodedName, 
+                                   "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = expanderCreate(&expander, fpOutput, pLayout, dataSize, passphrase)) 
+             != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        end  = position + dataSize + checksumSize(pLayout);
+        rows = rowsPerBlock;
+        errRtn = success;
+    }
+
+    /* The first block has already been read */
+    while (errRtn == success && position < end)
+    {
+        count = hiddenBytesInRows(pLayout, row + rows);
+        count = end < count ? end : count;
+        count -= position;
+
+        if ((errRtn = extractBlock(pLayout, pBlock, row, position, pDecoded, count)) 
+            != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if ((errRtn = expanderWrite(&expander, pDecoded, count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        position += count;
+        row      += rows;
+
+        rows = pLayout->height - row;
+        rows = rows < rowsPerBlock ? rows : rowsPerBlock;
+
+        if (errRtn == success && position < end && 
+            fread(pBlock, pLayout->widthBytes, rows, fpBitmap) != rows)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    if ((finishRtn = expanderFinish(&expander)) != success && errRtn == success)
+    {
+        errRtn = finishRtn;
+        ERROR_PRINT(errRtn);
+    }
+
+    errRtn = stdioFinish(fpOutput, outputFileName != NULL ? outputFileName : decodedName,
+                         errRtn);
+
+    return errRtn;
+}
+
+/** @brief Works out the rows of a block of a pipeline and the bytes of the
+ *         hidden stream they hold, leaving out any before start or past end.
+ *  @param pPipeline The pipeline.
+ *  @param block The block. */
+static void pipelineSpan(IN_OUT tPipeline * pPipeline, uint32_t block)
+{
+    tPipelineSlot * pSlot = &pPipeline->slots[block % PIPELINE_SLOTS];
+    const tPixelLayout * pLayout = pPipeline->pLayout;
+    uint64_t first = 0;
+    uint64_t last = 0;
+
+    pSlot->row  = block * pPipeline->rowsPerBlock;
+    pSlot->rows = pLayout->height - pSlot->row;
+    pSlot->rows = pSlot->rows < pPipeline->rowsPerBlock ? pSlot->rows : pPipeline->rowsPerBlock;
+
+    /* Blocks start on a multiple of 8 rows so no hidden byte is split between
+     * two, see streamBlockRows */
+    first = hiddenBytesInRows(pLayout, pSlot->row);
+    first = first > pPipeline->start ? first : pPipeline->start;
+    first = first < pPipeline->end ? first : pPipeline->end;
+    last  = hiddenBytesInRows(pLayout, pSlot->row + pSlot->rows);
+    last  = last < pPipeline->end ? last : pPipeline->end;
+    last  = last > first ? last : first;
+
+    pSlot->position = first;
+    pSlot->count = last - first;
+}
+
+
+/** @brief Waits until a counter of a pipeline passes a value, checking it 
+ *         PIPELINE_SPINS times before sleeping until a stage moves it.
+ *  @param pPipeline The pipeline.
+ *  @param pCounter The counter, owned by another stage.
+ *  @param value The value to wait for it to pass.
+ *  @return Non zero once the counter has passed value, zero if the pipeline
+ *          is stopping. */
+static int pipelineWait(IN_OUT tPipeline * pPipeline, IN uint32_t * pCounter, uint32_t value)
+{
+    uint32_t spin = 0;
+
+    while (spin++ < PIPELINE_SPINS && 
+           __atomic_load_n(pCounter, __ATOMIC_ACQUIRE) <= value &&
+           !__atomic_load_n(&pPipeline->stopping, __ATOMIC_RELAXED))
+    {
+    }
+
+    if (__atomic_load_n(pCounter, __ATOMIC_ACQUIRE) <= value)
+    {
+        /* Counted before the counter is checked again, so a stage moving it 
+         * either sees the sleeper or is seen to have moved it */
+        pthread_mutex_lock(&pPipeline->lock);
+        __atomic_add_fetch(&pPipeline->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        while (__atomic_load_n(pCounter, __ATOMIC_SEQ_CST) <= value &&
+               !__atomic_load_n(&pPipeline->stopping, __ATOMIC_SEQ_CST))
+        {
+            pthread_cond_wait(&pPipeline->moved, &pPipeline->lock);
+        }
+
+        __atomic_sub_fetch(&pPipeline->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pPipeline->lock);
+    }
+
+    return !__atomic_load_n(&pPipeline->stopping, __ATOMIC_SEQ_CST);
+}
+
+
+/** @brief Moves a counter of a pipeline on, waking any stage asleep.
+ *  @param pPipeline The pipeline.
+ *  @param pCounter The counter, owned by the calling stage.
+ *  @param value Its new value. */
+static void pipelinePublish(IN_OUT tPipeline * pPipeline, OUT uint32_t * pCounter, 
+                            uint32_t value)
+{
+    __atomic_store_n(pCounter, value, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pPipeline->sleepers, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&pPipeline->lock);
+        pthread_cond_broadcast(&pPipeline->moved);
+        pthread_mutex_unlock(&pPipeline->lock);
+    }
+}
+
+
+/** @brief Stops every stage of a pipeline after a failure.
+ *  @param pPipeline The pipeline.
+ *  @param errRtn The error, kept if it is the first. */
+static void pipelineStop(IN_OUT tPipeline * pPipeline, tError errRtn)
+{
+    pthread_mutex_lock(&pPipeline->lock);
+
+    if (pPipeline->errRtn == success)
+    {
+        pPipeline->errRtn = errRtn;
+    }
+
+    __atomic_store_n(&pPipeline->stopping, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&pPipeline->moved);
+    pthread_mutex_unlock(&pPipeline->lock);
+}
+
+
+/** @brief The reader stage of a pipeline. Reads each block of rows into the
+ *         ring once the writer has finished with its slot, along with the 
+ *         bytes to hide in them when hiding.
+ *  @param pArgument The tPipeline.
+ *  @return Always NULL. */
+static void * pipelineReader(void * pArgument)
+{
+    tPipeline * pPipeline = pArgument;
+    tPipelineSlot * pSlot = NULL;
+    uint32_t block = pPipeline->read;
+    tError errRtn = success;
+
+    for (; errRtn == success && block < pPipeline->blocks; block++)
+    {
+        if (block >= PIPELINE_SLOTS &&
+            !pipelineWait(pPipeline, &pPipeline->written, block - PIPELINE_SLOTS))
+        {
+            break;
+        }
+
+        pSlot = &pPipeline->slots[block % PIPELINE_SLOTS];
+        pipelineSpan(pPipeline, block);
+
+        if (fread(pSlot->pRows, pPipeline->pLayout->widthBytes, pSlot->rows, 
+                  pPipeline->fpInput) != pSlot->rows)
+        {
+            errRtn = errorFread;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if (!pPipeline->extract && pSlot->count > 0 &&
+                 (errRtn = readHiddenBytes(&pPipeline->source, pSlot->position, 
+                                           pSlot->pBytes, pSlot->count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            pipelinePublish(pPipeline, &pPipeline->read, block + 1);
+        }
+    }
+
+    if (errRtn != success)
+    {
+        pipelineStop(pPipeline, errRtn);
+    }
+
+    return NULL;
+}
+
+
+/** @brief The writer stage of a pipeline. Writes each block of rows when 
+ *         hiding, or the bytes recovered from it, once it has been computed.
+ *  @param pArgument The tPipeline.
+ *  @return Always NULL. */
+static void * pipelineWriter(void * pArgument)
+{
+    tPipeline * pPipeline = pArgument;
+    tPipelineSlot * pSlot = NULL;
+    uint32_t block = 0;
+    tError errRtn = success;
+
+    for (block = 0; errRtn == success && block < pPipeline->blocks; block++)
+    {
+        if (!pipelineWait(pPipeline, &pPipeline->computed, block))
+        {
+            break;
+        }
+
+        pSlot = &pPipeline->slots[block % PIPELINE_SLOTS];
+
+        if (!pPipeline->extract && 
+            fwrite(pSlot->pRows, pPipeline->pLayout->widthBytes, pSlot->rows, 
+                   pPipeline->fpOutput) != pSlot->rows)
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else if (pPipeline->extract &&
+                 (errRtn = expanderWrite(&pPipeline->expander, pSlot->pBytes, 
+                                         pSlot->count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            pipelinePublish(pPipeline, &pPipeline->written, block + 1);
+        }
+    }
+
+    if (errRtn != success)
+    {
+        pipelineStop(pPipeline, errRtn);
+    }
+
+    return NULL;
+}
+
+
+/** @brief Runs a pipeline: starts the reader and writer threads and hides or
+ *         recovers the data of each block on this thread as it arrives.
+ *         Blocks already read when called are taken as they are.
+ *  @param pPipeline The pipeline, with everything but its counters, errRtn
+ *         and lock set up.
+ *  @return An error value from enum eErrors. */
+static tError pipelineRun(IN_OUT tPipeline * pPipeline)
+{
+    tError errRtn = errorDefault;
+    tPipelineSlot * pSlot = NULL;
+    pthread_t reader;
+    pthread_t writer;
+    int readerStarted = 0;
+    int writerStarted = 0;
+    uint32_t block = 0;
+
+    pPipeline->computed = 0;
+    pPipeline->written = 0;
+    pPipeline->sleepers = 0;
+    pPipeline->stopping = 0;
+    pPipeline->errRtn = success;
+    pthread_mutex_init(&pPipeline->lock, NULL);
+    pthread_cond_init(&pPipeline->moved, NULL);
+
+    if (pthread_create(&reader, NULL, pipelineReader, pPipeline) != success)
+    {
+        errRtn = errorThread;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        readerStarted = 1;
+        errRtn = success;
+    }
+
+    if (errRtn == success && 
+        pthread_create(&writer, NULL, pipelineWriter, pPipeline) != success)
+    {
+        errRtn = errorThread;
+        ERROR_PRINT(errRtn);
+        pipelineStop(pPipeline, errRtn);
+    }
+
+    else if (errRtn == success)
+    {
+        writerStarted = 1;
+    }
+
+    for (block = 0; errRtn == success && block < pPipeline->blocks; block++)
+    {
+        if (!pipelineWait(pPipeline, &pPipeline->read, block))
+        {
+            break;
+        }
+
+        pSlot = &pPipeline->slots[block % PIPELINE_SLOTS];
+
+        if (pSlot->count > 0 && pPipeline->extract)
+        {
+            errRtn = extractBlock(pPipeline->pLayout, pSlot->pRows, pSlot->row, 
+                                  pSlot->position, pSlot->pBytes, pSlot->count);
+        }
+
+        else if (pSlot->count > 0)
+        {
+            errRtn = embedBlock(pPipeline->pLayout, pSlot->pRows, pSlot->row, 
+                                pSlot->position, pSlot->pBytes, pSlot->count);
+        }
+
+        if (errRtn != success)
+        {
+            ERROR_PRINT(errRtn);
+            pipelineStop(pPipeline, errRtn);
+        }
+
+        else
+        {
+            pipelinePublish(pPipeline, &pPipeline->computed, block + 1);
+        }
+    }
+
+    if (readerStarted)
+    {
+        pthread_join(reader, NULL);
+    }
+
+    if (writerStarted)
+    {
+        pthread_join(writer, NULL);
+    }
+
+    pthread_mutex_destroy(&pPipeline->lock);
+    pthread_cond_destroy(&pPipeline->moved);
+
+    return errRtn != success ? errRtn : pPipeline->errRtn;
+}
+
+
+/** @brief Gives each slot of a pipeline its share of a set of working 
+ *         buffers, growing them as needed.
+ *  @param pPipeline The pipeline, with pLayout and rowsPerBlock set.
+ *  @param pBuffers The buffers.
+ *  @return An error value from enum eErrors. */
+static tError pipelineBuffers(IN_OUT tPipeline * pPipeline, IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    uint64_t blockSize = pPipeline->rowsPerBlock * pPipeline->pLayout->widthBytes;
+    uint32_t slot = 0;
+
+    if ((errRtn = reserveBuffers(pBuffers, PIPELINE_SLOTS * blockSize, 
+                                 PIPELINE_SLOTS * blockSize)) == success)
+    {
+        for (slot = 0; slot < PIPELINE_SLOTS; slot++)
+        {
+            pPipeline->slots[slot].pRows  = &pBuffers->pBlock[slot * blockSize];
+            pPipeline->slots[slot].pBytes = &pBuffers->pBytes[slot * blockSize];
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Hides the data from fpDataFile in a copy of the bitmap as 
+ *         encodeStream does, but reads, hides and writes on three threads at
+ *         once, passing blocks of rows through a ring of PIPELINE_SLOTS. 
+ *         The time taken approaches the longest of the three rather than 
+ *         their sum, with memory bounded by the ring.
+ *  @param fpBitmap File pointer to the cover bitmap, already parsed.
+ *  @param fpDataFile File pointer to data to "hide" in image.
+ *  @param dataFileName File name of data file to "hide" - used to get extension.
+ *  @param pFileHeader File header of the cover bitmap.
+ *  @param pInfoHeader Info header of the cover bitmap.
+ *  @param pLayout Layout of the pixels in the cover bitmap.
+ *  @param dataSize Size of what is hidden after the header in bytes: the data,
+ *         and the cipher's prefix when encrypting.
+ *  @param pCipher Cipher to encrypt the data with, or NULL.
+ *  @param outputFileName Name of the bitmap to create.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. */
+tError encodePipeline(IN FILE * fpBitmap,
+                      IN FILE * fpDataFile,
+                      IN const char * dataFileName,
+                      IN const tBitmapFileHeader * pFileHeader,
+                      IN const tBitmapInfoHeader * pInfoHeader,
+                      IN const tPixelLayout * pLayout,
+                      uint64_t dataSize,
+                      IN const tCipher * pCipher,
+                      IN const char * outputFileName,
+                      IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    tPipeline pipeline;
+
+    memset(&pipeline, 0, sizeof(tPipeline));
+    pipeline.pLayout = pLayout;
+    pipeline.rowsPerBlock = streamBlockRows(pLayout);
+    pipeline.blocks = (pLayout->height + pipeline.rowsPerBlock - 1) / pipeline.rowsPerBlock;
+    pipeline.fpInput = fpBitmap;
+    hiddenSourceCreate(&pipeline.source, fpDataFile, dataFileName, pLayout, dataSize, pCipher);
+    pipeline.end = pipeline.source.end;
+
+    if ((errRtn = pipelineBuffers(&pipeline, pBuffers)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = seekBitmap(fpBitmap, pLayout, pLayout->headerSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fseek(fpDataFile, 0, SEEK_SET) != success)
+    {
+        errRtn = errorFseek;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    /* As in encodeStream, the output can't be what is read from */
+    else if (sameFile(fileno(fpBitmap), outputFileName) || 
+             sameFile(fileno(fpDataFile), outputFileName))
+    {
+        errRtn = errorSameFile;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pipeline.fpOutput = stdioOpen(outputFileName, "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = writeBitmapHeaders(pipeline.fpOutput, pFileHeader, pInfoHeader, 
+                                          fpBitmap)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = pipelineRun(&pipeline)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    if (pipeline.fpOutput != NULL)
+    {
+        if (stdioClose(pipeline.fpOutput) != success)
+        {
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Retrieves the hidden data from a bitmap as decodeStream does, but 
+ *         reads, recovers and writes on three threads at once as 
+ *         encodePipeline does. The first block is read here to find the 
+ *         size of the data and so how many blocks to read.
+ *  @param fpBitmap File pointer to the bitmap, already parsed.
+ *  @param pBitmapLayout Layout of the pixels in the bitmap.
+ *  @param outputFileName Name of the file to create, or NULL to use 
+ *         decodedFileName.
+ *  @param passphrase Passphrase the data was encrypted with, or NULL.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. */
+tError decodePipeline(IN FILE * fpBitmap, 
+                      IN const tPixelLayout * pBitmapLayout,
+                      IN const char * outputFileName,
+                      IN const char * passphrase,
+                      IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    tError finishRtn = errorDefault;
+    tPipeline pipeline;
+    tPixelLayout layout = *pBitmapLayout;
+    uint64_t dataSize = 0;
+    uint64_t rows = 0;
+    char extension[EXTENSION_SIZE + 1] = {0};
+    char decodedName[OUTPUT_NAME_SIZE];
+
+    memset(&pipeline, 0, sizeof(tPipeline));
+    pipeline.pLayout = &layout;
+    pipeline.rowsPerBlock = streamBlockRows(&layout);
+    pipeline.extract = 1;
+    pipeline.fpInput = fpBitmap;
+
+    if ((errRtn = pipelineBuffers(&pipeline, pBuffers)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = seekBitmap(fpBitmap, &layout, layout.dataOffset)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (fread(pipeline.slots[0].pRows, layout.widthBytes, pipeline.rowsPerBlock, 
+                   fpBitmap) != pipeline.rowsPerBlock)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = parseEncodedData(pipeline.slots[0].pRows, &layout, &pipeline.start, 
+                                        extension, &dataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* The original encoder's walk isn't row by row, see extractLegacy */
+    else if (layout.legacy)
+    {
+        errRtn = errorLayout;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = decodedFileName(extension, decodedName)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pipeline.fpOutput = stdioOpen(outputFileName != NULL ? outputFileName : 
+                                            decodedName, "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = expanderCreate(&pipeline.expander, pipeline.fpOutput, &layout,
+                                      dataSize, passphrase)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        /* Read up to the block holding the last hidden byte */
+        pipeline.end = pipeline.start + dataSize + checksumSize(&layout);
+
+        do
+        {
+            pipeline.blocks++;
+            rows = pipeline.blocks * pipeline.rowsPerBlock;
+            rows = rows < layout.height ? rows : layout.height;
+        }
+        while (rows < layout.height && hiddenBytesInRows(&layout, rows) < pipeline.end);
+
+        pipelineSpan(&pipeline, 0);
+        pipeline.read = 1;
+
+        if ((errRtn = pipelineRun(&pipeline)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    if ((finishRtn = expanderFinish(&pipeline.expander)) != success && errRtn == success)
+    {
+        errRtn = finishRtn;
+        ERROR_PRINT(errRtn);
+    }
+
+    errRtn = stdioFinish(pipeline.fpOutput, 
+                         outputFileName != NULL ? outputFileName : decodedName, errRtn);
+
+    return errRtn;
+}
+
+/** @brief Reads one block of the rows holding part of the hidden stream,
+ *         starting with the row holding its first byte, and recovers the 
+ *         bytes of the part they hold.
+ *  @param fdBitmap Descriptor of the bitmap.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param pBuffers Working buffers, reserved for a block of streamBlockRows 
+ *         rows. The bytes are returned in pBytes.
+ *  @param position Position in the hidden stream of the first byte wanted.
+ *  @param end Position of the byte after the last wanted.
+ *  @param pCipher Cipher to decrypt the bytes with, or NULL.
+ *  @param pCount Returns the number of bytes recovered.
+ *  @return An error value from enum eErrors. */
+static tError extractRangeBlock(int fdBitmap,
+                                IN const tPixelLayout * pLayout,
+                                IN_OUT tBuffers * pBuffers,
+                                uint64_t position,
+                                uint64_t end,
+                                IN const tCipher * pCipher,
+                                OUT uint64_t * pCount)
+{
+    tError errRtn = errorDefault;
+    uint64_t row = hiddenChannel(pLayout, position) / pLayout->rowBytes;
+    uint64_t rows = pLayout->height - row;
+    uint64_t count = 0;
+
+    /* The first row may also hold the end of the byte before, and the block
+     * stops at the end of the bitmap */
+    rows = rows < streamBlockRows(pLayout) ? rows : streamBlockRows(pLayout);
+
+    count = hiddenBytesInRows(pLayout, row + rows);
+    count = end < count ? end : count;
+    count -= position;
+
+    if (pread(fdBitmap, pBuffers->pBlock, rows * pLayout->widthBytes, 
+              pLayout->dataOffset + row * pLayout->widthBytes) != 
+        (ssize_t)(rows * pLayout->widthBytes))
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = extractBlock(pLayout, pBuffers->pBlock, row, position, 
+                                    pBuffers->pBytes, count)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        if (pCipher != NULL)
+        {
+            cipherApply(pCipher, position - HEADER_SIZE - CIPHER_PREFIX_SIZE, 
+                        pBuffers->pBytes, count);
+        }
+
+        *pCount = count;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Recovers length bytes of the hidden data, starting offset bytes 
+ *         in, without decoding the rest. The header is read as probeFile 
+ *         reads it. As every hidden byte sits at a channel byte fixed by its 
+ *         position, only the rows from the one holding the first byte to the
+ *         one holding the last are then read, a block at a time with pread.
+ *         Encrypted data is decrypted from the offset on, as the keystream 
+ *         can start anywhere. Compressed data can't be read this way.
+ *  @param bitmapFileName Name of the bitmap.
+ *  @param offset Offset into the hidden data of the first byte wanted.
+ *  @param length Number of bytes wanted. Cut short at the end of the data.
+ *  @param outputFileName Name of the file to create, or NULL to use 
+ *         decodedFileName.
+ *  @param passphrase Passphrase to decrypt with, or NULL.
+ *  @param pBuffers Working buffers, kept for the next call.
+ *  @return An error value from enum eErrors. */
+tError extractRange(IN const char * bitmapFileName,
+                    uint64_t offset,
+                    uint64_t length,
+                    IN const char * outputFileName,
+                    IN const char * passphrase,
+                    IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    FILE * fpOutput = NULL;
+    tProbe probe;
+    tPixelLayout layout;
+    tPixelLayout * pLayout = &layout;
+    tCipher cipher;
+    tCipher * pCipher = NULL;
+    uint64_t prefixSize = 0;
+    uint64_t rowsPerBlock = 0;
+    uint64_t position = 0;
+    uint64_t end = 0;
+    uint64_t count = 0;
+    char decodedName[OUTPUT_NAME_SIZE];
+    int fdBitmap = -1;
+
+    if ((errRtn = probeBitmap(bitmapFileName, &probe, pLayout)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    /* Offsets into compressed data don't say where the bytes are hidden, and
+     * finding them in a bitmap from the original encoder means walking every
+     * pixel before them */
+    else if (pLayout->compressed || pLayout->legacy)
+    {
+        errRtn = errorLayout;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((prefixSize = pLayout->encrypted ? CIPHER_PREFIX_SIZE : 0) > probe.dataSize ||
+             offset > probe.dataSize - prefixSize)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((rowsPerBlock = streamBlockRows(pLayout)) == 0 ||
+             (errRtn = reserveBuffers(pBuffers, rowsPerBlock * pLayout->widthBytes,
+                                      rowsPerBlock * pLayout->widthBytes)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((fdBitmap = open(bitmapFileName, O_RDONLY)) < 0)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    /* Encrypted data is keyed from the prefix in front of it, which is 
+     * fetched first the same way as the range */
+    else if (pLayout->encrypted &&
+             (errRtn = extractRangeBlock(fdBitmap, pLayout, pBuffers, HEADER_SIZE, 
+                                         HEADER_SIZE + prefixSize, NULL, &count)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pLayout->encrypted && count != prefixSize)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pLayout->encrypted && 
+             (errRtn = cipherOpen(&cipher, passphrase, pBuffers->pBytes)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = decodedFileName(probe.extension, decodedName)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((fpOutput = stdioOpen(outputFileName != NULL ? outputFileName : decodedName, 
+                                   "wb")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        pCipher  = pLayout->encrypted ? &cipher : NULL;
+        length   = length < probe.dataSize - prefixSize - offset ? length : 
+                                                                  probe.dataSize - prefixSize - offset;
+        position = HEADER_SIZE + prefixSize + offset;
+        end      = position + length;
+        errRtn   = success;
+    }
+
+    while (errRtn == success && position < end)
+    {
+        if ((errRtn = extractRangeBlock(fdBitmap, pLayout, pBuffers, position, end, 
+                                        pCipher, &count)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else if (fwrite(pBuffers->pBytes, sizeof(uint8_t), count, fpOutput) != count)
+        {
+            errRtn = errorFwrite;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        position += count;
+    }
+
+    errRtn = stdioFinish(fpOutput, outputFileName != NULL ? outputFileName : decodedName,
+                         errRtn);
+
+    if (fdBitmap >= 0)
+    {
+        if (close(fdBitmap) != success)
+        {
+            errRtn = errorFclose;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+/** @brief Decodes the hidden data from the bitmap.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param encodedDataSize The size of the hidden data.
+ *  @param startOfEncodedDataPixel The pixel which the hidden data begins at.
+ *  @param decodedData Pointer to the memory where the decoded data is to be 
+ *         stored.
+ *  @param pPool Threads to decode the data with, or NULL to use this thread.
+ *  @return An error value from enum eErrors. */
+tError decodeData(IN const uint8_t * pImageData,
+                  IN const tPixelLayout * pLayout,
+                  uint64_t encodedDataSize, 
+                  uint64_t startOfEncodedDataPixel,
+                  OUT uint8_t * decodedData,
+                  IN tThreadPool * pPool)
+{
+    tError errRtn = errorDefault;
+
+    if (pImageData == NULL || pLayout == NULL || decodedData == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+    
+    else if (pLayout->legacy)
+    {
+        errRtn = extractLegacy(pLayout, pImageData, startOfEncodedDataPixel, decodedData,
+                               encodedDataSize);
+    }
+
+    else if (pPool != NULL &&
+             (errRtn = extractRowsParallel(pPool, pLayout, pImageData, 
+                                           startOfEncodedDataPixel, decodedData, 
+                                           encodedDataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pPool == NULL &&
+             (errRtn = extractRows(pLayout, pImageData, startOfEncodedDataPixel, decodedData,
+                                   encodedDataSize)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Parses the bitmap containing hidden information and retrieves the 
+ *         pixel where the hidden data starts, the extension of the hidden data
+ *         and the size of the hidden data.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param pLayout Layout of the pixels in pImageData. Its bitsPerChannel and
+ *         alpha are set from the header.
+ *  @param pStartOfEncodedDataPixel The pixel at which the hidden data starts.
+ *  @param pExtension Pointer to memory to which will hold the original extension
+ *         of the hidden data.
+ *  @param pEncodedDataSize The size in bytes of the hidden data.
+ *  @return An error value from enum eErrors. */
+tError parseEncodedData(IN const uint8_t * pImageData, 
+                        IN_OUT tPixelLayout * pLayout,
+                        OUT uint64_t * pStartOfEncodedDataPixel, 
+                        OUT char * pExtension, 
+                        OUT uint64_t * pEncodedDataSize)
+{
+    tError errRtn = errorDefault;
+    uint8_t header[HEADER_SIZE];
+    uint8_t flags = 0;
+    uint8_t legacyHeader[HEADER_SIZE];
+    uint8_t legacyFlags = 0;
+    uint64_t legacySize = 0;
+    char legacyExtension[EXTENSION_SIZE + 1];
+
+    if (pImageData == NULL || pLayout == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (pLayout->width * pLayout->height < HEADER_SIZE)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        /* The header is read the same way whatever the layout */
+        pLayout->bitsPerChannel = 0;
+        pLayout->alpha = 0;
+
+        if ((errRtn = extractRows(pLayout, pImageData, 0, header, HEADER_SIZE)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            unpackHeader(header, pEncodedDataSize, &flags, pExtension);
+            pLayout->bitsPerChannel = flags & FLAG_BITS_PER_CHANNEL;
+            pLayout->alpha = (flags & FLAG_ALPHA) != 0;
+            pLayout->compressed = (flags & FLAG_COMPRESSED) != 0;
+            pLayout->encrypted = (flags & FLAG_ENCRYPTED) != 0;
+            pLayout->checksummed = (flags & FLAG_CHECKSUM) != 0;
+            *pStartOfEncodedDataPixel = HEADER_SIZE;
+        }
+
+        /* Every bitmap written since the flags were added has FLAG_CHECKSUM
+         * set. One without may be from the original encoder, which walked 
+         * padded rows differently, so its header can be read wrongly above
+         * and is read again its way, and taken if it has no flags */
+        if (errRtn == success && (flags & FLAG_CHECKSUM) == 0 && 
+            pLayout->bytesPerPixel == BYTES_IN_PIXEL && pLayout->padding != 0 &&
+            extractLegacy(pLayout, pImageData, 0, legacyHeader, HEADER_SIZE) == success &&
+            unpackHeader(legacyHeader, &legacySize, &legacyFlags, legacyExtension) == success &&
+            legacyFlags == 0)
+        {
+            pLayout->legacy = 1;
+            pLayout->bitsPerChannel = 0;
+            pLayout->alpha = 0;
+            pLayout->compressed = 0;
+            pLayout->encrypted = 0;
+            pLayout->checksummed = 0;
+            *pEncodedDataSize = legacySize;
+            memcpy(pExtension, legacyExtension, EXTENSION_SIZE);
+        }
+
+        if (errRtn == success && layoutScheme(pLayout) == NULL)
+        {
+            errRtn = errorLayout;
+            ERROR_PRINT(errRtn);
+        }
+
+        /* A size which runs off the end of the image can't be genuine, nor
+         * can one which doesn't leave room for the prefix of encrypted data */
+        else if (errRtn == success &&
+                 (*pEncodedDataSize + checksumSize(pLayout) > 
+                  hiddenBytesInRows(pLayout, pLayout->height) - HEADER_SIZE ||
+                  (pLayout->encrypted && *pEncodedDataSize < CIPHER_PREFIX_SIZE)))
+        {
+            errRtn = errorSize;
+            ERROR_PRINT(errRtn);
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Hides or recovers count bytes held in consecutive channel bytes. 
+ *         The channels are visited row by row and each row is handed to the
+ *         kernel as one contiguous span, so the line padding is only stepped 
+ *         over at the end of a row. A byte whose channel bytes run on past the
+ *         end of a row is gathered into a buffer, which the kernel is run on.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Pointer to image data starting at a row.
+ *  @param firstChannel Index of the first channel byte, counting along the 
+ *         rows from pImageData and ignoring padding.
+ *  @param pBytes Pointer to the data to hide or the memory to recover it to.
+ *  @param count Number of bytes.
+ *  @param pScheme How the bytes are spread across the channel bytes.
+ *  @param extract Non zero to recover data, zero to hide it. */
+static void hideChannels(IN const tPixelLayout * pLayout, 
+                         IN_OUT uint8_t * pImageData, 
+                         uint64_t firstChannel,
+                         IN_OUT uint8_t * pBytes, 
+                         uint64_t count,
+                         IN const tHidingScheme * pScheme,
+                         int extract)
+{
+    uint64_t row = firstChannel / pLayout->rowBytes;
+    uint64_t column = firstChannel % pLayout->rowBytes;
+    uint64_t span = 0;
+    uint64_t index = 0;
+    uint8_t * pChannels[LAYOUT_MAX_CHANNELS];
+    uint8_t unit[LAYOUT_MAX_CHANNELS];
+
+    while (count > 0)
+    {
+        span = (pLayout->rowBytes - column) / pScheme->channels;
+        span = span < count ? span : count;
+
+        if (span > 0 && extract)
+        {
+            pScheme->extract(&pImageData[row * pLayout->widthBytes + column], pBytes, span);
+        }
+
+        else if (span > 0)
+        {
+            pScheme->embed(&pImageData[row * pLayout->widthBytes + column], pBytes, span);
+        }
+
+        else
+        {
+            span = 1;
+
+            for (index = 0; index < pScheme->channels; index++)
+            {
+                if (column == pLayout->rowBytes)
+                {
+                    row++;
+                    column = 0;
+                }
+
+                pChannels[index] = &pImageData[row * pLayout->widthBytes + column++];
+                unit[index] = *pChannels[index];
+            }
+
+            column -= pScheme->channels;
+
+            if (extract)
+            {
+                pScheme->extract(unit, pBytes, 1);
+            }
+
+            else
+            {
+                pScheme->embed(unit, pBytes, 1);
+
+                for (index = 0; index < pScheme->channels; index++)
+                {
+                    *pChannels[index] = unit[index];
+                }
+            }
+        }
+
+        pBytes += span;
+        count  -= span;
+        column += span * pScheme->channels;
+
+        if (column == pLayout->rowBytes)
+        {
+            row++;
+            column = 0;
+        }
+    }
+}
+
+/** @brief Does the work of embedBlock and extractBlock, taking the same 
+ *         parameters. The header is always run through the 3/3/2 kernels for
+ *         the pixel size and the data after it through those layoutScheme 
+ *         picks.
+ *  @param extract Non zero to recover data, zero to hide it.
+ *  @return An error value from enum eErrors. */
+static tError hideBlock(IN const tPixelLayout * pLayout, 
+                        IN_OUT uint8_t * pBlock, 
+                        uint64_t firstRow,
+                        uint64_t position,
+                        IN_OUT uint8_t * pBytes, 
+                        uint64_t count,
+                        int extract)
+{
+    tError errRtn = errorDefault;
+    const tHidingScheme * pScheme = layoutScheme(pLayout);
+    uint64_t blockChannel = firstRow * pLayout->rowBytes;
+    uint64_t headerBytes = 0;
+
+    if (pScheme == NULL)
+    {
+        errRtn = errorLayout;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        if (position < HEADER_SIZE)
+        {
+            headerBytes = HEADER_SIZE - position;
+            headerBytes = headerBytes < count ? headerBytes : count;
+
+            hideChannels(pLayout, pBlock, position * pLayout->bytesPerPixel - blockChannel, 
+                         pBytes, headerBytes, pixelScheme(pLayout), extract);
+        }
+
+        hideChannels(pLayout, pBlock, 
+                     hiddenChannel(pLayout, position + headerBytes) - blockChannel,
+                     &pBytes[headerBytes], count - headerBytes, pScheme, extract);
+
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+/** @brief Hides count bytes in the image, starting at byte position of the 
+ *         hidden stream. See embedBlock.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param position Offset into the hidden stream, the header included, of 
+ *         the first byte.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide.
+ *  @return An error value from enum eErrors. */
+tError embedRows(IN const tPixelLayout * pLayout, 
+                 IN_OUT uint8_t * pImageData, 
+                 uint64_t position,
+                 IN const uint8_t * pBytes, 
+                 uint64_t count)
+{
+    return embedBlock(pLayout, pImageData, 0, position, pBytes, count);
+}
+
+/** @brief Recovers count bytes hidden in the image, starting at byte position
+ *         of the hidden stream. See extractBlock.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param position Offset into the hidden stream, the header included, of 
+ *         the first byte.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return An error value from enum eErrors. */
+tError extractRows(IN const tPixelLayout * pLayout, 
+                   IN const uint8_t * pImageData, 
+                   uint64_t position,
+                   OUT uint8_t * pBytes, 
+                   uint64_t count)
+{
+    return extractBlock(pLayout, pImageData, 0, position, pBytes, count);
+}
+
+/** @brief Hides count bytes in a block of rows, starting at byte position of
+ *         the hidden stream. The header is split across pixels and the data 
+ *         after it is spread as pLayout->bitsPerChannel says. The bytes must 
+ *         all lie in the block.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param pBlock Pointer to the image data of the block.
+ *  @param firstRow Row of the image the block starts at.
+ *  @param position Offset into the hidden stream, the header included, of 
+ *         the first byte.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide.
+ *  @return An error value from enum eErrors. */
+tError embedBlock(IN const tPixelLayout * pLayout, 
+                  IN_OUT uint8_t * pBlock, 
+                  uint64_t firstRow,
+                  uint64_t position,
+                  IN const uint8_t * pBytes, 
+                  uint64_t count)
+{
+    return hideBlock(pLayout, pBlock, firstRow, position, (uint8_t *)pBytes, count, 0);
+}
+
+/** @brief Recovers count bytes hidden in a block of rows, starting at byte 
+ *         position of the hidden stream. The bytes must all lie in the block.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param pBlock Pointer to the image data of the block.
+ *  @param firstRow Row of the image the block starts at.
+ *  @param position Offset into the hidden stream, the header included, of 
+ *         the first byte.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return An error value from enum eErrors. */
+tError extractBlock(IN const tPixelLayout * pLayout, 
+                    IN const uint8_t * pBlock, 
+                    uint64_t firstRow,
+                    uint64_t position,
+                    OUT uint8_t * pBytes, 
+                    uint64_t count)
+{
+    return hideBlock(pLayout, (uint8_t *)pBlock, firstRow, position, pBytes, count, 1);
+}
+
+
+/** @brief Recovers count bytes hidden by the original encoder, starting at byte
+ *         position of the hidden stream. It walked the image a pixel at a 
+ *         time, skipping the row padding before any pixel whose byte index 
+ *         plus one was a multiple of the width in pixels. That only matches 
+ *         the ends of rows when there is no padding, so bitmaps with padding 
+ *         are read the same way here, from the start of the image each call.
+ *  @param pLayout Layout of the bitmap.
+ *  @param pImageData The image data, as much of it as the bytes span.
+ *  @param position Position in the hidden stream of the first byte.
+ *  @param pBytes Returns the bytes.
+ *  @param count Number of bytes to recover.
+ *  @return An error value from enum eErrors. */
+tError extractLegacy(IN const tPixelLayout * pLayout, 
+                     IN const uint8_t * pImageData, 
+                     uint64_t position,
+                     OUT uint8_t * pBytes, 
+                     uint64_t count)
+{
+    tError errRtn = success;
+    uint64_t index = 0;
+    uint64_t byte = 0;
+
+    for (byte = 0; errRtn == success && byte < position + count; byte++)
+    {
+        if ((index + 1) % pLayout->width == 0)
+        {
+            index += pLayout->padding;
+        }
+
+        if (index + BYTES_IN_PIXEL > pLayout->sizeOfData)
+        {
+            errRtn = errorSize;
+            ERROR_PRINT(errRtn);
+        }
+
+        else if (byte >= position)
+        {
+            extractBytesScalar(&pImageData[index], &pBytes[byte - position], 1);
+        }
+
+        index += BYTES_IN_PIXEL;
+    }
+
+    return errRtn;
+}
+
+/** The ways of spreading hidden bytes across channel bytes. */
+static const tHidingScheme hidingSchemes[] = {
+    { 0, BYTES_IN_PIXEL, embedBytes,  extractBytes  },
+    { 1, 8,              embedBytes1, extractBytes1 },
+    { 2, 4,              embedBytes2, extractBytes2 },
+    { 4, 2,              embedBytes4, extractBytes4 },
+    { 8, 1,              embedBytes8, extractBytes8 },
+};
+
+/** The 3/3/2 split for 32 bit pixels, which leaves the alpha byte alone. */
+static const tHidingScheme bgraScheme = 
+    { 0, BYTES_IN_PIXEL_ALPHA, embedBytesBgra, extractBytesBgra };
+
+/** @brief Looks up the scheme for hiding a number of bits in each channel.
+ *  @param bitsPerChannel 1, 2, 4 or 8, or zero for the 3/3/2 split.
+ *  @return The scheme, or NULL if there is none for bitsPerChannel. */
+const tHidingScheme * hidingScheme(uint64_t bitsPerChannel)
+{
+    const tHidingScheme * pScheme = NULL;
+    uint32_t index = 0;
+
+    for (index = 0; index < sizeof(hidingSchemes) / sizeof(hidingSchemes[0]); index++)
+    {
+        if (hidingSchemes[index].bitsPerChannel == bitsPerChannel)
+        {
+            pScheme = &hidingSchemes[index];
+        }
+    }
+
+    return pScheme;
+}
+
+/** @brief Looks up the scheme for splitting a byte across the colours of a 
+ *         pixel, which the header is always hidden with.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @return The scheme for the size of pixel. */
+const tHidingScheme * pixelScheme(IN const tPixelLayout * pLayout)
+{
+    return pLayout->bytesPerPixel == BYTES_IN_PIXEL_ALPHA ? &bgraScheme : hidingScheme(0);
+}
+
+/** @brief Looks up the scheme the data after the header is hidden with.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @return The scheme, or NULL if pLayout asks for one which can't be used. */
+const tHidingScheme * layoutScheme(IN const tPixelLayout * pLayout)
+{
+    const tHidingScheme * pScheme = NULL;
+
+    if (pLayout->alpha && pLayout->bytesPerPixel != BYTES_IN_PIXEL_ALPHA)
+    {
+        /* No alpha bytes to hide data in */
+    }
+
+    else if (pLayout->alpha && pLayout->bitsPerChannel == 0)
+    {
+        pScheme = hidingScheme(8 / BYTES_IN_PIXEL_ALPHA);
+    }
+
+    else if (pLayout->bitsPerChannel == 0)
+    {
+        pScheme = pixelScheme(pLayout);
+    }
+
+    /* Only the split across colours can step over the alpha bytes */
+    else if (pLayout->alpha || pLayout->bytesPerPixel == BYTES_IN_PIXEL)
+    {
+        pScheme = hidingScheme(pLayout->bitsPerChannel);
+    }
+
+    return pScheme;
+}
+
+/** @brief Sets the layout data is to be hidden with. Every layout other than
+ *         the split across colours uses each byte of a 32 bit pixel, so hides
+ *         data in the alpha bytes whether asked to or not.
+ *  @param pLayout Layout of the pixels in the cover bitmap.
+ *  @param bitsPerChannel Data bits to hide in each channel byte, see 
+ *         tPixelLayout.
+ *  @param alpha Non zero to hide data in the alpha bytes of a 32 bit bitmap.
+ *         Ignored for 24 bit bitmaps.
+ *  @param compress Non zero to hide the data compressed.
+ *  @param encrypt Non zero to hide the data encrypted.
+ *  @return An error value from enum eErrors. The data is always given a 
+ *          checksum. */
+tError chooseLayout(IN_OUT tPixelLayout * pLayout, uint64_t bitsPerChannel, int alpha,
+                    int compress, int encrypt)
+{
+    tError errRtn = errorDefault;
+
+    pLayout->bitsPerChannel = bitsPerChannel;
+    pLayout->alpha = pLayout->bytesPerPixel == BYTES_IN_PIXEL_ALPHA && 
+                     (alpha || bitsPerChannel != 0);
+    pLayout->compressed = compress != 0;
+    pLayout->encrypted = encrypt != 0;
+    pLayout->checksummed = 1;
+
+    if (layoutScheme(pLayout) == NULL)
+    {
+        errRtn = errorLayout;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+/** @brief Works out the HEADER_FLAGS byte recording a layout.
+ *  @param pLayout Layout the data is hidden with.
+ *  @return The flags. */
+uint8_t layoutFlags(IN const tPixelLayout * pLayout)
+{
+    return (uint8_t)(pLayout->bitsPerChannel | (pLayout->alpha ? FLAG_ALPHA : 0) |
+                     (pLayout->compressed ? FLAG_COMPRESSED : 0) |
+                     (pLayout->encrypted ? FLAG_ENCRYPTED : 0) |
+                     (pLayout->checksummed ? FLAG_CHECKSUM : 0));
+}
+
+/** @brief Works out the size of the checksum hidden after the data.
+ *  @param pLayout Layout of the hidden data.
+ *  @return CHECKSUM_SIZE if the layout has a checksum, otherwise zero. */
+uint64_t checksumSize(IN const tPixelLayout * pLayout)
+{
+    return pLayout->checksummed ? CHECKSUM_SIZE : 0;
+}
+
+/** @brief Works out how much of the hidden stream isn't the data itself: the
+ *         header, the prefix of encrypted data and the checksum.
+ *  @param pLayout Layout of the hidden data.
+ *  @return The number of bytes. */
+uint64_t streamOverhead(IN const tPixelLayout * pLayout)
+{
+    return HEADER_SIZE + (pLayout->encrypted ? CIPHER_PREFIX_SIZE : 0) + 
+           checksumSize(pLayout);
+}
+
+/** @brief Works out the first channel byte holding a byte of the hidden 
+ *         stream.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param position Offset into the hidden stream, the header included.
+ *  @return Index of the channel byte, counting along the rows and ignoring
+ *          padding. */
+uint64_t hiddenChannel(IN const tPixelLayout * pLayout, uint64_t position)
+{
+    const tHidingScheme * pScheme = layoutScheme(pLayout);
+    uint64_t channel = position * pLayout->bytesPerPixel;
+
+    if (pScheme->bitsPerChannel != 0 && position >= HEADER_SIZE)
+    {
+        channel = LAYOUT_DATA_CHANNEL(pLayout->bytesPerPixel) + 
+                  (position - HEADER_SIZE) * pScheme->channels;
+    }
+
+    return channel;
+}
+
+/** @brief Works out how many bytes of the hidden stream, the header included,
+ *         fit completely within the first rows of the image.
+ *  @param pLayout Layout of the pixels in the bitmap.
+ *  @param rows Number of rows.
+ *  @return Number of bytes. */
+uint64_t hiddenBytesInRows(IN const tPixelLayout * pLayout, uint64_t rows)
+{
+    const tHidingScheme * pScheme = layoutScheme(pLayout);
+    uint64_t dataChannel = LAYOUT_DATA_CHANNEL(pLayout->bytesPerPixel);
+    uint64_t channels = rows * pLayout->rowBytes;
+    uint64_t bytes = channels / pLayout->bytesPerPixel;
+
+    if (pScheme->bitsPerChannel != 0 && channels < dataChannel)
+    {
+        bytes = bytes < HEADER_SIZE ? bytes : HEADER_SIZE;
+    }
+
+    else if (pScheme->bitsPerChannel != 0)
+    {
+        bytes = HEADER_SIZE + (channels - dataChannel) / pScheme->channels;
+    }
+
+    return bytes;
+}
+
+/** @brief Runs one part of a parallel embed or extract. Used as the task 
+ *         function for the thread pool.
+ *  @param pArgument The tRowsTask describing the part. */
+static void rowsTask(void * pArgument)
+{
+    tRowsTask * pTask = pArgument;
+
+    if (pTask->extract)
+    {
+        pTask->result = extractRows(pTask->pLayout, pTask->pImageData, pTask->position, 
+                                    pTask->pBytes, pTask->count);
+    }
+
+    else
+    {
+        pTask->result = embedRows(pTask->pLayout, pTask->pImageData, pTask->position, 
+                                  pTask->pBytes, pTask->count);
+    }
+}
+
+
+/** @brief Splits an embed or extract into parts and runs them on a thread 
+ *         pool. Each part works out its own starting row from its first byte
+ *         and no two bytes share a channel byte, so the result is identical to
+ *         running in one thread.
+ *  @param pPool Threads to run the parts on.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param position Offset into the hidden stream of the first byte.
+ *  @param pBytes Pointer to the data to hide or the memory to recover it to.
+ *  @param count Number of bytes.
+ *  @param extract Non zero to recover data, zero to hide it.
+ *  @return An error value from enum eErrors. */
+static tError rowsParallel(IN tThreadPool * pPool,
+                           IN const tPixelLayout * pLayout,
+                           IN_OUT uint8_t * pImageData,
+                           uint64_t position,
+                           IN_OUT uint8_t * pBytes,
+                           uint64_t count,
+                           int extract)
+{
+    tError errRtn = errorDefault;
+    tRowsTask * pTasks = NULL;
+    uint64_t parts = pPool->threadCount * PARALLEL_PARTS_PER_THREAD;
+    uint64_t partSize = 0;
+    uint64_t done = 0;
+    uint64_t part = 0;
+    uint64_t submitted = 0;
+    tError waitRtn = errorDefault;
+
+    /* Enough parts to balance the threads, but none so small that handing 
+     * it over costs more than doing it. Parts are kept to whole vectors. */
+    partSize = (count + parts - 1) / parts;
+    partSize = partSize > PARALLEL_MIN_PART ? partSize : PARALLEL_MIN_PART;
+    partSize = (partSize + 63) & ~(uint64_t)63;
+    parts = (count + partSize - 1) / partSize;
+
+    if ((pTasks = malloc(parts * sizeof(tRowsTask))) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+
+        for (part = 0; errRtn == success && part < parts; part++)
+        {
+            pTasks[part].pLayout    = pLayout;
+            pTasks[part].pImageData = pImageData;
+            pTasks[part].position   = position + done;
+            pTasks[part].pBytes     = &pBytes[done];
+            pTasks[part].count      = count - done < partSize ? count - done : partSize;
+            pTasks[part].extract    = extract;
+            pTasks[part].result     = errorDefault;
+
+            if ((errRtn = threadPoolSubmit(pPool, rowsTask, &pTasks[part])) != success)
+            {
+                ERROR_PRINT(errRtn);
+            }
+
+            done += pTasks[part].count;
+        }
+
+        /* Parts already submitted still use pTasks, so are always waited for */
+        submitted = errRtn == success ? parts : part - 1;
+
+        if ((waitRtn = threadPoolWait(pPool)) != success)
+        {
+            ERROR_PRINT(waitRtn);
+            errRtn = errRtn == success ? waitRtn : errRtn;
+        }
+
+        for (part = 0; errRtn == success && part < submitted; part++)
+        {
+            if ((errRtn = pTasks[part].result) != success)
+            {
+                ERROR_PRINT(errRtn);
+            }
+        }
+    }
+
+    free(pTasks);
+
+    return errRtn;
+}
+
+
+/** @brief Hides count bytes in the image as embedRows does, spread across the
+ *         threads of a pool.
+ *  @param pPool Threads to hide the data with.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param position Offset into the hidden stream of the first byte.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide.
+ *  @return An error value from enum eErrors. */
+tError embedRowsParallel(IN tThreadPool * pPool,
+                         IN const tPixelLayout * pLayout, 
+                         IN_OUT uint8_t * pImageData, 
+                         uint64_t position,
+                         IN const uint8_t * pBytes, 
+                         uint64_t count)
+{
+    return rowsParallel(pPool, pLayout, pImageData, position, (uint8_t *)pBytes, 
+                        count, 0);
+}
+
+
+/** @brief Recovers count bytes from the image as extractRows does, spread 
+ *         across the threads of a pool.
+ *  @param pPool Threads to recover the data with.
+ *  @param pLayout Layout of the pixels in pImageData.
+ *  @param pImageData Pointer to the bitmap image data.
+ *  @param position Offset into the hidden stream of the first byte.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return An error value from enum eErrors. */
+tError extractRowsParallel(IN tThreadPool * pPool,
+                           IN const tPixelLayout * pLayout, 
+                           IN const uint8_t * pImageData, 
+                           uint64_t position,
+                           OUT uint8_t * pBytes, 
+                           uint64_t count)
+{
+    return rowsParallel(pPool, pLayout, (uint8_t *)pImageData, position, pBytes, 
+                        count, 1);
+}
+
+
+/** @brief The loop run by each thread of a pool. Takes tasks off the queue 
+ *         until the pool is destroyed.
+ *  @param pArgument The tThreadPool the thread belongs to.
+ *  @return Always NULL. */
+static void * threadPoolWorker(void * pArgument)
+{
+    tThreadPool * pPool = pArgument;
+    tTask task;
+
+    pthread_mutex_lock(&pPool->lock);
+
+    while (1)
+    {
+        while (pPool->queued == 0 && !pPool->stopping)
+        {
+            pthread_cond_wait(&pPool->taskReady, &pPool->lock);
+        }
+
+        if (pPool->queued == 0)
+        {
+            break;
+        }
+
+        task = pPool->queue[pPool->head];
+        pPool->head = (pPool->head + 1) % THREAD_POOL_QUEUE_SIZE;
+        pPool->queued--;
+        pthread_cond_signal(&pPool->spaceReady);
+
+        pthread_mutex_unlock(&pPool->lock);
+        task.function(task.pArgument);
+        pthread_mutex_lock(&pPool->lock);
+
+        if (--pPool->outstanding == 0)
+        {
+            pthread_cond_broadcast(&pPool->allDone);
+        }
+    }
+
+    pthread_mutex_unlock(&pPool->lock);
+
+    return NULL;
+}
+
+
+/** @brief Starts a pool of threads which run submitted tasks.
+ *  @param pPool The pool to start.
+ *  @param threadCount Number of threads in the pool, from 1 to 
+ *         THREAD_POOL_MAX_THREADS.
+ *  @return An error value from enum eErrors. */
+tError threadPoolCreate(OUT tThreadPool * pPool, uint32_t threadCount)
+{
+    tError errRtn = errorDefault;
+
+    memset(pPool, 0, sizeof(tThreadPool));
+    pthread_mutex_init(&pPool->lock, NULL);
+    pthread_cond_init(&pPool->taskReady, NULL);
+    pthread_cond_init(&pPool->spaceReady, NULL);
+    pthread_cond_init(&pPool->allDone, NULL);
+
+    /* Work is split into parts per thread, so a pool needs at least one */
+    if (threadCount < 1 || threadCount > THREAD_POOL_MAX_THREADS)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pPool->pThreads = malloc(threadCount * sizeof(pthread_t))) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    while (errRtn == success && pPool->threadCount < threadCount)
+    {
+        if (pthread_create(&pPool->pThreads[pPool->threadCount], NULL, 
+                           threadPoolWorker, pPool) != success)
+        {
+            errRtn = errorThread;
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            pPool->threadCount++;
+        }
+    }
+
+    if (errRtn != success)
+    {
+        threadPoolDestroy(pPool);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Queues a task to be run by the next free thread of a pool. Blocks 
+ *         while the queue is full.
+ *  @param pPool The pool to run the task.
+ *  @param function The task.
+ *  @param pArgument Passed to the task.
+ *  @return An error value from enum eErrors. */
+tError threadPoolSubmit(IN tThreadPool * pPool, tTaskFunction function, 
+                        IN void * pArgument)
+{
+    pthread_mutex_lock(&pPool->lock);
+
+    while (pPool->queued == THREAD_POOL_QUEUE_SIZE)
+    {
+        pthread_cond_wait(&pPool->spaceReady, &pPool->lock);
+    }
+
+    pPool->queue[(pPool->head + pPool->queued) % THREAD_POOL_QUEUE_SIZE].function  = function;
+    pPool->queue[(pPool->head + pPool->queued) % THREAD_POOL_QUEUE_SIZE].pArgument = pArgument;
+    pPool->queued++;
+    pPool->outstanding++;
+
+    pthread_cond_signal(&pPool->taskReady);
+    pthread_mutex_unlock(&pPool->lock);
+
+    return success;
+}
+
+
+/** @brief Waits until every task submitted to a pool has finished.
+ *  @param pPool The pool to wait for.
+ *  @return An error value from enum eErrors. */
+tError threadPoolWait(IN tThreadPool * pPool)
+{
+    pthread_mutex_lock(&pPool->lock);
+
+    while (pPool->outstanding > 0)
+    {
+        pthread_cond_wait(&pPool->allDone, &pPool->lock);
+    }
+
+    pthread_mutex_unlock(&pPool->lock);
+
+    return success;
+}
+
+
+/** @brief Finishes any queued tasks and stops the threads of a pool.
+ *  @param pPool The pool to stop.
+ *  @return An error value from enum eErrors. */
+tError threadPoolDestroy(IN_OUT tThreadPool * pPool)
+{
+    uint32_t thread = 0;
+
+    pthread_mutex_lock(&pPool->lock);
+    pPool->stopping = 1;
+    pthread_cond_broadcast(&pPool->taskReady);
+    pthread_mutex_unlock(&pPool->lock);
+
+    for (thread = 0; thread < pPool->threadCount; thread++)
+    {
+        pthread_join(pPool->pThreads[thread], NULL);
+    }
+
+    free(pPool->pThreads);
+    pthread_mutex_destroy(&pPool->lock);
+    pthread_cond_destroy(&pPool->taskReady);
+    pthread_cond_destroy(&pPool->spaceReady);
+    pthread_cond_destroy(&pPool->allDone);
+
+    memset(pPool, 0, sizeof(tThreadPool));
+
+    return success;
+}
+
+
+/** @brief Allocates and starts a thread pool, for callers which only see 
+ *         the public header and so can't hold a tThreadPool themselves.
+ *  @param threadCount Number of threads to start, from 1 to 
+ *         THREAD_POOL_MAX_THREADS.
+ *  @param ppPool Returns the pool, to be passed to threadPoolClose.
+ *  @return An error value from enum eErrors. */
+tError threadPoolOpen(uint32_t threadCount, OUT tThreadPool ** ppPool)
+{
+    tError errRtn = errorDefault;
+    tThreadPool * pPool = NULL;
+
+    if (ppPool == NULL)
+    {
+        errRtn = errorNull;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (threadCount < 1 || threadCount > THREAD_POOL_MAX_THREADS)
+    {
+        errRtn = errorSize;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((pPool = malloc(sizeof(tThreadPool))) == NULL)
+    {
+        errRtn = errorMalloc;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = threadPoolCreate(pPool, threadCount)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        free(pPool);
+    }
+
+    else
+    {
+        *ppPool = pPool;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Stops and frees a thread pool from threadPoolOpen.
+ *  @param pPool The pool, or NULL.
+ *  @return An error value from enum eErrors. */
+tError threadPoolClose(IN_OUT tThreadPool * pPool)
+{
+    tError errRtn = success;
+
+    if (pPool != NULL)
+    {
+        errRtn = threadPoolDestroy(pPool);
+        free(pPool);
+    }
+
+    return errRtn;
+}
+
+
+#if defined(USE_IO_URING)
+/** @brief Unmaps the rings of an I/O engine's io_uring and closes it.
+ *  @param pEngine The engine. */
+static void ioUringRelease(IN_OUT tIoEngine * pEngine)
+{
+    if (pEngine->pSqes != NULL)
+    {
+        munmap(pEngine->pSqes, pEngine->sqesSize);
+    }
+
+    if (pEngine->pCqRing != NULL && pEngine->pCqRing != pEngine->pSqRing)
+    {
+        munmap(pEngine->pCqRing, pEngine->cqRingSize);
+    }
+
+    if (pEngine->pSqRing != NULL)
+    {
+        munmap(pEngine->pSqRing, pEngine->sqRingSize);
+    }
+
+    if (pEngine->ring != -1)
+    {
+        close(pEngine->ring);
+    }
+
+    pEngine->pSqes = NULL;
+    pEngine->pCqRing = NULL;
+    pEngine->pSqRing = NULL;
+    pEngine->ring = -1;
+}
+
+
+/** @brief Asks the kernel whether an io_uring can run the reads and writes 
+ *         an I/O engine queues. IORING_OP_READ and IORING_OP_WRITE only 
+ *         arrived in 5.6, as did the probe itself, so 5.1 to 5.5 kernels 
+ *         set a ring up but fail every request on it.
+ *  @param ring The io_uring.
+ *  @return Non zero if both are supported. */
+static int ioUringSupported(int ring)
+{
+    union {
+        struct io_uring_probe probe;
+        uint8_t space[sizeof(struct io_uring_probe) + 
+                      IO_ENGINE_PROBE_OPS * sizeof(struct io_uring_probe_op)];
+    } probe;
+    int supported = 0;
+
+    memset(&probe, 0, sizeof(probe));
+
+    if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, &probe.probe, 
+                IO_ENGINE_PROBE_OPS) == 0 &&
+        probe.probe.ops_len > IORING_OP_READ && probe.probe.ops_len > IORING_OP_WRITE)
+    {
+        supported = probe.probe.ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED &&
+                    probe.probe.ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED;
+    }
+
+    return supported;
+}
+
+
+/** @brief Sets an I/O engine up to use a new io_uring, mapping its rings.
+ *  @param pEngine The engine.
+ *  @param entries Number of entries in the submission ring.
+ *  @return An error value from enum eErrors. ring is left -1 on failure. */
+static tError ioUringCreate(IN_OUT tIoEngine * pEngine, uint32_t entries)
+{
+    tError errRtn = errorDefault;
+    struct io_uring_params params;
+    int ring = -1;
+    void * pMapping = MAP_FAILED;
+
+    memset(&params, 0, sizeof(struct io_uring_params));
+
+    /* Not offered by older kernels or inside some sandboxes */
+    if ((ring = syscall(__NR_io_uring_setup, entries, &params)) == -1)
+    {
+        return errorIo;
+    }
+
+    else if (!ioUringSupported(ring))
+    {
+        close(ring);
+        return errorIo;
+    }
+
+    pEngine->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    pEngine->cqRingSize = params.cq_off.cqes + 
+                          params.cq_entries * sizeof(struct io_uring_cqe);
+    pEngine->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        pEngine->sqRingSize = pEngine->sqRingSize > pEngine->cqRingSize ? 
+                              pEngine->sqRingSize : pEngine->cqRingSize;
+        pEngine->cqRingSize = 0;
+    }
+
+    if ((pMapping = mmap(NULL, pEngine->sqRingSize, PROT_READ | PROT_WRITE, 
+                         MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING)) == MAP_FAILED)
+    {
+        errRtn = errorMmap;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        pEngine->pSqRing = pMapping;
+        pEngine->pCqRing = pMapping;
+        errRtn = success;
+    }
+
+    if (errRtn == success && pEngine->cqRingSize > 0)
+    {
+        if ((pMapping = mmap(NULL, pEngine->cqRingSize, PROT_READ | PROT_WRITE, 
+                             MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING)) 
+            == MAP_FAILED)
+        {
+            errRtn = errorMmap;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else
+        {
+            pEngine->pCqRing = pMapping;
+        }
+    }
+
+    if (errRtn == success)
+    {
+        if ((pMapping = mmap(NULL, pEngine->sqesSize, PROT_READ | PROT_WRITE, 
+                             MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES)) == MAP_FAILED)
+        {
+            errRtn = errorMmap;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else
+        {
+            pEngine->pSqes = pMapping;
+        }
+    }
+
+    if (errRtn == success)
+    {
+        pEngine->pSqHead  = (uint32_t *)&pEngine->pSqRing[params.sq_off.head];
+        pEngine->pSqTail  = (uint32_t *)&pEngine->pSqRing[params.sq_off.tail];
+        pEngine->pSqMask  = (uint32_t *)&pEngine->pSqRing[params.sq_off.ring_mask];
+        pEngine->pSqArray = (uint32_t *)&pEngine->pSqRing[params.sq_off.array];
+        pEngine->sqEntries = params.sq_entries;
+        pEngine->pCqHead  = (uint32_t *)&pEngine->pCqRing[params.cq_off.head];
+        pEngine->pCqTail  = (uint32_t *)&pEngine->pCqRing[params.cq_off.tail];
+        pEngine->pCqMask  = (uint32_t *)&pEngine->pCqRing[params.cq_off.ring_mask];
+        pEngine->pCqes    = &pEngine->pCqRing[params.cq_off.cqes];
+        pEngine->ring = ring;
+    }
+
+    else
+    {
+        pEngine->ring = ring;
+        ioUringRelease(pEngine);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Adds what is left of a request to the submission ring of an 
+ *         io_uring, first handing the kernel everything already there if 
+ *         the ring is full.
+ *  @param pEngine The engine.
+ *  @param pRequest The request.
+ *  @return An error value from enum eErrors. */
+static tError ioUringQueue(IN_OUT tIoEngine * pEngine, IN tIoRequest * pRequest)
+{
+    tError errRtn = success;
+    uint32_t tail = *pEngine->pSqTail;
+    uint32_t index = tail & *pEngine->pSqMask;
+    struct io_uring_sqe * pEntry = &((struct io_uring_sqe *)pEngine->pSqes)[index];
+    uint64_t left = pRequest->size - pRequest->done;
+    int submitted = 0;
+
+    while (errRtn == success &&
+           tail - __atomic_load_n(pEngine->pSqHead, __ATOMIC_ACQUIRE) == pEngine->sqEntries)
+    {
+        if ((submitted = syscall(__NR_io_uring_enter, pEngine->ring, pEngine->unsubmitted, 
+                                 0, 0, NULL, 0)) >= 0)
+        {
+            pEngine->unsubmitted -= submitted;
+        }
+
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            errRtn = errorIo;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+    }
+
+    if (errRtn == success)
+    {
+        memset(pEntry, 0, sizeof(struct io_uring_sqe));
+        pEntry->opcode = pRequest->write ? IORING_OP_WRITE : IORING_OP_READ;
+        pEntry->fd = pRequest->fd;
+        pEntry->addr = (uintptr_t)&pRequest->pBuffer[pRequest->done];
+        pEntry->len = left < IO_ENGINE_MAX_TRANSFER ? left : IO_ENGINE_MAX_TRANSFER;
+        pEntry->off = pRequest->offset + pRequest->done;
+        pEntry->user_data = (uintptr_t)pRequest;
+        pEngine->pSqArray[index] = index;
+
+        __atomic_store_n(pEngine->pSqTail, tail + 1, __ATOMIC_RELEASE);
+        pEngine->unsubmitted++;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Hands the kernel any queued requests and takes one completion off 
+ *         an io_uring, waiting for it if need be. A short read or write is 
+ *         queued again for the rest of its bytes, and one which was 
+ *         interrupted or not ready is queued again whole.
+ *  @param pEngine The engine.
+ *  @param ppRequest Returns the request if it is done, otherwise NULL.
+ *  @return An error value from enum eErrors. */
+static tError ioUringReap(IN_OUT tIoEngine * pEngine, OUT tIoRequest ** ppRequest)
+{
+    tError errRtn = success;
+    uint32_t head = *pEngine->pCqHead;
+    struct io_uring_cqe * pCompletion = NULL;
+    tIoRequest * pRequest = NULL;
+    int submitted = 0;
+
+    *ppRequest = NULL;
+
+    if (head == __atomic_load_n(pEngine->pCqTail, __ATOMIC_ACQUIRE))
+    {
+        if ((submitted = syscall(__NR_io_uring_enter, pEngine->ring, pEngine->unsubmitted, 
+                                 1, IORING_ENTER_GETEVENTS, NULL, 0)) >= 0)
+        {
+            pEngine->unsubmitted -= submitted;
+        }
+
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            errRtn = errorIo;
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        return errRtn;
+    }
+
+    pCompletion = &((struct io_uring_cqe *)pEngine->pCqes)[head & *pEngine->pCqMask];
+    pRequest = (tIoRequest *)(uintptr_t)pCompletion->user_data;
+
+    if (pCompletion->res > 0)
+    {
+        pRequest->done += pCompletion->res;
+    }
+
+    /* Nothing moved means the file ended early, unless the request was 
+     * interrupted or not ready, when it is queued again below */
+    else if (pCompletion->res != -EAGAIN && pCompletion->res != -EINTR)
+    {
+        pRequest->result = pRequest->write ? errorFwrite : errorFread;
+        errno = -pCompletion->res;
+        ERROR_ERRNO_PRINT(pRequest->result);
+    }
+
+    __atomic_store_n(pEngine->pCqHead, head + 1, __ATOMIC_RELEASE);
+
+    if (pRequest->result == success && pRequest->done < pRequest->size)
+    {
+        errRtn = ioUringQueue(pEngine, pRequest);
+    }
+
+    else
+    {
+        *ppRequest = pRequest;
+    }
+
+    return errRtn;
+}
+#endif
+
+
+/** @brief Run by the threads of an I/O engine without io_uring. Moves all the
+ *         bytes of a request with pread or pwrite, then adds it to the 
+ *         engine's finished requests.
+ *  @param pArgument The tIoRequest. */
+static void ioEngineTask(void * pArgument)
+{
+    tIoRequest * pRequest = pArgument;
+    tIoEngine * pEngine = pRequest->pEngine;
+    uint64_t left = 0;
+    ssize_t moved = 0;
+
+    while (pRequest->result == success && pRequest->done < pRequest->size)
+    {
+        left = pRequest->size - pRequest->done;
+        left = left < IO_ENGINE_MAX_TRANSFER ? left : IO_ENGINE_MAX_TRANSFER;
+
+        if (pRequest->write)
+        {
+            moved = pwrite(pRequest->fd, &pRequest->pBuffer[pRequest->done], left, 
+                           pRequest->offset + pRequest->done);
+        }
+
+        else
+        {
+            moved = pread(pRequest->fd, &pRequest->pBuffer[pRequest->done], left, 
+                          pRequest->offset + pRequest->done);
+        }
+
+        if (moved > 0)
+        {
+            pRequest->done += moved;
+        }
+
+        /* Nothing moved means the file ended early */
+        else if (moved == 0 || errno != EINTR)
+        {
+            pRequest->result = pRequest->write ? errorFwrite : errorFread;
+            ERROR_ERRNO_PRINT(pRequest->result);
+        }
+    }
+
+    pthread_mutex_lock(&pEngine->lock);
+    pRequest->pNext = pEngine->pFinished;
+    pEngine->pFinished = pRequest;
+    pthread_cond_signal(&pEngine->finished);
+    pthread_mutex_unlock(&pEngine->lock);
+}
+
+
+/** @brief Starts an I/O engine, using io_uring where the kernel offers it and
+ *         otherwise a pool of IO_ENGINE_THREADS threads calling pread and 
+ *         pwrite.
+ *  @param pEngine The engine to start.
+ *  @param entries Most requests expected in flight at once.
+ *  @return An error value from enum eErrors. */
+tError ioEngineCreate(OUT tIoEngine * pEngine, uint32_t entries)
+{
+    tError errRtn = errorDefault;
+
+    memset(pEngine, 0, sizeof(tIoEngine));
+    pEngine->ring = -1;
+    pthread_mutex_init(&pEngine->lock, NULL);
+    pthread_cond_init(&pEngine->finished, NULL);
+
+#if defined(USE_IO_URING)
+    errRtn = ioUringCreate(pEngine, entries);
+#endif
+
+    if (pEngine->ring == -1 && 
+        (errRtn = threadPoolCreate(&pEngine->pool, IO_ENGINE_THREADS)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        pthread_mutex_destroy(&pEngine->lock);
+        pthread_cond_destroy(&pEngine->finished);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Starts a read or write. Its buffer must stay put until 
+ *         ioEngineWait returns it.
+ *  @param pEngine The engine.
+ *  @param pRequest The request, with fd, pBuffer, size, offset, write and 
+ *         pTag filled in.
+ *  @return An error value from enum eErrors. */
+tError ioEngineSubmit(IN_OUT tIoEngine * pEngine, IN_OUT tIoRequest * pRequest)
+{
+    tError errRtn = errorDefault;
+
+    pRequest->done = 0;
+    pRequest->result = success;
+    pRequest->pEngine = pEngine;
+    pRequest->pNext = NULL;
+
+    if (pRequest->size == 0)
+    {
+        pthread_mutex_lock(&pEngine->lock);
+        pRequest->pNext = pEngine->pFinished;
+        pEngine->pFinished = pRequest;
+        pthread_mutex_unlock(&pEngine->lock);
+        errRtn = success;
+    }
+
+#if defined(USE_IO_URING)
+    else if (pEngine->ring != -1)
+    {
+        errRtn = ioUringQueue(pEngine, pRequest);
+    }
+#endif
+
+    else
+    {
+        errRtn = threadPoolSubmit(&pEngine->pool, ioEngineTask, pRequest);
+    }
+
+    if (errRtn == success)
+    {
+        pEngine->inFlight++;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Waits for one submitted request to finish, in whatever order they
+ *         do. Check its result.
+ *  @param pEngine The engine.
+ *  @param ppRequest Returns the request.
+ *  @return errorNull if nothing is in flight, otherwise an error value from 
+ *          enum eErrors. */
+tError ioEngineWait(IN_OUT tIoEngine * pEngine, OUT tIoRequest ** ppRequest)
+{
+    tError errRtn = pEngine->inFlight > 0 ? success : errorNull;
+
+    *ppRequest = NULL;
+
+    while (errRtn == success && *ppRequest == NULL)
+    {
+        pthread_mutex_lock(&pEngine->lock);
+
+        while (pEngine->ring == -1 && pEngine->pFinished == NULL)
+        {
+            pthread_cond_wait(&pEngine->finished, &pEngine->lock);
+        }
+
+        if (pEngine->pFinished != NULL)
+        {
+            *ppRequest = pEngine->pFinished;
+            pEngine->pFinished = pEngine->pFinished->pNext;
+        }
+
+        pthread_mutex_unlock(&pEngine->lock);
+
+#if defined(USE_IO_URING)
+        if (*ppRequest == NULL)
+        {
+            errRtn = ioUringReap(pEngine, ppRequest);
+        }
+#endif
+    }
+
+    if (*ppRequest != NULL)
+    {
+        pEngine->inFlight--;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Stops an I/O engine. Wait for every request first: the kernel may
+ *         still use the buffers of any left in flight.
+ *  @param pEngine The engine to stop.
+ *  @return An error value from enum eErrors. */
+tError ioEngineDestroy(IN_OUT tIoEngine * pEngine)
+{
+    if (pEngine->ring == -1)
+    {
+        threadPoolDestroy(&pEngine->pool);
+    }
+
+#if defined(USE_IO_URING)
+    else
+    {
+        ioUringRelease(pEngine);
+    }
+#endif
+
+    pthread_mutex_destroy(&pEngine->lock);
+    pthread_cond_destroy(&pEngine->finished);
+
+    memset(pEngine, 0, sizeof(tIoEngine));
+    pEngine->ring = -1;
+
+    return success;
+}
+
+/** @brief Fills simdKernels in with the kernels of an instruction set level.
+ *         The BMI2 word kernels lie outside the levels, so are used at any 
+ *         level above scalar when the CPU has them. Forcing the scalar level
+ *         keeps to the portable word kernels.
+ *  @param level The level. */
+static void simdKernelsPick(tSimdLevel level)
+{
+    tSimdKernels kernels;
+    int pixel = 0;
+    int bgra = 0;
+    int chacha = 0;
+
+    memset(&kernels, 0, sizeof(tSimdKernels));
+    kernels.crc32c = crc32cScalar;
+
+#if defined(SIMD_KERNELS)
+    if (level >= simdAvx512)
+    {
+        kernels.embed[pixel] = embedBytesAvx512;
+        kernels.extract[pixel++] = extractBytesAvx512;
+    }
+
+    if (level >= simdAvx2)
+    {
+        kernels.embed[pixel] = embedBytesAvx2;
+        kernels.extract[pixel++] = extractBytesAvx2;
+        kernels.embedBgra[bgra] = embedBytesBgraAvx2;
+        kernels.extractBgra[bgra++] = extractBytesBgraAvx2;
+        kernels.chacha[chacha++] = chachaXorAvx2;
+    }
+
+    if (level >= simdSse42)
+    {
+        kernels.crc32c = crc32cSse42;
+    }
+
+    if (level >= simdSsse3)
+    {
+        kernels.embed[pixel] = embedBytesSsse3;
+        kernels.extract[pixel++] = extractBytesSsse3;
+    }
+
+    if (level >= simdSse2)
+    {
+        kernels.embedBgra[bgra] = embedBytesBgraSse2;
+        kernels.extractBgra[bgra++] = extractBytesBgraSse2;
+        kernels.chacha[chacha++] = chachaXorSse2;
+    }
+
+    if (level > simdScalar && __builtin_cpu_supports("bmi2"))
+    {
+        kernels.embed[pixel] = embedBytesBmi2;
+        kernels.extract[pixel++] = extractBytesBmi2;
+    }
+#endif
+
+    kernels.embed[pixel] = embedBytesSwar;
+    kernels.extract[pixel++] = extractBytesSwar;
+
+    simdKernels = kernels;
+}
+
+/** @brief Picks the kernels for the best level the CPU supports as the 
+ *         library loads, so the hot paths only follow simdKernels. */
+__attribute__((constructor)) static void simdLevelInit(void)
+{
+    simdLevelInUse = simdDetect();
+    simdKernelsPick(simdLevelInUse);
+}
+
+/** @brief Asks the CPU, through cpuid, which instruction set levels it and 
+ *         the operating system support.
+ *  @return The highest level supported. */
+tSimdLevel simdDetect(void)
+{
+    tSimdLevel level = simdScalar;
+
+#if defined(SIMD_KERNELS)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vbmi"))
+    {
+        level = simdAvx512;
+    }
+
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        level = simdAvx2;
+    }
+
+    else if (__builtin_cpu_supports("sse4.2"))
+    {
+        level = simdSse42;
+    }
+
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        level = simdSsse3;
+    }
+
+    else
+    {
+        level = simdSse2;
+    }
+#endif
+
+    return level;
+}
+
+/** @brief Gives the instruction set level the kernels are picked by, the 
+ *         best the CPU supports unless simdForce has lowered it.
+ *  @return The level. */
+tSimdLevel simdLevel(void)
+{
+    return simdLevelInUse;
+}
+
+/** @brief Makes the kernels be picked by a given instruction set level 
+ *         rather than the best the CPU supports, e.g. to test or time the 
+ *         narrower kernels. Call before any threads are started.
+ *  @param levelName Name of the level, from simdLevelNames.
+ *  @return An error value from enum eErrors. errorSimd if there is no such
+ *          level or the CPU doesn't support it. */
+tError simdForce(IN const char * levelName)
+{
+    tError errRtn = errorSimd;
+    uint32_t level = 0;
+
+    for (level = simdScalar; level <= simdAvx512; level++)
+    {
+        if (strcmp(levelName, simdLevelNames[level]) == 0 && level <= simdDetect())
+        {
+            simdLevelInUse = level;
+            simdKernelsPick(simdLevelInUse);
+            errRtn = success;
+        }
+    }
+
+    return errRtn;
+}
+
+/** @brief Hides one byte from pBytes in each of count consecutive pixels.
+ *         The widest kernel the CPU supports handles the bulk of the data,
+ *         a word kernel what it leaves a word at a time and the scalar 
+ *         kernel finishes off the remainder.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide. */
+void embedBytes(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const tBulkEmbedKernel * pKernel = NULL;
+
+    for (pKernel = simdKernels.embed; *pKernel != NULL; pKernel++)
+    {
+        done += (*pKernel)(&pPixels[done * BYTES_IN_PIXEL], &pBytes[done], count - done);
+    }
+
+    embedBytesScalar(&pPixels[done * BYTES_IN_PIXEL], &pBytes[done], count - done);
+}
+
+
+/** @brief Hides one byte from pBytes in each of count consecutive pixels, one
+ *         pixel at a time.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide. */
+void embedBytesScalar(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t index = 0;
+
+    while (index < count)
+    {
+        pPixels[BLUE]  = (pPixels[BLUE]  & ~BLUE_BITMASK)  | ( pBytes[index]                            & BLUE_BITMASK);
+        pPixels[GREEN] = (pPixels[GREEN] & ~GREEN_BITMASK) | ((pBytes[index] >> BLUE_BITS)              & GREEN_BITMASK);
+        pPixels[RED]   = (pPixels[RED]   & ~RED_BITMASK)   | ((pBytes[index] >> (BLUE_BITS + GREEN_BITS)) & RED_BITMASK);
+
+        pPixels += BYTES_IN_PIXEL;
+        index++;
+    }
+}
+
+
+/** @brief Recovers the byte hidden in each of count consecutive pixels.
+ *         The widest kernel the CPU supports handles the bulk of the data,
+ *         a word kernel what it leaves a word at a time and the scalar 
+ *         kernel finishes off the remainder.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover. */
+void extractBytes(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const tBulkExtractKernel * pKernel = NULL;
+
+    for (pKernel = simdKernels.extract; *pKernel != NULL; pKernel++)
+    {
+        done += (*pKernel)(&pPixels[done * BYTES_IN_PIXEL], &pBytes[done], count - done);
+    }
+
+    extractBytesScalar(&pPixels[done * BYTES_IN_PIXEL], &pBytes[done], count - done);
+}
+
+
+/** @brief Recovers the byte hidden in each of count consecutive pixels, one 
+ *         pixel at a time.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover. */
+void extractBytesScalar(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t index = 0;
+
+    while (index < count)
+    {
+        pBytes[index] =  (pPixels[BLUE]  & BLUE_BITMASK)
+                      | ((pPixels[GREEN] & GREEN_BITMASK) << BLUE_BITS)
+                      | ((pPixels[RED]   & RED_BITMASK)   << (BLUE_BITS + GREEN_BITS));
+
+        pPixels += BYTES_IN_PIXEL;
+        index++;
+    }
+}
+
+
+/* The word kernels work on blocks of 8 data bytes, which map onto 24 pixel 
+ * bytes or three little endian 64 bit words. Byte j of word w is pixel byte
+ * 8w + j, so holds colour (j + 2w) % 3: the colours of each word take turns
+ * at bytes 0, 3 and 6, bytes 1, 4 and 7, and bytes 2 and 5. */
+#define WORD_LANES_0                0x00FF0000FF0000FFULL
+#define WORD_LANES_1                0xFF0000FF0000FF00ULL
+#define WORD_LANES_2                0x0000FF0000FF0000ULL
+#define WORD_BLUE(lanes)            ((lanes) & (BLUE_BITMASK  * 0x0101010101010101ULL))
+#define WORD_GREEN(lanes)           ((lanes) & (GREEN_BITMASK * 0x0101010101010101ULL))
+#define WORD_RED(lanes)             ((lanes) & (RED_BITMASK   * 0x0101010101010101ULL))
+
+/** All the data bits in each word of a block. */
+static const uint64_t dataWordBits[3] = {
+    WORD_BLUE(WORD_LANES_0) | WORD_GREEN(WORD_LANES_1) | WORD_RED(WORD_LANES_2),
+    WORD_BLUE(WORD_LANES_1) | WORD_GREEN(WORD_LANES_2) | WORD_RED(WORD_LANES_0),
+    WORD_BLUE(WORD_LANES_2) | WORD_GREEN(WORD_LANES_0) | WORD_RED(WORD_LANES_1)
+};
+
+/** Bit of the 8 data bytes each word of a block starts at: the 22 bits of
+ *  the first word, then the 21 of the second. */
+static const int dataWordShift[3] = { 0, 22, 43 };
+
+
+/** @brief Hides the data bytes belonging to one word of a block in it.
+ *  @param pixels The pixel bytes.
+ *  @param spread Each data byte copied into all the bytes of its pixel.
+ *  @param blue The data bits of the blue bytes of the word, and green and 
+ *         red those of the others.
+ *  @return The pixel bytes with the data hidden in them. */
+static inline uint64_t embedWordSwar(uint64_t pixels, uint64_t spread, 
+                                     uint64_t blue, uint64_t green, uint64_t red)
+{
+    /* Shifts across the whole word are fine here as the bits dragged across
+     * from the neighbouring byte are always masked off */
+    return (pixels & ~(blue | green | red))
+         | ( spread                             & blue)
+         | ((spread >> BLUE_BITS)               & green)
+         | ((spread >> (BLUE_BITS + GREEN_BITS)) & red);
+}
+
+
+/** @brief Hides 8 data bytes at a time in 24 pixel bytes, three 64 bit words
+ *         at a time, with shifts and masks which work on every byte of a 
+ *         word at once. Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+uint64_t embedBytesSwar(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    uint64_t spread[3];
+    uint64_t words[3];
+    const uint8_t * pData = NULL;
+
+    while (count - done >= 8)
+    {
+        pData = &pBytes[done];
+
+        /* Each data byte copied into all three bytes of its pixel */
+        spread[0] = pData[0] * 0x010101ULL | (pData[1] * 0x010101ULL) << 24 | 
+                    (pData[2] * 0x0101ULL) << 48;
+        spread[1] = pData[2] | (pData[3] * 0x010101ULL) << 8 | 
+                    (pData[4] * 0x010101ULL) << 32 | (uint64_t)pData[5] << 56;
+        spread[2] = pData[5] * 0x0101ULL | (pData[6] * 0x010101ULL) << 16 | 
+                    (pData[7] * 0x010101ULL) << 40;
+
+        memcpy(words, &pPixels[done * BYTES_IN_PIXEL], sizeof(words));
+
+        words[0] = embedWordSwar(words[0], spread[0], WORD_BLUE(WORD_LANES_0), 
+                                 WORD_GREEN(WORD_LANES_1), WORD_RED(WORD_LANES_2));
+        words[1] = embedWordSwar(words[1], spread[1], WORD_BLUE(WORD_LANES_1), 
+                                 WORD_GREEN(WORD_LANES_2), WORD_RED(WORD_LANES_0));
+        words[2] = embedWordSwar(words[2], spread[2], WORD_BLUE(WORD_LANES_2), 
+                                 WORD_GREEN(WORD_LANES_0), WORD_RED(WORD_LANES_1));
+
+        memcpy(&pPixels[done * BYTES_IN_PIXEL], words, sizeof(words));
+        done += 8;
+    }
+
+    return done;
+}
+
+
+/** @brief Moves the data bits of each byte of one word of a block to where 
+ *         they sit in the data byte, so the bytes of each pixel only need 
+ *         ORing together.
+ *  @param pixels The pixel bytes.
+ *  @param blue The data bits of the blue bytes of the word, and green and 
+ *         red those of the others.
+ *  @return The moved bits. */
+static inline uint64_t extractWordSwar(uint64_t pixels, 
+                                       uint64_t blue, uint64_t green, uint64_t red)
+{
+    return ( pixels & blue)
+         | ((pixels & green) << BLUE_BITS)
+         | ((pixels & red)   << (BLUE_BITS + GREEN_BITS));
+}
+
+
+/** @brief Recovers 8 data bytes at a time from 24 pixel bytes, three 64 bit
+ *         words at a time, as embedBytesSwar hides them. Any bytes left over 
+ *         are not processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+uint64_t extractBytesSwar(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    uint64_t words[3];
+    uint64_t folded[3];
+    uint64_t data = 0;
+    int word = 0;
+
+    while (count - done >= 8)
+    {
+        memcpy(words, &pPixels[done * BYTES_IN_PIXEL], sizeof(words));
+
+        words[0] = extractWordSwar(words[0], WORD_BLUE(WORD_LANES_0), 
+                                   WORD_GREEN(WORD_LANES_1), WORD_RED(WORD_LANES_2));
+        words[1] = extractWordSwar(words[1], WORD_BLUE(WORD_LANES_1), 
+                                   WORD_GREEN(WORD_LANES_2), WORD_RED(WORD_LANES_0));
+        words[2] = extractWordSwar(words[2], WORD_BLUE(WORD_LANES_2), 
+                                   WORD_GREEN(WORD_LANES_0), WORD_RED(WORD_LANES_1));
+
+        /* The bytes of each pixel ORed into its first */
+        for (word = 0; word < 3; word++)
+        {
+            folded[word] = words[word] | words[word] >> 8 | words[word] >> 16;
+        }
+
+        /* Pixels 2 and 5 straddle two words */
+        data = ( folded[0]                                    & 0xFF)
+             | ((folded[0] >> 24)                             & 0xFF) << 8
+             | ((words[0] >> 48 | words[0] >> 56 | words[1])  & 0xFF) << 16
+             | ((folded[1] >> 8)                              & 0xFF) << 24
+             | ((folded[1] >> 32)                             & 0xFF) << 32
+             | ((words[1] >> 56 | words[2] | words[2] >> 8)   & 0xFF) << 40
+             | ((folded[2] >> 16)                             & 0xFF) << 48
+             | ((folded[2] >> 40)                             & 0xFF) << 56;
+
+        memcpy(&pBytes[done], &data, sizeof(data));
+        done += 8;
+    }
+
+    return done;
+}
+
+
+/** @brief Hides one byte from pBytes in the colours of each of count 
+ *         consecutive 32 bit pixels, leaving their alpha bytes alone. The 
+ *         widest kernel the CPU supports handles the bulk of the data and 
+ *         the scalar kernel finishes off the remainder.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide. */
+void embedBytesBgra(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const tBulkEmbedKernel * pKernel = NULL;
+
+    for (pKernel = simdKernels.embedBgra; *pKernel != NULL; pKernel++)
+    {
+        done += (*pKernel)(&pPixels[done * BYTES_IN_PIXEL_ALPHA], &pBytes[done], 
+                           count - done);
+    }
+
+    embedBytesBgraScalar(&pPixels[done * BYTES_IN_PIXEL_ALPHA], &pBytes[done], 
+                         count - done);
+}
+
+
+/** @brief Hides one byte in the colours of each of count consecutive 32 bit
+ *         pixels, treating each pixel as one little endian word. The bits for
+ *         each colour are moved into place with a shift and a mask, and the 
+ *         whole pixel written back at once.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes to hide. */
+void embedBytesBgraScalar(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t index = 0;
+    uint32_t lane = 0;
+    uint32_t byte = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        byte = pBytes[index];
+
+        memcpy(&lane, pPixels, BYTES_IN_PIXEL_ALPHA);
+        lane = (lane & ~BGRA_LANE_MASK) 
+             | ( byte                                 & BLUE_BITMASK)
+             | ((byte << (8 - BLUE_BITS))               & (GREEN_BITMASK << 8))
+             | ((byte << (16 - BLUE_BITS - GREEN_BITS)) & (RED_BITMASK << 16));
+        memcpy(pPixels, &lane, BYTES_IN_PIXEL_ALPHA);
+
+        pPixels += BYTES_IN_PIXEL_ALPHA;
+    }
+}
+
+
+/** @brief Recovers the byte hidden in the colours of each of count 
+ *         consecutive 32 bit pixels. The widest kernel the CPU supports 
+ *         handles the bulk of the data and the scalar kernel finishes off the
+ *         remainder.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover. */
+void extractBytesBgra(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const tBulkExtractKernel * pKernel = NULL;
+
+    for (pKernel = simdKernels.extractBgra; *pKernel != NULL; pKernel++)
+    {
+        done += (*pKernel)(&pPixels[done * BYTES_IN_PIXEL_ALPHA], &pBytes[done], 
+                           count - done);
+    }
+
+    extractBytesBgraScalar(&pPixels[done * BYTES_IN_PIXEL_ALPHA], &pBytes[done], 
+                           count - done);
+}
+
+
+/** @brief Recovers the byte hidden in the colours of each of count 
+ *         consecutive 32 bit pixels, one pixel word at a time.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover. */
+void extractBytesBgraScalar(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t index = 0;
+    uint32_t lane = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        memcpy(&lane, pPixels, BYTES_IN_PIXEL_ALPHA);
+        pBytes[index] = ( lane                                 & BLUE_BITMASK)
+                      | ((lane >> (8 - BLUE_BITS))               & (GREEN_BITMASK << BLUE_BITS))
+                      | ((lane >> (16 - BLUE_BITS - GREEN_BITS)) & (RED_BITMASK << (BLUE_BITS + GREEN_BITS)));
+
+        pPixels += BYTES_IN_PIXEL_ALPHA;
+    }
+}
+
+
+/** @brief Spreads the bits of a byte over 8 bytes, one bit in the bottom of
+ *         each, least significant first, by halving the fields in place.
+ *  @param byte The byte to spread.
+ *  @return The spread bits. */
+static inline uint64_t spreadByte1(uint64_t byte)
+{
+    byte = (byte | byte << 28) & 0x0000000F0000000FULL;
+    byte = (byte | byte << 14) & 0x0003000300030003ULL;
+    return (byte | byte << 7)  & 0x0101010101010101ULL;
+}
+
+/** @brief Reverses spreadByte1, ignoring all but the bottom bit of each byte.
+ *  @param word The spread bits.
+ *  @return The byte. */
+static inline uint8_t gatherByte1(uint64_t word)
+{
+    word &= 0x0101010101010101ULL;
+    word = (word | word >> 7)  & 0x0003000300030003ULL;
+    word = (word | word >> 14) & 0x0000000F0000000FULL;
+    return word | word >> 28;
+}
+
+/** @brief Spreads a byte over 4 bytes, 2 bits in the bottom of each.
+ *  @param byte The byte to spread.
+ *  @return The spread bits. */
+static inline uint64_t spreadByte2(uint64_t byte)
+{
+    byte = (byte | byte << 12) & 0x000F000FULL;
+    return (byte | byte << 6)  & 0x03030303ULL;
+}
+
+/** @brief Reverses spreadByte2, ignoring all but the bottom 2 bits of each 
+ *         byte.
+ *  @param word The spread bits.
+ *  @return The byte. */
+static inline uint8_t gatherByte2(uint64_t word)
+{
+    word &= 0x03030303ULL;
+    word = (word | word >> 6) & 0x000F000FULL;
+    return word | word >> 12;
+}
+
+/** @brief Spreads a byte over 2 bytes, 4 bits in the bottom of each.
+ *  @param byte The byte to spread.
+ *  @return The spread bits. */
+static inline uint64_t spreadByte4(uint64_t byte)
+{
+    return (byte | byte << 4) & 0x0F0FULL;
+}
+
+/** @brief Reverses spreadByte4, ignoring the top 4 bits of each byte.
+ *  @param word The spread bits.
+ *  @return The byte. */
+static inline uint8_t gatherByte4(uint64_t word)
+{
+    word &= 0x0F0FULL;
+    return word | word >> 4;
+}
+
+/** @brief A byte in one byte needs no spreading.
+ *  @param byte The byte.
+ *  @return The byte. */
+static inline uint64_t spreadByte8(uint64_t byte)
+{
+    return byte;
+}
+
+/** @brief A byte in one byte needs no gathering.
+ *  @param word The byte.
+ *  @return The byte. */
+static inline uint8_t gatherByte8(uint64_t word)
+{
+    return word;
+}
+
+/** @brief Defines embedBytesN and extractBytesN, the kernels for hiding N bits
+ *         in each channel byte, so 8 / N channel bytes for each byte with its
+ *         least significant bits in the first. Everything but the count is 
+ *         fixed by N, so each byte takes one load, a few constant shifts and 
+ *         masks and one store with no branches. Relies on the host being 
+ *         little endian, as the header structures do. */
+#define LAYOUT_KERNELS(BITS)                                                          \
+void embedBytes##BITS(IN_OUT uint8_t * pChannels, IN const uint8_t * pBytes,           \
+                      uint64_t count)                                                 \
+{                                                                                     \
+    const uint64_t fieldMask = spreadByte##BITS(0xFF);                                \
+    uint64_t index = 0;                                                               \
+    uint64_t word = 0;                                                                \
+                                                                                      \
+    for (index = 0; index < count; index++)                                           \
+    {                                                                                 \
+        memcpy(&word, pChannels, 8 / BITS);                                           \
+        word = (word & ~fieldMask) | spreadByte##BITS(pBytes[index]);                 \
+        memcpy(pChannels, &word, 8 / BITS);                                           \
+                                                                                      \
+        pChannels += 8 / BITS;                                                        \
+    }                                                                                 \
+}                                                                                     \
+                                                                                      \
+void extractBytes##BITS(IN const uint8_t * pChannels, OUT uint8_t * pBytes,            \
+                        uint64_t count)                                               \
+{                                                                                     \
+    uint64_t index = 0;                                                               \
+    uint64_t word = 0;                                                                \
+                                                                                      \
+    for (index = 0; index < count; index++)                                           \
+    {                                                                                 \
+        memcpy(&word, pChannels, 8 / BITS);                                           \
+        pBytes[index] = gatherByte##BITS(word);                                       \
+                                                                                      \
+        pChannels += 8 / BITS;                                                        \
+    }                                                                                 \
+}
+
+LAYOUT_KERNELS(1)
+LAYOUT_KERNELS(2)
+LAYOUT_KERNELS(4)
+LAYOUT_KERNELS(8)
+
+#if defined(SIMD_KERNELS)
+
+/* The SIMD kernels work on blocks of 16 data bytes, which map onto 48 pixel 
+ * bytes or three 16 byte vectors. Row k of each table describes vector k of 
+ * the block. */
+
+/** Shuffle which copies each data byte into all three bytes of its pixel. */
+static const uint8_t embedSpreadTable[3][16] __attribute__((aligned(16))) = {
+    {  0,  0,  0,  1,  1,  1,  2,  2,  2,  3,  3,  3,  4,  4,  4,  5 },
+    {  5,  5,  6,  6,  6,  7,  7,  7,  8,  8,  8,  9,  9,  9, 10, 10 },
+    { 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15 }
+};
+
+/** Selects the data bits held in the blue bytes of a vector. */
+static const uint8_t blueMaskTable[3][16] __attribute__((aligned(16))) = {
+    { BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK },
+    { 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0 },
+    { 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0, BLUE_BITMASK, 0, 0 }
+};
+
+/** Selects the data bits held in the green bytes of a vector. */
+static const uint8_t greenMaskTable[3][16] __attribute__((aligned(16))) = {
+    { 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0 },
+    { GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK },
+    { 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0, 0, GREEN_BITMASK, 0 }
+};
+
+/** Selects the data bits held in the red bytes of a vector. */
+static const uint8_t redMaskTable[3][16] __attribute__((aligned(16))) = {
+    { 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0 },
+    { 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0 },
+    { RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK, 0, 0, RED_BITMASK }
+};
+
+/** @brief Hides the data bytes belonging to one vector of a block in pixels.
+ *  @param pixels The pixel bytes.
+ *  @param bytes The 16 data bytes of the block.
+ *  @param k Which vector of the block pixels is.
+ *  @return The pixel bytes with the data hidden in them. */
+SIMD_TARGET("ssse3")
+static inline __m128i embedVectorSsse3(__m128i pixels, __m128i bytes, int k)
+{
+    __m128i blue  = _mm_load_si128((const __m128i *)blueMaskTable[k]);
+    __m128i green = _mm_load_si128((const __m128i *)greenMaskTable[k]);
+    __m128i red   = _mm_load_si128((const __m128i *)redMaskTable[k]);
+    __m128i spread = _mm_shuffle_epi8(bytes, _mm_load_si128((const __m128i *)embedSpreadTable[k]));
+    __m128i bits = _mm_and_si128(spread, blue);
+
+    /* 16 bit shifts are fine here as the bits dragged across from the 
+     * neighbouring byte are always masked off */
+    bits = _mm_or_si128(bits, _mm_and_si128(_mm_srli_epi16(spread, BLUE_BITS), green));
+    bits = _mm_or_si128(bits, _mm_and_si128(_mm_srli_epi16(spread, BLUE_BITS + GREEN_BITS), red));
+
+    pixels = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(blue, green), red), pixels);
+
+    return _mm_or_si128(pixels, bits);
+}
+
+
+/* Shuffles which gather one colour of each pixel into the position of the data
+ * byte the pixel holds. */
+
+/** Gathers the blue bytes from a vector. */
+static const uint8_t gatherBlueTable[3][16] __attribute__((aligned(16))) = {
+    {    0,    3,    6,    9,   12,   15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,    2,    5,    8,   11,   14, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,    1,    4,    7,   10,   13 }
+};
+
+/** Gathers the green bytes from a vector. */
+static const uint8_t gatherGreenTable[3][16] __attribute__((aligned(16))) = {
+    {    1,    4,    7,   10,   13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80,    0,    3,    6,    9,   12,   15, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,    2,    5,    8,   11,   14 }
+};
+
+/** Gathers the red bytes from a vector. */
+static const uint8_t gatherRedTable[3][16] __attribute__((aligned(16))) = {
+    {    2,    5,    8,   11,   14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80,    1,    4,    7,   10,   13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,    0,    3,    6,    9,   12,   15 }
+};
+
+/** @brief Gathers one colour from the three vectors of a block.
+ *  @param pixels The three pixel vectors of the block.
+ *  @param table The gather table for the colour.
+ *  @return The colour byte of each of the 16 pixels in the block. */
+SIMD_TARGET("ssse3")
+static inline __m128i gatherColourSsse3(const __m128i pixels[3], const uint8_t table[3][16])
+{
+    __m128i colour = _mm_shuffle_epi8(pixels[0], _mm_load_si128((const __m128i *)table[0]));
+    
+    colour = _mm_or_si128(colour, _mm_shuffle_epi8(pixels[1], _mm_load_si128((const __m128i *)table[1])));
+    colour = _mm_or_si128(colour, _mm_shuffle_epi8(pixels[2], _mm_load_si128((const __m128i *)table[2])));
+
+    return colour;
+}
+
+
+/** @brief Recovers 16 data bytes at a time from 48 pixel bytes with SSSE3
+ *         shuffles. Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+SIMD_TARGET("ssse3")
+uint64_t extractBytesSsse3(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const __m128i * pVector = NULL;
+    __m128i pixels[3];
+    __m128i bytes;
+
+    while (count - done >= 16)
+    {
+        pVector = (const __m128i *)&pPixels[done * BYTES_IN_PIXEL];
+        pixels[0] = _mm_loadu_si128(&pVector[0]);
+        pixels[1] = _mm_loadu_si128(&pVector[1]);
+        pixels[2] = _mm_loadu_si128(&pVector[2]);
+
+        bytes = _mm_and_si128(gatherColourSsse3(pixels, gatherBlueTable), 
+                              _mm_set1_epi8(BLUE_BITMASK));
+        bytes = _mm_or_si128(bytes, _mm_slli_epi16(_mm_and_si128(gatherColourSsse3(pixels, gatherGreenTable),
+                                                                 _mm_set1_epi8(GREEN_BITMASK)), 
+                                                   BLUE_BITS));
+        bytes = _mm_or_si128(bytes, _mm_slli_epi16(_mm_and_si128(gatherColourSsse3(pixels, gatherRedTable),
+                                                                 _mm_set1_epi8(RED_BITMASK)), 
+                                                   BLUE_BITS + GREEN_BITS));
+
+        _mm_storeu_si128((__m128i *)&pBytes[done], bytes);
+        done += 16;
+    }
+
+    return done;
+}
+
+
+/** @brief Hides 16 data bytes at a time in 48 pixel bytes with SSSE3 
+ *         shuffles. Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+SIMD_TARGET("ssse3")
+uint64_t embedBytesSsse3(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    __m128i bytes;
+    __m128i * pVector = NULL;
+    int k = 0;
+
+    while (count - done >= 16)
+    {
+        bytes = _mm_loadu_si128((const __m128i *)&pBytes[done]);
+        pVector = (__m128i *)&pPixels[done * BYTES_IN_PIXEL];
+
+        for (k = 0; k < 3; k++)
+        {
+            _mm_storeu_si128(&pVector[k], 
+                             embedVectorSsse3(_mm_loadu_si128(&pVector[k]), bytes, k));
+        }
+
+        done += 16;
+    }
+
+    return done;
+}
+
+#endif
+
+
+#if defined(SIMD_KERNELS)
+
+/** @brief Works out the CRC32C of some bytes with the SSE4.2 crc32 
+ *         instruction, 8 bytes at a time and then a byte at a time.
+ *  @param crc CRC32C of the bytes before these, zero for none.
+ *  @param pBytes The bytes.
+ *  @param count Number of bytes.
+ *  @return CRC32C of the bytes before and these. */
+SIMD_TARGET("sse4.2")
+uint32_t crc32cSse42(uint32_t crc, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t wide = ~crc;
+    uint64_t word = 0;
+
+    while (count >= sizeof(uint64_t))
+    {
+        memcpy(&word, pBytes, sizeof(uint64_t));
+        wide = _mm_crc32_u64(wide, word);
+
+        pBytes += sizeof(uint64_t);
+        count -= sizeof(uint64_t);
+    }
+
+    crc = (uint32_t)wide;
+
+    while (count > 0)
+    {
+        crc = _mm_crc32_u8(crc, *pBytes);
+
+        pBytes++;
+        count--;
+    }
+
+    return ~crc;
+}
+
+#endif
+
+
+#if defined(SIMD_KERNELS)
+
+/* SSE2 is part of x86-64, so these kernels need no target of their own */
+
+/** @brief Spreads the byte in the bottom of each 32 bit lane to the bits of
+ *         the lane which hold data, as embedBytesBgraScalar does.
+ *  @param bytes One byte in the bottom of each lane, the rest zero.
+ *  @return The spread bits. */
+static inline __m128i spreadBgraSse2(__m128i bytes)
+{
+    __m128i lanes = _mm_and_si128(bytes, _mm_set1_epi32(BLUE_BITMASK));
+
+    lanes = _mm_or_si128(lanes, _mm_and_si128(_mm_slli_epi32(bytes, 8 - BLUE_BITS),
+                                              _mm_set1_epi32(GREEN_BITMASK << 8)));
+    lanes = _mm_or_si128(lanes, _mm_and_si128(_mm_slli_epi32(bytes, 16 - BLUE_BITS - GREEN_BITS),
+                                              _mm_set1_epi32(RED_BITMASK << 16)));
+
+    return lanes;
+}
+
+
+/** @brief Gathers the byte hidden in each 32 bit lane into its bottom byte,
+ *         as extractBytesBgraScalar does.
+ *  @param pixels Four 32 bit pixels.
+ *  @return The hidden bytes, one in the bottom of each lane. */
+static inline __m128i gatherBgraSse2(__m128i pixels)
+{
+    __m128i bytes = _mm_and_si128(pixels, _mm_set1_epi32(BLUE_BITMASK));
+
+    bytes = _mm_or_si128(bytes, _mm_and_si128(_mm_srli_epi32(pixels, 8 - BLUE_BITS),
+                                              _mm_set1_epi32(GREEN_BITMASK << BLUE_BITS)));
+    bytes = _mm_or_si128(bytes, _mm_and_si128(_mm_srli_epi32(pixels, 16 - BLUE_BITS - GREEN_BITS),
+                                              _mm_set1_epi32(RED_BITMASK << (BLUE_BITS + GREEN_BITS))));
+
+    return bytes;
+}
+
+
+/** @brief Hides 16 data bytes at a time in 16 32 bit pixels, four pixel lanes
+ *         to a vector. With no padding or packing to undo, the data bytes are
+ *         widened to lanes with unpacks, so no shuffles are needed.
+ *         Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+uint64_t embedBytesBgraSse2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi32(BGRA_LANE_MASK);
+    __m128i bytes, words, lanes[4];
+    __m128i * pVector = NULL;
+    int k = 0;
+
+    while (count - done >= 16)
+    {
+        bytes = _mm_loadu_si128((const __m128i *)&pBytes[done]);
+        pVector = (__m128i *)&pPixels[done * BYTES_IN_PIXEL_ALPHA];
+
+        words    = _mm_unpacklo_epi8(bytes, zero);
+        lanes[0] = _mm_unpacklo_epi16(words, zero);
+        lanes[1] = _mm_unpackhi_epi16(words, zero);
+        words    = _mm_unpackhi_epi8(bytes, zero);
+        lanes[2] = _mm_unpacklo_epi16(words, zero);
+        lanes[3] = _mm_unpackhi_epi16(words, zero);
+
+        for (k = 0; k < 4; k++)
+        {
+            _mm_storeu_si128(&pVector[k], 
+                             _mm_or_si128(_mm_andnot_si128(mask, _mm_loadu_si128(&pVector[k])),
+                                          spreadBgraSse2(lanes[k])));
+        }
+
+        done += 16;
+    }
+
+    return done;
+}
+
+
+/** @brief Recovers 16 data bytes at a time from 16 32 bit pixels, narrowing
+ *         the four lane vectors back to bytes with saturating packs, which 
+ *         can't saturate as each lane holds a single byte. Any bytes left 
+ *         over are not processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+uint64_t extractBytesBgraSse2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const __m128i * pVector = NULL;
+    __m128i lanes[4];
+    int k = 0;
+
+    while (count - done >= 16)
+    {
+        pVector = (const __m128i *)&pPixels[done * BYTES_IN_PIXEL_ALPHA];
+
+        for (k = 0; k < 4; k++)
+        {
+            lanes[k] = gatherBgraSse2(_mm_loadu_si128(&pVector[k]));
+        }
+
+        _mm_storeu_si128((__m128i *)&pBytes[done], 
+                         _mm_packus_epi16(_mm_packs_epi32(lanes[0], lanes[1]),
+                                          _mm_packs_epi32(lanes[2], lanes[3])));
+        done += 16;
+    }
+
+    return done;
+}
+
+
+#define ROTATE_LEFT_SSE2(x, n)  _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+
+#define CHACHA_QUARTER_SSE2(a, b, c, d)                                              \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTATE_LEFT_SSE2(d, 16);  \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTATE_LEFT_SSE2(b, 12);  \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTATE_LEFT_SSE2(d, 8);   \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTATE_LEFT_SSE2(b, 7);
+
+/** @brief XORs ChaCha20 keystream into data 4 blocks at a time with SSE2. 
+ *         Each 32 bit lane works on its own block, so word n of all 4 blocks
+ *         sits in one register, and the words are transposed back into blocks
+ *         4 at a time on the way out. Any blocks left over are not processed.
+ *  @param state The cipher's input block.
+ *  @param block Number of the first block of keystream.
+ *  @param pBytes The data.
+ *  @param blocks Number of blocks available.
+ *  @return Number of blocks processed. */
+uint64_t chachaXorSse2(IN const uint32_t state[16], uint64_t block, IN_OUT uint8_t * pBytes,
+                       uint64_t blocks)
+{
+    __m128i input[16];
+    __m128i x[16];
+    __m128i low[2];
+    __m128i high[2];
+    __m128i words[4];
+    __m128i * pOut = NULL;
+    uint64_t done = 0;
+    int index = 0;
+    int word = 0;
+
+    for (index = 0; index < 16; index++)
+    {
+        input[index] = _mm_set1_epi32(state[index]);
+    }
+
+    for (done = 0; done + 4 <= blocks; done += 4, block += 4)
+    {
+        input[12] = _mm_set_epi32((uint32_t)(block + 3), (uint32_t)(block + 2), 
+                                  (uint32_t)(block + 1), (uint32_t)block);
+        input[13] = _mm_set_epi32((uint32_t)((block + 3) >> 32), (uint32_t)((block + 2) >> 32),
+                                  (uint32_t)((block + 1) >> 32), (uint32_t)(block >> 32));
+        memcpy(x, input, sizeof(x));
+
+        for (index = 0; index < CHACHA_DOUBLE_ROUNDS; index++)
+        {
+            CHACHA_QUARTER_SSE2(x[0], x[4], x[8],  x[12]);
+            CHACHA_QUARTER_SSE2(x[1], x[5], x[9],  x[13]);
+            CHACHA_QUARTER_SSE2(x[2], x[6], x[10], x[14]);
+            CHACHA_QUARTER_SSE2(x[3], x[7], x[11], x[15]);
+            CHACHA_QUARTER_SSE2(x[0], x[5], x[10], x[15]);
+            CHACHA_QUARTER_SSE2(x[1], x[6], x[11], x[12]);
+            CHACHA_QUARTER_SSE2(x[2], x[7], x[8],  x[13]);
+            CHACHA_QUARTER_SSE2(x[3], x[4], x[9],  x[14]);
+        }
+
+        for (word = 0; word < 16; word += 4)
+        {
+            for (index = 0; index < 4; index++)
+            {
+                words[index] = _mm_add_epi32(x[word + index], input[word + index]);
+            }
+
+            /* Words word to word + 3 of each block in turn */
+            low[0]  = _mm_unpacklo_epi32(words[0], words[1]);
+            low[1]  = _mm_unpacklo_epi32(words[2], words[3]);
+            high[0] = _mm_unpackhi_epi32(words[0], words[1]);
+            high[1] = _mm_unpackhi_epi32(words[2], words[3]);
+
+            words[0] = _mm_unpacklo_epi64(low[0], low[1]);
+            words[1] = _mm_unpackhi_epi64(low[0], low[1]);
+            words[2] = _mm_unpacklo_epi64(high[0], high[1]);
+            words[3] = _mm_unpackhi_epi64(high[0], high[1]);
+
+            for (index = 0; index < 4; index++)
+            {
+                pOut = (__m128i *)&pBytes[index * CHACHA_BLOCK_SIZE + word * 4];
+                _mm_storeu_si128(pOut, _mm_xor_si128(_mm_loadu_si128(pOut), words[index]));
+            }
+        }
+
+        pBytes += 4 * CHACHA_BLOCK_SIZE;
+    }
+
+    return done;
+}
+
+#endif
+
+
+#if defined(SIMD_KERNELS)
+
+/** @brief Hides 32 data bytes at a time in 96 pixel bytes with AVX2 
+ *         shuffles. As shuffles can't cross 128 bit lanes the low lane works 
+ *         on the first 48 pixel bytes and the high lane on the second 48, 
+ *         which lets both lanes share the SSSE3 tables. Any bytes left over 
+ *         are not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+SIMD_TARGET("avx2")
+uint64_t embedBytesAvx2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    __m256i bytes, pixels, blue, green, red, spread, bits;
+    __m128i * pLow = NULL;
+    __m128i * pHigh = NULL;
+    int k = 0;
+
+    while (count - done >= 32)
+    {
+        bytes = _mm256_loadu_si256((const __m256i *)&pBytes[done]);
+        pLow  = (__m128i *)&pPixels[done * BYTES_IN_PIXEL];
+        pHigh = &pLow[3];
+
+        for (k = 0; k < 3; k++)
+        {
+            blue   = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)blueMaskTable[k]));
+            green  = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)greenMaskTable[k]));
+            red    = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)redMaskTable[k]));
+            spread = _mm256_shuffle_epi8(bytes, _mm256_broadcastsi128_si256(
+                                         _mm_load_si128((const __m128i *)embedSpreadTable[k])));
+
+            bits = _mm256_and_si256(spread, blue);
+            bits = _mm256_or_si256(bits, _mm256_and_si256(_mm256_srli_epi16(spread, BLUE_BITS), green));
+            bits = _mm256_or_si256(bits, _mm256_and_si256(_mm256_srli_epi16(spread, BLUE_BITS + GREEN_BITS), red));
+
+            pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(&pLow[k])),
+                                             _mm_loadu_si128(&pHigh[k]), 1);
+            pixels = _mm256_andnot_si256(_mm256_or_si256(_mm256_or_si256(blue, green), red), pixels);
+            pixels = _mm256_or_si256(pixels, bits);
+
+            _mm_storeu_si128(&pLow[k],  _mm256_castsi256_si128(pixels));
+            _mm_storeu_si128(&pHigh[k], _mm256_extracti128_si256(pixels, 1));
+        }
+
+        done += 32;
+    }
+
+    return done;
+}
+
+
+/** @brief Gathers one colour from the three vectors of a block pair.
+ *  @param pixels The three pixel vectors of the block pair.
+ *  @param table The gather table for the colour.
+ *  @return The colour byte of each of the 32 pixels in the block pair. */
+SIMD_TARGET("avx2")
+static inline __m256i gatherColourAvx2(const __m256i pixels[3], const uint8_t table[3][16])
+{
+    __m256i colour = _mm256_shuffle_epi8(pixels[0], _mm256_broadcastsi128_si256(
+                                         _mm_load_si128((const __m128i *)table[0])));
+
+    colour = _mm256_or_si256(colour, _mm256_shuffle_epi8(pixels[1], _mm256_broadcastsi128_si256(
+                                     _mm_load_si128((const __m128i *)table[1]))));
+    colour = _mm256_or_si256(colour, _mm256_shuffle_epi8(pixels[2], _mm256_broadcastsi128_si256(
+                                     _mm_load_si128((const __m128i *)table[2]))));
+
+    return colour;
+}
+
+
+/** @brief Recovers 32 data bytes at a time from 96 pixel bytes with AVX2
+ *         shuffles. Lanes are split the same way as embedBytesAvx2. Any bytes
+ *         left over are not processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+SIMD_TARGET("avx2")
+uint64_t extractBytesAvx2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const __m128i * pLow = NULL;
+    const __m128i * pHigh = NULL;
+    __m256i pixels[3];
+    __m256i bytes;
+    int k = 0;
+
+    while (count - done >= 32)
+    {
+        pLow  = (const __m128i *)&pPixels[done * BYTES_IN_PIXEL];
+        pHigh = &pLow[3];
+
+        for (k = 0; k < 3; k++)
+        {
+            pixels[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(&pLow[k])),
+                                                _mm_loadu_si128(&pHigh[k]), 1);
+        }
+
+        bytes = _mm256_and_si256(gatherColourAvx2(pixels, gatherBlueTable), 
+                                 _mm256_set1_epi8(BLUE_BITMASK));
+        bytes = _mm256_or_si256(bytes, _mm256_slli_epi16(_mm256_and_si256(gatherColourAvx2(pixels, gatherGreenTable),
+                                                                          _mm256_set1_epi8(GREEN_BITMASK)), 
+                                                         BLUE_BITS));
+        bytes = _mm256_or_si256(bytes, _mm256_slli_epi16(_mm256_and_si256(gatherColourAvx2(pixels, gatherRedTable),
+                                                                          _mm256_set1_epi8(RED_BITMASK)), 
+                                                         BLUE_BITS + GREEN_BITS));
+
+        _mm256_storeu_si256((__m256i *)&pBytes[done], bytes);
+        done += 32;
+    }
+
+    return done;
+}
+
+/** @brief Spreads the byte in the bottom of each 32 bit lane to the bits of
+ *         the lane which hold data, as embedBytesBgraScalar does.
+ *  @param bytes One byte in the bottom of each lane, the rest zero.
+ *  @return The spread bits. */
+SIMD_TARGET("avx2")
+static inline __m256i spreadBgraAvx2(__m256i bytes)
+{
+    __m256i lanes = _mm256_and_si256(bytes, _mm256_set1_epi32(BLUE_BITMASK));
+
+    lanes = _mm256_or_si256(lanes, _mm256_and_si256(_mm256_slli_epi32(bytes, 8 - BLUE_BITS),
+                                                    _mm256_set1_epi32(GREEN_BITMASK << 8)));
+    lanes = _mm256_or_si256(lanes, _mm256_and_si256(_mm256_slli_epi32(bytes, 16 - BLUE_BITS - GREEN_BITS),
+                                                    _mm256_set1_epi32(RED_BITMASK << 16)));
+
+    return lanes;
+}
+
+
+/** @brief Gathers the byte hidden in each 32 bit lane into its bottom byte,
+ *         as extractBytesBgraScalar does.
+ *  @param pixels Eight 32 bit pixels.
+ *  @return The hidden bytes, one in the bottom of each lane. */
+SIMD_TARGET("avx2")
+static inline __m256i gatherBgraAvx2(__m256i pixels)
+{
+    __m256i bytes = _mm256_and_si256(pixels, _mm256_set1_epi32(BLUE_BITMASK));
+
+    bytes = _mm256_or_si256(bytes, _mm256_and_si256(_mm256_srli_epi32(pixels, 8 - BLUE_BITS),
+                                                    _mm256_set1_epi32(GREEN_BITMASK << BLUE_BITS)));
+    bytes = _mm256_or_si256(bytes, _mm256_and_si256(_mm256_srli_epi32(pixels, 16 - BLUE_BITS - GREEN_BITS),
+                                                    _mm256_set1_epi32(RED_BITMASK << (BLUE_BITS + GREEN_BITS))));
+
+    return bytes;
+}
+
+
+/** @brief Hides 32 data bytes at a time in 32 32 bit pixels, eight pixel 
+ *         lanes to a vector, widening each 8 data bytes straight to lanes.
+ *         Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+SIMD_TARGET("avx2")
+uint64_t embedBytesBgraAvx2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const __m256i mask = _mm256_set1_epi32(BGRA_LANE_MASK);
+    __m256i lanes, pixels;
+    __m256i * pVector = NULL;
+    int k = 0;
+
+    while (count - done >= 32)
+    {
+        pVector = (__m256i *)&pPixels[done * BYTES_IN_PIXEL_ALPHA];
+
+        for (k = 0; k < 4; k++)
+        {
+            lanes  = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&pBytes[done + k * 8]));
+            pixels = _mm256_andnot_si256(mask, _mm256_loadu_si256(&pVector[k]));
+
+            _mm256_storeu_si256(&pVector[k], _mm256_or_si256(pixels, spreadBgraAvx2(lanes)));
+        }
+
+        done += 32;
+    }
+
+    return done;
+}
+
+
+/** @brief Recovers 32 data bytes at a time from 32 32 bit pixels. The packs 
+ *         work within 128 bit halves, so a final permute puts the four byte 
+ *         groups back in pixel order. Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+SIMD_TARGET("avx2")
+uint64_t extractBytesBgraAvx2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i * pVector = NULL;
+    __m256i lanes[4];
+    __m256i bytes;
+    int k = 0;
+
+    while (count - done >= 32)
+    {
+        pVector = (const __m256i *)&pPixels[done * BYTES_IN_PIXEL_ALPHA];
+
+        for (k = 0; k < 4; k++)
+        {
+            lanes[k] = gatherBgraAvx2(_mm256_loadu_si256(&pVector[k]));
+        }
+
+        bytes = _mm256_packus_epi16(_mm256_packs_epi32(lanes[0], lanes[1]),
+                                    _mm256_packs_epi32(lanes[2], lanes[3]));
+
+        _mm256_storeu_si256((__m256i *)&pBytes[done], _mm256_permutevar8x32_epi32(bytes, order));
+        done += 32;
+    }
+
+    return done;
+}
+
+
+#define ROTATE_LEFT_AVX2(x, n)  _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+/* Rotations by whole bytes are done with a shuffle */
+#define CHACHA_QUARTER_AVX2(a, b, c, d)                                                       \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rotate16);   \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTATE_LEFT_AVX2(b, 12);     \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rotate8);    \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTATE_LEFT_AVX2(b, 7);
+
+/** @brief XORs ChaCha20 keystream into data 8 blocks at a time with AVX2, as
+ *         chachaXorSse2 does 4. The transposes work within 128 bit lanes, so
+ *         each result holds 4 words of block n in its low lane and of block 
+ *         n + 4 in its high lane. Any blocks left over are not processed.
+ *  @param state The cipher's input block.
+ *  @param block Number of the first block of keystream.
+ *  @param pBytes The data.
+ *  @param blocks Number of blocks available.
+ *  @return Number of blocks processed. */
+SIMD_TARGET("avx2")
+uint64_t chachaXorAvx2(IN const uint32_t state[16], uint64_t block, IN_OUT uint8_t * pBytes,
+                       uint64_t blocks)
+{
+    const __m256i rotate16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                              2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rotate8  = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                              3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    __m256i input[16];
+    __m256i x[16];
+    __m256i low[2];
+    __m256i high[2];
+    __m256i words[4];
+    __m128i * pOut = NULL;
+    uint64_t done = 0;
+    int index = 0;
+    int word = 0;
+
+    for (index = 0; index < 16; index++)
+    {
+        input[index] = _mm256_set1_epi32(state[index]);
+    }
+
+    for (done = 0; done + 8 <= blocks; done += 8, block += 8)
+    {
+        for (index = 0; index < 8; index++)
+        {
+            ((uint32_t *)&input[12])[index] = (uint32_t)(block + index);
+            ((uint32_t *)&input[13])[index] = (uint32_t)((block + index) >> 32);
+        }
+
+        memcpy(x, input, sizeof(x));
+
+        for (index = 0; index < CHACHA_DOUBLE_ROUNDS; index++)
+        {
+            CHACHA_QUARTER_AVX2(x[0], x[4], x[8],  x[12]);
+            CHACHA_QUARTER_AVX2(x[1], x[5], x[9],  x[13]);
+            CHACHA_QUARTER_AVX2(x[2], x[6], x[10], x[14]);
+            CHACHA_QUARTER_AVX2(x[3], x[7], x[11], x[15]);
+            CHACHA_QUARTER_AVX2(x[0], x[5], x[10], x[15]);
+            CHACHA_QUARTER_AVX2(x[1], x[6], x[11], x[12]);
+            CHACHA_QUARTER_AVX2(x[2], x[7], x[8],  x[13]);
+            CHACHA_QUARTER_AVX2(x[3], x[4], x[9],  x[14]);
+        }
+
+        for (word = 0; word < 16; word += 4)
+        {
+            for (index = 0; index < 4; index++)
+            {
+                words[index] = _mm256_add_epi32(x[word + index], input[word + index]);
+            }
+
+            low[0]  = _mm256_unpacklo_epi32(words[0], words[1]);
+            low[1]  = _mm256_unpacklo_epi32(words[2], words[3]);
+            high[0] = _mm256_unpackhi_epi32(words[0], words[1]);
+            high[1] = _mm256_unpackhi_epi32(words[2], words[3]);
+
+            words[0] = _mm256_unpacklo_epi64(low[0], low[1]);
+            words[1] = _mm256_unpackhi_epi64(low[0], low[1]);
+            words[2] = _mm256_unpacklo_epi64(high[0], high[1]);
+            words[3] = _mm256_unpackhi_epi64(high[0], high[1]);
+
+            for (index = 0; index < 4; index++)
+            {
+                pOut = (__m128i *)&pBytes[index * CHACHA_BLOCK_SIZE + word * 4];
+                _mm_storeu_si128(pOut, _mm_xor_si128(_mm_loadu_si128(pOut), 
+                                                     _mm256_castsi256_si128(words[index])));
+
+                pOut = (__m128i *)&pBytes[(index + 4) * CHACHA_BLOCK_SIZE + word * 4];
+                _mm_storeu_si128(pOut, _mm_xor_si128(_mm_loadu_si128(pOut), 
+                                                     _mm256_extracti128_si256(words[index], 1)));
+            }
+        }
+
+        pBytes += 8 * CHACHA_BLOCK_SIZE;
+    }
+
+    return done;
+}
+
+/** @brief Hides 8 data bytes at a time in 24 pixel bytes with BMI2 pdep, 
+ *         which drops the bits of the data, in order, into the data bits of
+ *         each of the three pixel words of a block. Any bytes left over are
+ *         not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+SIMD_TARGET("bmi2")
+uint64_t embedBytesBmi2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    uint64_t data = 0;
+    uint64_t words[3];
+    int word = 0;
+
+    while (count - done >= 8)
+    {
+        memcpy(&data, &pBytes[done], sizeof(data));
+        memcpy(words, &pPixels[done * BYTES_IN_PIXEL], sizeof(words));
+
+        for (word = 0; word < 3; word++)
+        {
+            words[word] = (words[word] & ~dataWordBits[word]) | 
+                          _pdep_u64(data >> dataWordShift[word], dataWordBits[word]);
+        }
+
+        memcpy(&pPixels[done * BYTES_IN_PIXEL], words, sizeof(words));
+        done += 8;
+    }
+
+    return done;
+}
+
+
+/** @brief Recovers 8 data bytes at a time from 24 pixel bytes with BMI2 
+ *         pext, the reverse of embedBytesBmi2. Any bytes left over are not
+ *         processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+SIMD_TARGET("bmi2")
+uint64_t extractBytesBmi2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    uint64_t data = 0;
+    uint64_t words[3];
+    int word = 0;
+
+    while (count - done >= 8)
+    {
+        memcpy(words, &pPixels[done * BYTES_IN_PIXEL], sizeof(words));
+        data = 0;
+
+        for (word = 0; word < 3; word++)
+        {
+            data |= _pext_u64(words[word], dataWordBits[word]) << dataWordShift[word];
+        }
+
+        memcpy(&pBytes[done], &data, sizeof(data));
+        done += 8;
+    }
+
+    return done;
+}
+
+/* The AVX-512 kernels work on blocks of 64 data bytes, which map onto 192 
+ * pixel bytes or three 64 byte vectors. VBMI byte permutes can reach across
+ * a whole vector, or two, so unlike the AVX2 kernels no lanes are split. */
+
+/** Permute which copies each data byte into all three bytes of its pixel, 
+ *  one row for each vector of a block. */
+static const uint8_t embedSpreadTable512[3][64] __attribute__((aligned(64))) = {
+    {
+          0,   0,   0,   1,   1,   1,   2,   2,   2,   3,   3,   3,   4,   4,   4,   5,
+          5,   5,   6,   6,   6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,
+         10,  11,  11,  11,  12,  12,  12,  13,  13,  13,  14,  14,  14,  15,  15,  15,
+         16,  16,  16,  17,  17,  17,  18,  18,  18,  19,  19,  19,  20,  20,  20,  21
+    },
+    {
+         21,  21,  22,  22,  22,  23,  23,  23,  24,  24,  24,  25,  25,  25,  26,  26,
+         26,  27,  27,  27,  28,  28,  28,  29,  29,  29,  30,  30,  30,  31,  31,  31,
+         32,  32,  32,  33,  33,  33,  34,  34,  34,  35,  35,  35,  36,  36,  36,  37,
+         37,  37,  38,  38,  38,  39,  39,  39,  40,  40,  40,  41,  41,  41,  42,  42
+    },
+    {
+         42,  43,  43,  43,  44,  44,  44,  45,  45,  45,  46,  46,  46,  47,  47,  47,
+         48,  48,  48,  49,  49,  49,  50,  50,  50,  51,  51,  51,  52,  52,  52,  53,
+         53,  53,  54,  54,  54,  55,  55,  55,  56,  56,  56,  57,  57,  57,  58,  58,
+         58,  59,  59,  59,  60,  60,  60,  61,  61,  61,  62,  62,  62,  63,  63,  63
+    }
+};
+
+/** Permute which gathers the blue byte of each pixel of a block from the 
+ *  first two vectors; the last vector is reached with the same indices less
+ *  128, and green and red with one and two more. */
+static const uint8_t gatherTable512[64] __attribute__((aligned(64))) = {
+      0,   3,   6,   9,  12,  15,  18,  21,  24,  27,  30,  33,  36,  39,  42,  45,
+     48,  51,  54,  57,  60,  63,  66,  69,  72,  75,  78,  81,  84,  87,  90,  93,
+     96,  99, 102, 105, 108, 111, 114, 117, 120, 123, 126,   1,   4,   7,  10,  13,
+     16,  19,  22,  25,  28,  31,  34,  37,  40,  43,  46,  49,  52,  55,  58,  61
+};
+
+/** Bits of a 64 byte vector whose byte index is 0, 1 or 2 more than a 
+ *  multiple of three. Vector k of a block starts at pixel byte 64k, which is
+ *  k more than a multiple of three, so its byte j is colour (j + k) % 3. */
+static const __mmask64 thirdsMask[3] = {
+    0x9249249249249249ULL, 0x2492492492492492ULL, 0x4924924924924924ULL
+};
+
+
+/** @brief Hides 64 data bytes at a time in 192 pixel bytes with AVX-512 VBMI
+ *         permutes. Byte masks pick the bits for each colour, so one shift 
+ *         and blend per colour does what the SSSE3 tables do. Any bytes left
+ *         over are not processed.
+ *  @param pPixels Pointer to the first pixel to hide data in.
+ *  @param pBytes Pointer to the data to hide.
+ *  @param count Number of bytes available to hide.
+ *  @return Number of bytes hidden. */
+SIMD_TARGET("avx512f,avx512bw,avx512vbmi")
+uint64_t embedBytesAvx512(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    __m512i bytes, spread, bits, mask, pixels;
+    __mmask64 green = 0;
+    __mmask64 red = 0;
+    uint8_t * pVector = NULL;
+    int k = 0;
+
+    while (count - done >= 64)
+    {
+        bytes = _mm512_loadu_si512(&pBytes[done]);
+        pVector = &pPixels[done * BYTES_IN_PIXEL];
+
+        for (k = 0; k < 3; k++)
+        {
+            green = thirdsMask[(GREEN + 3 - k) % 3];
+            red   = thirdsMask[(RED + 3 - k) % 3];
+
+            /* 16 bit shifts are fine here as the bits dragged across from
+             * the neighbouring byte are always masked off */
+            spread = _mm512_permutexvar_epi8(_mm512_load_si512(embedSpreadTable512[k]), bytes);
+            bits = _mm512_mask_blend_epi8(green, spread, _mm512_srli_epi16(spread, BLUE_BITS));
+            bits = _mm512_mask_blend_epi8(red, bits, 
+                                          _mm512_srli_epi16(spread, BLUE_BITS + GREEN_BITS));
+
+            mask = _mm512_mask_blend_epi8(green, _mm512_set1_epi8(BLUE_BITMASK), 
+                                          _mm512_set1_epi8(GREEN_BITMASK));
+            mask = _mm512_mask_blend_epi8(red, mask, _mm512_set1_epi8(RED_BITMASK));
+
+            /* The data bits where mask is set and the pixel bits elsewhere */
+            pixels = _mm512_loadu_si512(&pVector[k * 64]);
+            pixels = _mm512_ternarylogic_epi32(mask, bits, pixels, 0xCA);
+            _mm512_storeu_si512(&pVector[k * 64], pixels);
+        }
+
+        done += 64;
+    }
+
+    return done;
+}
+
+
+/** @brief Gathers one colour from the three vectors of a block.
+ *  @param pixels The three pixel vectors of the block.
+ *  @param colour BLUE, GREEN or RED.
+ *  @return The colour byte of each of the 64 pixels in the block. */
+SIMD_TARGET("avx512f,avx512bw,avx512vbmi")
+static inline __m512i gatherColourAvx512(const __m512i pixels[3], int colour)
+{
+    __m512i index = _mm512_add_epi8(_mm512_load_si512(gatherTable512), 
+                                    _mm512_set1_epi8(colour));
+    /* Pixels from the first one past pixel byte 128 on are in the last vector */
+    __mmask64 last = ~0ULL << ((2 * 64 - colour + 2) / 3);
+    __m512i bytes = _mm512_permutex2var_epi8(pixels[0], index, pixels[1]);
+
+    return _mm512_mask_permutexvar_epi8(bytes, last, index, pixels[2]);
+}
+
+
+/** @brief Recovers 64 data bytes at a time from 192 pixel bytes with AVX-512
+ *         VBMI permutes. Any bytes left over are not processed.
+ *  @param pPixels Pointer to the first pixel holding hidden data.
+ *  @param pBytes Pointer to the memory to store the recovered data in.
+ *  @param count Number of bytes to recover.
+ *  @return Number of bytes recovered. */
+SIMD_TARGET("avx512f,avx512bw,avx512vbmi")
+uint64_t extractBytesAvx512(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count)
+{
+    uint64_t done = 0;
+    const uint8_t * pVector = NULL;
+    __m512i pixels[3];
+    __m512i bytes;
+
+    while (count - done >= 64)
+    {
+        pVector = &pPixels[done * BYTES_IN_PIXEL];
+        pixels[0] = _mm512_loadu_si512(&pVector[0]);
+        pixels[1] = _mm512_loadu_si512(&pVector[64]);
+        pixels[2] = _mm512_loadu_si512(&pVector[128]);
+
+        bytes = _mm512_and_si512(gatherColourAvx512(pixels, BLUE), 
+                                 _mm512_set1_epi8(BLUE_BITMASK));
+        bytes = _mm512_or_si512(bytes, _mm512_slli_epi16(_mm512_and_si512(gatherColourAvx512(pixels, GREEN),
+                                                                          _mm512_set1_epi8(GREEN_BITMASK)), 
+                                                         BLUE_BITS));
+        bytes = _mm512_or_si512(bytes, _mm512_slli_epi16(_mm512_and_si512(gatherColourAvx512(pixels, RED),
+                                                                          _mm512_set1_epi8(RED_BITMASK)), 
+                                                         BLUE_BITS + GREEN_BITS));
+
+        _mm512_storeu_si512(&pBytes[done], bytes);
+        done += 64;
+    }
+
+    return done;
+}
+
+#endif
 
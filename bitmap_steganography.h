@@ -1,8 +1,10 @@
 /**
  * @file bitmap_steganography.h
- * @brief Contains typical headery file stuff for bitmap_steganography.c
+ * @brief The interface of libbitmapsteg: hiding data in a bitmap held in
+ *        memory, recovering it, and probing a bitmap for what it holds.
+ *        Everything else is in bitmap_steganography_private.h.
  *
- * Copyright 
+ * Copyright
  *  @author Alan Barr
  *  @date April 2012
  * @section License
@@ -23,53 +25,10 @@
 #ifndef _BITMAP_ENCODER_H_
 #define _BITMAP_ENCODER_H_
 
-#include <stdio.h>
 #include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-
-/** Index to argv for bitmap file. */
-#define BITMAP_FILE                 1
-/** Index to argv for data file to encode into bitmap. */
-#define ENCODE_FILE                 2
-
-#define DEBUG_VALUES                __FILE__, __LINE__
-#define DEBUG_STRING                "%s:%d"
-
-#define PRINT(string)               fprintf(stdout, DEBUG_STRING " " string "\n", DEBUG_VALUES)
-#define ERROR_PRINT(err)            fprintf(stderr, DEBUG_STRING " error: %s \n" , DEBUG_VALUES, errorString[err])
-#define ERROR_ERRNO_PRINT(err)      fprintf(stderr, DEBUG_STRING " error: %s" " errno: %s \n", DEBUG_VALUES, errorString[err], strerror(errno))
 
+/** Most characters of the extension recorded with hidden data. */
 #define EXTENSION_SIZE              3
-#define DATA_SIZE                   8
-#define PIXELS_TO_STORE_DATA_LEN    24
-
-#define BYTES_IN_PIXEL              3
-
-#define BLUE                        0
-#define GREEN                       1
-#define RED                         2
-
-/** Bitmask used when encoding / decoding data to a blue byte. */
-#define BLUE_BITMASK                0x07
-/** Bitmask used when encoding / decoding data to a green byte. */
-#define GREEN_BITMASK               0x07
-/** Bitmask used when encoding / decoding data to a red byte. */
-#define RED_BITMASK                 0x03
-
-/** Number of bits used to store data in a blue byte. */
-#define BLUE_BITS                   3
-/** Number of bits used to store data in a green byte. */
-#define GREEN_BITS                  3
-/** Number of bits used to store data in a red byte. */
-#define RED_BITS                    2
-
-#if((BLUE_BITS + GREEN_BITS + RED_BITS) != 8)
-    #error "Bits stored in pixel != 8"
-#endif
-
-#define OUTPUT_NAME_SIZE            15
 
 /** Identifies a pointer argument passes data into a function. */
 #define IN
@@ -91,109 +50,92 @@
     ERROR(errorNull)     \
     ERROR(errorFileType) \
     ERROR(errorFseek)    \
+    ERROR(errorMmap)     \
+    ERROR(errorFtruncate)\
+    ERROR(errorThread)   \
+    ERROR(errorManifest) \
+    ERROR(errorLayout)   \
+    ERROR(errorSocket)   \
+    ERROR(errorRequest)  \
+    ERROR(errorIo)       \
+    ERROR(errorCorrupt)  \
+    ERROR(errorPassphrase)\
+    ERROR(errorChecksum) \
+    ERROR(errorSimd)     \
+    ERROR(errorSameFile) \
 
 
 #undef ERROR
 /** Defines error to get numerical value from list for enum. */
 #define ERROR(x) x,
 /** Holds numerical values for ERRORS */
-enum eErrors { 
+enum eErrors {
     ERRORS
 };
 
 typedef enum eErrors tError;
 
-#undef ERROR
-/** Defines error to stringify list for debug. */
-#define ERROR(x) #x,
-/** Holds the error names in strings. Compliments eErrors. */
-char * errorString[] = { ERRORS };
-
+/** Told of each error the library meets: the source file and line it was met
+ *  at, the error, and errno when that describes it or zero. */
+typedef void (*tErrorReporter)(IN const char * fileName, int line, tError err,
+                               int errnoValue);
 
-/** Changes structure packing allowing memcpy to work for the file and info
- *  headers. */
-#pragma pack(1)
+/** Threads the data is hidden or recovered with, from threadPoolOpen. */
+typedef struct tThreadPool tThreadPool;
 
+/** What probing a bitmap found out about the data hidden in it. */
 typedef struct {
-    uint16_t type;
-    uint32_t size;
-    uint16_t reserved1;
-    uint16_t reserved2;
-    uint32_t offsetbits;
-} tBitmapFileHeader;
-
-typedef struct {
-    uint32_t size;
-    uint32_t width;
-    uint32_t height;
-    uint16_t planes;
-    uint16_t bitsPerPixel;
-    uint32_t compressionType;
-    uint32_t imageDataSize;
-    int32_t horizontalResolution;
-    int32_t verticalResolution;
-    uint32_t numberOfColours;
-    uint32_t numberOfImportantColours;
-} tBitmapInfoHeader;
-
-
-void printFileHeader(IN const tBitmapFileHeader * pFileHeader);
-
-void printInfoHeader(IN const tBitmapInfoHeader * pInfoHeader);
-
-tError decoding(IN char ** argv);
-
-tError encoding(IN char ** argv);
-
-tError parseBitmap(IN FILE * fpBitmap, 
-                   OUT tBitmapFileHeader * pFileheader, 
-                   OUT tBitmapInfoHeader * pInfoheader, 
-                   OUT uint8_t * pPadding,
-                   OUT uint64_t * pSizeofdata);
-
-tError copyBitmapData(FILE * fpBitmap, uint8_t ** pData, uint64_t dataSize);
-
-tError encodeDataFileContents(IN FILE * fpDataFile, 
-                              IN const char * dataFileName,
-                              IN_OUT uint8_t * pData, 
-                              uint64_t dataSize, 
-                              uint32_t width, 
-                              uint8_t padding);
-
-tError createOutputBitmap(IN const tBitmapFileHeader * pFileHeader, 
-                          IN const tBitmapInfoHeader *pInfoHeader,
-                          IN const uint8_t * pData,
-                          uint64_t dataSize);
-
-tError createOutputFile(IN char * extension, 
-                        IN uint8_t * pFileData,
-                        uint64_t dataSizeBytes);
-
-tError validateSizes(uint64_t bitmapFileSizeBytes,
-                     uint64_t pixelSizeBytes,
-                     uint64_t filePaddingSizeBytes);
-
-tError fileSize(IN FILE * fpFile, OUT uint64_t * size);
-
-tError decodeData(IN uint8_t * encodedData,
-                  uint64_t encodedDataSize, 
-                  uint64_t startOfEncodedDataIndex,
-                  uint64_t width,
-                  uint64_t padding,
-                  OUT uint8_t * decodedData);
-
-tError parseEncodedData(IN uint8_t * pImageData, 
-                        uint64_t imageDataSize,
-                        uint8_t padding,
-                        uint64_t width,
-                        OUT uint64_t * pStartOfEncodedDataIndex, 
-                        OUT char * pExtension, 
-                        OUT uint64_t * pEncodedDataSize);
-
-
-tError checkPadding(IN_OUT uint64_t * index, uint64_t width, uint64_t padding);
+    /** Size of the hidden data in bytes, as stored when it is compressed or
+     *  encrypted. */
+    uint64_t dataSize;
+    /** Extension of the hidden data. */
+    char extension[EXTENSION_SIZE + 1];
+    /** Most data the bitmap can hold in the layout it uses. */
+    uint64_t capacity;
+    /** Data bits hidden in each channel byte: 1, 2, 4 or 8, or zero when each
+     *  byte is split across a pixel. */
+    uint64_t bitsPerChannel;
+    /** Non zero when the alpha bytes of a 32 bit bitmap hold data too. */
+    uint64_t alpha;
+    /** Non zero when the hidden data is compressed. */
+    uint64_t compressed;
+    /** Non zero when the hidden data is encrypted. */
+    uint64_t encrypted;
+    /** Non zero when a checksum follows the hidden data. */
+    uint64_t checksummed;
+} tProbe;
+
+
+const char * errorText(tError err);
+
+void setErrorReporter(tErrorReporter reporter);
+
+tError threadPoolOpen(uint32_t threadCount, OUT tThreadPool ** ppPool);
+
+tError threadPoolClose(IN_OUT tThreadPool * pPool);
+
+tError encodeMemory(IN const uint8_t * pCover,
+                    uint64_t coverSize,
+                    IN const uint8_t * pData,
+                    uint64_t dataSize,
+                    IN const char * extension,
+                    uint64_t bitsPerChannel,
+                    int alpha,
+                    int compress,
+                    IN const char * passphrase,
+                    IN tThreadPool * pPool,
+                    OUT uint8_t ** ppStego,
+                    OUT uint64_t * pStegoSize);
+
+tError decodeMemory(IN const uint8_t * pStego,
+                    uint64_t stegoSize,
+                    IN const char * passphrase,
+                    IN tThreadPool * pPool,
+                    OUT uint8_t ** ppData,
+                    OUT uint64_t * pDataSize,
+                    OUT char extension[EXTENSION_SIZE + 1]);
+
+tError probeFile(IN const char * bitmapFileName, OUT tProbe * pProbe);
 
 
 #endif
-
-
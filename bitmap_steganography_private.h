@@ -0,0 +1,1103 @@
+/**
+ * @file bitmap_steganography_private.h
+ * @brief The internals of libbitmapsteg, shared by bitmap_steganography.c and
+ *        the programs built in this tree alongside it: encoder.c and bench.c.
+ *        Programs using the library include bitmap_steganography.h instead.
+ *
+ * Copyright 
+ *  @author Alan Barr
+ *  @date April 2012
+ * @section License
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BITMAP_STEGANOGRAPHY_PRIVATE_H_
+#define _BITMAP_STEGANOGRAPHY_PRIVATE_H_
+
+#include "bitmap_steganography.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/random.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+/* Build with -DNO_IO_URING to always use the pread and pwrite fallback */
+#if defined(__linux__) && !defined(NO_IO_URING)
+#define USE_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include <pthread.h>
+#include <time.h>
+
+/* The SIMD kernels are built into every x86-64 binary, each for its own 
+ * instruction set, and picked at run time by what the CPU supports */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+#define DEBUG_VALUES                __FILE__, __LINE__
+
+/** Pass an error, and with ERROR_ERRNO_PRINT errno, to reportError. */
+#define ERROR_PRINT(err)            reportError(DEBUG_VALUES, err, 0)
+#define ERROR_ERRNO_PRINT(err)      reportError(DEBUG_VALUES, err, errno)
+
+#define DATA_SIZE                   8
+#define PIXELS_TO_STORE_DATA_LEN    24
+/** Number of hidden bytes ahead of the data: its size then its extension. */
+#define HEADER_SIZE                 (DATA_SIZE + EXTENSION_SIZE)
+
+#define BYTES_IN_PIXEL              3
+/** Bytes in a pixel of a 32 bit bitmap: blue, green, red and alpha. */
+#define BYTES_IN_PIXEL_ALPHA        4
+
+/** Info header compressionType of uncompressed pixels with no bit fields. */
+#define COMPRESSION_NONE            0
+/** Info header compressionType of uncompressed pixels laid out by colour 
+ *  masks. Only the standard BGRA masks below are accepted. */
+#define COMPRESSION_BITFIELDS       3
+
+/** Colour masks of a 32 bit bitmap whose pixels are plain blue, green, red 
+ *  and alpha bytes. An alpha mask of zero is accepted too. */
+#define STANDARD_RED_MASK           0x00FF0000
+#define STANDARD_GREEN_MASK         0x0000FF00
+#define STANDARD_BLUE_MASK          0x000000FF
+#define STANDARD_ALPHA_MASK         0xFF000000
+
+/** Sizes of the info headers accepted: BITMAPINFOHEADER, the V2 and V3 
+ *  headers adding colour masks, BITMAPV4HEADER and BITMAPV5HEADER. */
+#define INFO_HEADER_SIZE            40
+#define INFO_HEADER_V2_SIZE         52
+#define INFO_HEADER_V3_SIZE         56
+#define INFO_HEADER_V4_SIZE         108
+#define INFO_HEADER_V5_SIZE         124
+/** Bytes of red, green and blue masks following a BITMAPINFOHEADER with 
+ *  COMPRESSION_BITFIELDS. */
+#define BITFIELDS_MASKS_SIZE        12
+
+#define BLUE                        0
+#define GREEN                       1
+#define RED                         2
+
+/** Bitmask used when encoding / decoding data to a blue byte. */
+#define BLUE_BITMASK                0x07
+/** Bitmask used when encoding / decoding data to a green byte. */
+#define GREEN_BITMASK               0x07
+/** Bitmask used when encoding / decoding data to a red byte. */
+#define RED_BITMASK                 0x03
+
+/** Number of bits used to store data in a blue byte. */
+#define BLUE_BITS                   3
+/** Number of bits used to store data in a green byte. */
+#define GREEN_BITS                  3
+/** Number of bits used to store data in a red byte. */
+#define RED_BITS                    2
+
+#if((BLUE_BITS + GREEN_BITS + RED_BITS) != 8)
+    #error "Bits stored in pixel != 8"
+#endif
+
+/** Bits of a 32 bit pixel, read as a little endian word, which hold data. */
+#define BGRA_LANE_MASK              (BLUE_BITMASK | (GREEN_BITMASK << 8) | (RED_BITMASK << 16))
+
+/** Index of the header byte which holds flags. No bitmap holds data needing
+ *  all DATA_SIZE bytes of the size, so its top byte is used. Bitmaps written
+ *  before there were flags have it zero. */
+#define HEADER_FLAGS                (DATA_SIZE - 1)
+/** Flag bits giving the data bits hidden in each channel byte, zero for the 
+ *  BLUE_BITS / GREEN_BITS / RED_BITS split of a byte across a pixel. */
+#define FLAG_BITS_PER_CHANNEL       0x0F
+/** Flag bit set when the data is hidden in the alpha bytes of a 32 bit bitmap
+ *  as well as its colour bytes. */
+#define FLAG_ALPHA                  0x10
+/** Flag bit set when the data is hidden as a run of compressed chunks, see
+ *  compressChunk. The size in the header is then the size of the chunks. */
+#define FLAG_COMPRESSED             0x20
+/** Flag bit set when the data is encrypted with a passphrase, see tCipher.
+ *  CIPHER_PREFIX_SIZE bytes are hidden in front of it and counted in the 
+ *  size in the header. */
+#define FLAG_ENCRYPTED              0x40
+/** Flag bit set when a CRC32C of what is hidden between the header and the
+ *  end of the size in the header follows it, CHECKSUM_SIZE bytes long and
+ *  not counted in the size. */
+#define FLAG_CHECKSUM               0x80
+
+/** Channel byte the data starts at when it isn't split across pixels: the 
+ *  first after the header, which is always split across pixels, rounded up 
+ *  to a multiple of 8. As every layout uses 1, 2, 4 or 8 channel bytes for a
+ *  byte, a multiple of 8 channel bytes never ends part way through one. */
+#define LAYOUT_DATA_CHANNEL(bytesPerPixel) (((HEADER_SIZE * (bytesPerPixel)) + 7) & ~7)
+/** Most channel bytes used to hide one byte. */
+#define LAYOUT_MAX_CHANNELS         8
+
+#define OUTPUT_NAME_SIZE            15
+/** Name of the bitmap written when encoding. */
+#define OUTPUT_BITMAP_NAME          "out.bmp"
+
+/** File name which stands for standard input or output. */
+#define STDIO_FILE_NAME             "-"
+
+/** File header type of a bitmap, "BM". */
+#define BITMAP_FILE_TYPE            ('B' | ('M' << 8))
+
+/** Number of data bytes read and hidden at a time. */
+#define DATA_CHUNK_SIZE             (64 * 1024)
+
+/** Most data bytes compressed as one chunk. Matches reach back at most 
+ *  COMPRESS_MAX_OFFSET bytes, so never leave their chunk. */
+#define COMPRESS_CHUNK_SIZE         (32 * 1024)
+/** Bytes in front of each compressed chunk holding its sizes. */
+#define COMPRESS_CHUNK_HEADER       4
+/** Space for a chunk of data and the chunk it is packed into. */
+#define COMPRESS_BUFFER_SIZE        (2 * COMPRESS_CHUNK_SIZE + COMPRESS_CHUNK_HEADER)
+/** Bits of the hash of 4 bytes used to find earlier occurrences of them. */
+#define COMPRESS_HASH_BITS          12
+/** Shortest match worth coding. */
+#define COMPRESS_MIN_MATCH          4
+#define COMPRESS_MAX_OFFSET         0xFFFF
+/** The last bytes of a chunk are always literals, and no match starts in the
+ *  last COMPRESS_MATCH_LIMIT, as in the LZ4 block format. */
+#define COMPRESS_LAST_LITERALS      5
+#define COMPRESS_MATCH_LIMIT        12
+
+/** Random salt the key is derived with, hidden in front of encrypted data, 
+ *  followed by bytes of the key's hash to check a passphrase against. */
+#define CIPHER_SALT_SIZE            16
+#define CIPHER_CHECK_SIZE           4
+#define CIPHER_PREFIX_SIZE          (CIPHER_SALT_SIZE + CIPHER_CHECK_SIZE)
+/** Iterations of PBKDF2-HMAC-SHA256 taken to turn a passphrase into a key, 
+ *  so each guess at a passphrase costs as much. */
+#define CIPHER_KDF_ROUNDS           100000
+/** Bytes of keystream from each ChaCha20 block. */
+#define CHACHA_BLOCK_SIZE           64
+#define CHACHA_DOUBLE_ROUNDS        10
+#define SHA256_BLOCK_SIZE           64
+#define SHA256_SIZE                 32
+
+/** Bytes of the CRC32C trailer, little endian. */
+#define CHECKSUM_SIZE               4
+/** The CRC32C (Castagnoli) polynomial, bit reversed. */
+#define CRC32C_POLYNOMIAL           0x82F63B78
+
+/** Size of the block of rows a bitmap is streamed through. */
+#define STREAM_BLOCK_SIZE           (1024 * 1024)
+
+/** Most threads that can be asked for. */
+#define THREAD_POOL_MAX_THREADS     256
+
+/** Number of tasks which can wait in a thread pool's queue. */
+#define THREAD_POOL_QUEUE_SIZE      64
+
+/** Number of blocks of rows a pipeline holds at once. */
+#define PIPELINE_SLOTS              4
+
+/** Times a pipeline stage checks the ring before sleeping until it moves. */
+#define PIPELINE_SPINS              1000
+
+/** Number of threads an I/O engine without io_uring calls pread and pwrite
+ *  on. */
+#define IO_ENGINE_THREADS           4
+
+/** Most bytes moved by one read or write of an I/O engine. */
+#define IO_ENGINE_MAX_TRANSFER      (1024 * 1024 * 1024)
+
+/** Number of io_uring opcodes asked about when probing the kernel. */
+#define IO_ENGINE_PROBE_OPS         256
+
+/** Number of parts given to each thread when embedding or extracting in 
+ *  parallel, so that a slow thread doesn't hold up the others. */
+#define PARALLEL_PARTS_PER_THREAD   4
+
+/** Fewest bytes worth handing to another thread. */
+#define PARALLEL_MIN_PART           (256 * 1024)
+
+/** Most bytes of image data the hidden header can span: each of its pixels
+ *  in a row of its own, followed by the most padding a row can have. */
+#define PROBE_IMAGE_SIZE            (HEADER_SIZE * (BYTES_IN_PIXEL_ALPHA + 3))
+
+/** Size of the window a mapped cover is copied to a mapped output through. */
+#define COPY_WINDOW_SIZE            (8 * 1024 * 1024)
+
+/** Bytes copied at a time from between the headers and the image data of a
+ *  bitmap. */
+#define GAP_COPY_SIZE               512
+
+/** Instruction sets the kernels can use and their names, each level having
+ *  everything the one before it has. simdAvx512 is AVX-512 with VBMI. */
+#define SIMD_LEVELS                     \
+    SIMD_LEVEL(simdScalar, "scalar")    \
+    SIMD_LEVEL(simdSse2,   "sse2")      \
+    SIMD_LEVEL(simdSsse3,  "ssse3")     \
+    SIMD_LEVEL(simdSse42,  "sse4.2")    \
+    SIMD_LEVEL(simdAvx2,   "avx2")      \
+    SIMD_LEVEL(simdAvx512, "avx512")    \
+
+#undef SIMD_LEVEL
+/** Defines level to get numerical value from list for enum. */
+#define SIMD_LEVEL(level, name) level,
+/** Holds numerical values for SIMD_LEVELS */
+typedef enum {
+    SIMD_LEVELS
+} tSimdLevel;
+
+/** Holds the level names in strings. Compliments tSimdLevel. */
+extern const char * simdLevelNames[];
+
+/** Most kernels of one kind tried in turn, with the NULL ending the list. */
+#define SIMD_MAX_KERNELS            6
+
+/** A kernel which hides one byte in each of as many pixels as its vectors 
+ *  cover whole, returning how many. */
+typedef uint64_t (*tBulkEmbedKernel)(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, 
+                                     uint64_t count);
+/** A kernel which recovers one byte from each of as many pixels as its 
+ *  vectors cover whole, returning how many. */
+typedef uint64_t (*tBulkExtractKernel)(IN const uint8_t * pPixels, OUT uint8_t * pBytes, 
+                                       uint64_t count);
+/** A kernel which XORs whole ChaCha20 blocks of keystream into some bytes, 
+ *  returning how many blocks. */
+typedef uint64_t (*tChachaKernel)(IN const uint32_t state[16], uint64_t block, 
+                                  IN_OUT uint8_t * pBytes, uint64_t blocks);
+/** A kernel which works out the CRC32C of some bytes. */
+typedef uint32_t (*tCrcKernel)(uint32_t crc, IN const uint8_t * pBytes, uint64_t count);
+
+/** The kernels of the instruction set level in use, picked when the library
+ *  loads and again by simdForce. Each list is tried widest first up to its 
+ *  NULL, every kernel taking what it can of what the one before left, and 
+ *  the scalar kernel finishes off the remainder. */
+typedef struct {
+    tBulkEmbedKernel embed[SIMD_MAX_KERNELS];
+    tBulkExtractKernel extract[SIMD_MAX_KERNELS];
+    tBulkEmbedKernel embedBgra[SIMD_MAX_KERNELS];
+    tBulkExtractKernel extractBgra[SIMD_MAX_KERNELS];
+    tChachaKernel chacha[SIMD_MAX_KERNELS];
+    tCrcKernel crc32c;
+} tSimdKernels;
+
+#if defined(SIMD_KERNELS)
+/** Builds a kernel for an instruction set the rest of the build may not use.*/
+#define SIMD_TARGET(isa)            __attribute__((target(isa)))
+#endif
+
+
+/** Changes structure packing allowing memcpy to work for the file and info
+ *  headers. */
+#pragma pack(push, 1)
+
+typedef struct {
+    uint16_t type;
+    uint32_t size;
+    uint16_t reserved1;
+    uint16_t reserved2;
+    uint32_t offsetbits;
+} tBitmapFileHeader;
+
+typedef struct {
+    uint32_t size;
+    uint32_t width;
+    uint32_t height;
+    uint16_t planes;
+    uint16_t bitsPerPixel;
+    uint32_t compressionType;
+    uint32_t imageDataSize;
+    int32_t horizontalResolution;
+    int32_t verticalResolution;
+    uint32_t numberOfColours;
+    uint32_t numberOfImportantColours;
+    /** The rest only appear in the larger info headers, except that the 
+     *  red, green and blue masks also follow a BITMAPINFOHEADER with 
+     *  COMPRESSION_BITFIELDS. */
+    uint32_t redMask;
+    uint32_t greenMask;
+    uint32_t blueMask;
+    uint32_t alphaMask;
+    /** Colour space, gamma and profile fields, kept only to be copied. */
+    uint8_t colourSpace[INFO_HEADER_V5_SIZE - INFO_HEADER_V3_SIZE];
+} tBitmapInfoHeader;
+
+#pragma pack(pop)
+
+/** Offset of the pixel data from the start of a bitmap file with a plain
+ *  BITMAPINFOHEADER. Others give it in the file header, see dataOffset. */
+#define PIXEL_DATA_OFFSET   (sizeof(tBitmapFileHeader) + INFO_HEADER_SIZE)
+
+/** Describes where the pixels sit in the image data. */
+typedef struct {
+    /** Number of pixels in a row. */
+    uint64_t width;
+    /** Number of rows. */
+    uint64_t height;
+    /** Number of pixel bytes in a row, excluding padding. */
+    uint64_t rowBytes;
+    /** Number of bytes in a row, including padding. */
+    uint64_t widthBytes;
+    /** Number of padding bytes at the end of each row. */
+    uint64_t padding;
+    /** Size of image data - both pixels and padding. */
+    uint64_t sizeOfData;
+    /** Offset of the image data from the start of the file. */
+    uint64_t dataOffset;
+    /** Bytes of the file held in the file and info headers, counting any 
+     *  colour masks after the info header. Anything between these and the
+     *  image data is copied as it is. */
+    uint64_t headerSize;
+    /** Number of bytes in a pixel, BYTES_IN_PIXEL or BYTES_IN_PIXEL_ALPHA. */
+    uint64_t bytesPerPixel;
+    /** Data bits hidden in each channel byte past the header: 1, 2, 4 or 8, or
+     *  zero to split each byte across a pixel. */
+    uint64_t bitsPerChannel;
+    /** Non zero when the alpha bytes of a 32 bit bitmap are channel bytes too.
+     *  Bytes split across a pixel then take 2 bits from each of its bytes. */
+    uint64_t alpha;
+    /** Non zero when the hidden data is compressed, see FLAG_COMPRESSED. */
+    uint64_t compressed;
+    /** Non zero when the hidden data is encrypted, see FLAG_ENCRYPTED. */
+    uint64_t encrypted;
+    /** Non zero when a checksum follows the hidden data, see FLAG_CHECKSUM. */
+    uint64_t checksummed;
+    /** Non zero when the data was hidden by the original encoder in a bitmap 
+     *  with row padding, see extractLegacy. */
+    uint64_t legacy;
+} tPixelLayout;
+
+/** A kernel which hides one byte in each run of channel bytes. */
+typedef void (*tEmbedKernel)(IN_OUT uint8_t * pChannels, IN const uint8_t * pBytes, 
+                             uint64_t count);
+/** A kernel which recovers one byte from each run of channel bytes. */
+typedef void (*tExtractKernel)(IN const uint8_t * pChannels, OUT uint8_t * pBytes, 
+                               uint64_t count);
+
+/** How hidden bytes are spread across the channel bytes of a bitmap. */
+typedef struct {
+    /** Data bits hidden in each channel byte, zero for the 3/3/2 split. */
+    uint64_t bitsPerChannel;
+    /** Number of channel bytes each hidden byte uses. */
+    uint64_t channels;
+    tEmbedKernel embed;
+    tExtractKernel extract;
+} tHidingScheme;
+
+/** Pixel data of a bitmap held in memory, either mapped from the file or 
+ *  copied into a buffer. */
+typedef struct {
+    /** Start of the pixel data. */
+    uint8_t * pData;
+    /** Start of the file mapping, NULL when not mapped. */
+    uint8_t * pMapping;
+    /** Size of the file mapping in bytes. */
+    uint64_t mappingSize;
+    /** Buffer the pixel data was copied into, NULL when not owned. */
+    uint8_t * pBuffer;
+} tImageData;
+
+
+/** Working buffers which can be kept from one encode or decode to the next.
+ *  Zero before first use. */
+typedef struct {
+    /** Holds a block of rows. */
+    uint8_t * pBlock;
+    uint64_t blockSize;
+    /** Holds data being hidden or recovered. */
+    uint8_t * pBytes;
+    uint64_t bytesSize;
+} tBuffers;
+
+/** A task run by a thread pool. */
+typedef void (*tTaskFunction)(void * pArgument);
+
+/** A queued task and its argument. */
+typedef struct {
+    tTaskFunction function;
+    void * pArgument;
+} tTask;
+
+/** A fixed set of threads which run tasks from a bounded queue. */
+struct tThreadPool {
+    /** The threads of the pool. */
+    pthread_t * pThreads;
+    /** Number of threads running. */
+    uint32_t threadCount;
+    /** Tasks waiting for a thread, a ring starting at head. */
+    tTask queue[THREAD_POOL_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t queued;
+    /** Tasks submitted but not yet finished. */
+    uint64_t outstanding;
+    /** Set when the pool is being destroyed. */
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t taskReady;
+    pthread_cond_t spaceReady;
+    pthread_cond_t allDone;
+};
+
+/** One part of an embed or extract run on a thread pool. */
+typedef struct {
+    const tPixelLayout * pLayout;
+    uint8_t * pImageData;
+    uint64_t position;
+    uint8_t * pBytes;
+    uint64_t count;
+    /** Non zero to recover data, zero to hide it. */
+    int extract;
+    /** What embedRows or extractRows returned for the part. */
+    tError result;
+} tRowsTask;
+
+/** Options given on the command line. */
+typedef struct {
+    /** Stream the bitmap through a few rows at a time. */
+    int stream;
+    /** Number of threads to hide or recover data with. */
+    uint32_t threads;
+    /** Pool of threads, NULL when only one is wanted. */
+    tThreadPool * pPool;
+    /** Data bits to hide in each channel byte when encoding, see 
+     *  tPixelLayout. */
+    uint64_t bitsPerChannel;
+    /** Hide data in the alpha bytes of 32 bit bitmaps when encoding. */
+    int alpha;
+    /** Only report what is hidden in each bitmap given. */
+    int probe;
+    /** Only check the data hidden in each bitmap given against its checksum.*/
+    int verify;
+    /** Recover only rangeLength bytes of the data, from rangeOffset in, when
+     *  decoding. */
+    int range;
+    uint64_t rangeOffset;
+    uint64_t rangeLength;
+    /** Hide the data in the cover bitmap itself rather than a copy. */
+    int inPlace;
+    /** Make the copy with cloneFile and only rewrite the rows holding data. */
+    int clone;
+    /** Stream the bitmap through reader, compute and writer threads. */
+    int pipeline;
+    /** Compress the data as it is hidden when encoding. */
+    int compress;
+    /** Passphrase to encrypt the data with when encoding and to decrypt it
+     *  with when decoding, NULL for none. */
+    const char * passphrase;
+    /** File to write the bitmap or data to, NULL for the default name. */
+    const char * outputFileName;
+} tOptions;
+
+/** SHA-256 part way through hashing a message. */
+typedef struct {
+    uint32_t state[8];
+    /** Bytes not yet making up a whole block, and bytes hashed so far. */
+    uint8_t block[SHA256_BLOCK_SIZE];
+    uint64_t length;
+} tSha256;
+
+/** ChaCha20 keyed for one hidden stream. Byte n of the encrypted data is 
+ *  XORed with byte n of the keystream, so any part of it can be encrypted
+ *  or decrypted on its own, in any order. */
+typedef struct {
+    /** The input block: constants, key, block counter (left zero) and nonce.*/
+    uint32_t state[16];
+    /** The salt and key check hidden in front of the encrypted data. */
+    uint8_t prefix[CIPHER_PREFIX_SIZE];
+} tCipher;
+
+/** Makes the hidden stream when hiding the contents of a data file: the 
+ *  header, the cipher's prefix when encrypting, the data, encrypted as it is
+ *  read, and the checksum of all but the header. The data file is read as 
+ *  the stream is, so the stream must be read in order. */
+typedef struct {
+    uint8_t header[HEADER_SIZE];
+    const tCipher * pCipher;
+    FILE * fpData;
+    /** Position in the stream of the checksum, and of the end of the stream.*/
+    uint64_t checksumPosition;
+    uint64_t end;
+    /** CRC32C of the stream after the header read so far. */
+    uint32_t crc;
+} tHiddenSource;
+
+/** Writes recovered data to a file, decrypting and then expanding it on the
+ *  way when it was hidden encrypted or compressed, and checks it against its
+ *  checksum. The data arrives in pieces of any size, so each chunk is 
+ *  gathered until all of it is in. */
+typedef struct {
+    /** File to write to, NULL to only check the data. */
+    FILE * fpOutput;
+    /** Bytes still to come before the checksum, and the checksum once they
+     *  have. */
+    uint64_t dataLeft;
+    uint64_t checksummed;
+    uint8_t checksum[CHECKSUM_SIZE];
+    uint64_t checksumGathered;
+    /** CRC32C of the data so far. */
+    uint32_t crc;
+    /** Non zero when the data is compressed. */
+    uint64_t compressed;
+    /** Passphrase to decrypt with, NULL when the data isn't encrypted. The
+     *  cipher is keyed once the prefix has arrived. */
+    const char * passphrase;
+    tCipher cipher;
+    /** The prefix being gathered, and how much of it is in. */
+    uint8_t prefix[CIPHER_PREFIX_SIZE];
+    uint64_t prefixGathered;
+    /** Bytes decrypted so far. */
+    uint64_t decrypted;
+    /** The chunk being gathered, its sizes first, and how much of it is in. */
+    uint8_t * pChunk;
+    uint64_t gathered;
+    /** The chunk once expanded. */
+    uint8_t * pExpanded;
+} tExpander;
+
+/** One block of rows in a pipeline's ring. */
+typedef struct {
+    /** The rows of the bitmap. */
+    uint8_t * pRows;
+    /** First row and number of rows. */
+    uint64_t row;
+    uint64_t rows;
+    /** The bytes hidden in the rows, their position in the hidden stream 
+     *  and how many there are. */
+    uint8_t * pBytes;
+    uint64_t position;
+    uint64_t count;
+} tPipelineSlot;
+
+/** Blocks of rows passed from a reader thread, through the thread hiding or
+ *  recovering data, to a writer thread. The slots form a ring; each stage 
+ *  owns a counter of the blocks it has finished and only waits on the 
+ *  counter of the stage before it. */
+typedef struct {
+    const tPixelLayout * pLayout;
+    /** Rows in every block but the last. */
+    uint64_t rowsPerBlock;
+    /** Number of blocks to pass through. */
+    uint32_t blocks;
+    /** Non zero to recover data, zero to hide it. */
+    int extract;
+    /** Makes the hidden stream when hiding. */
+    tHiddenSource source;
+    /** Position in the hidden stream of the first byte to hide or recover, 
+     *  and of the byte after the last. */
+    uint64_t start;
+    uint64_t end;
+    /** Bitmap read from and file written. */
+    FILE * fpInput;
+    FILE * fpOutput;
+    /** Writes the recovered data to fpOutput when recovering. */
+    tExpander expander;
+    tPipelineSlot slots[PIPELINE_SLOTS];
+    /** Blocks read, hidden or recovered, and written. */
+    uint32_t read;
+    uint32_t computed;
+    uint32_t written;
+    /** Stages asleep waiting for a counter to move. */
+    uint32_t sleepers;
+    /** Set once a stage fails. */
+    int stopping;
+    /** First error met by a stage. */
+    tError errRtn;
+    pthread_mutex_t lock;
+    pthread_cond_t moved;
+} tPipeline;
+
+/** A read or write handed to an I/O engine. The engine moves all size bytes
+ *  before reporting it done. */
+typedef struct tIoRequest {
+    /** File to read or write. */
+    int fd;
+    uint8_t * pBuffer;
+    uint64_t size;
+    /** Position in the file of the first byte. */
+    uint64_t offset;
+    /** Non zero to write, zero to read. */
+    int write;
+    /** Belongs to the submitter, the engine leaves it alone. */
+    void * pTag;
+    /** Bytes moved so far. */
+    uint64_t done;
+    /** Outcome: success, errorFread or errorFwrite. */
+    tError result;
+    /** Engine the request was submitted to. */
+    struct tIoEngine * pEngine;
+    /** Next request in the engine's list of finished requests. */
+    struct tIoRequest * pNext;
+} tIoRequest;
+
+/** Keeps many reads and writes of one thread in flight: an io_uring where 
+ *  the kernel offers one, otherwise a pool of threads calling pread and
+ *  pwrite. */
+typedef struct tIoEngine {
+    /** The io_uring, -1 when the pool is used. */
+    int ring;
+    /** Mappings of the submission ring, completion ring and submission 
+     *  entries. The rings may share one mapping. */
+    uint8_t * pSqRing;
+    uint64_t sqRingSize;
+    uint8_t * pCqRing;
+    uint64_t cqRingSize;
+    void * pSqes;
+    uint64_t sqesSize;
+    /** Fields of the rings, within the mappings. */
+    uint32_t * pSqHead;
+    uint32_t * pSqTail;
+    uint32_t * pSqMask;
+    uint32_t * pSqArray;
+    uint32_t sqEntries;
+    uint32_t * pCqHead;
+    uint32_t * pCqTail;
+    uint32_t * pCqMask;
+    void * pCqes;
+    /** Entries added to the submission ring the kernel hasn't been told of. */
+    uint32_t unsubmitted;
+    /** Requests submitted and not yet reported done. */
+    uint32_t inFlight;
+    /** Threads for the fallback. */
+    tThreadPool pool;
+    /** Requests which finished without the ring, latest first. */
+    tIoRequest * pFinished;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} tIoEngine;
+
+
+void reportError(IN const char * fileName, int line, tError err, int errnoValue);
+
+tError decodeFile(IN const char * bitmapFileName,
+                  IN const char * outputFileName,
+                  IN const tOptions * pOptions,
+                  IN_OUT tBuffers * pBuffers);
+
+tError encodeFile(IN const char * bitmapFileName,
+                  IN const char * dataFileName,
+                  IN const char * outputFileName,
+                  IN const tOptions * pOptions,
+                  IN_OUT tBuffers * pBuffers);
+
+int stdioFileName(IN const char * fileName);
+
+int sameFile(int fdInput, IN const char * fileName);
+
+FILE * stdioOpen(IN const char * fileName, IN const char * mode);
+
+int stdioClose(IN FILE * fpFile);
+
+tError stdioFinish(IN FILE * fpOutput, IN const char * outputFileName, tError errRtn);
+
+tError openDataFile(IN const char * fileName, 
+                    OUT FILE ** pfpDataFile, 
+                    OUT uint8_t ** ppBuffer);
+
+tError seekBitmap(IN FILE * fpBitmap, IN const tPixelLayout * pLayout, uint64_t offset);
+
+tError readWholeFile(IN const char * fileName, OUT uint8_t ** ppData, OUT uint64_t * pSize);
+
+tError readPassphrase(IN const char * fileName, OUT char ** ppPassphrase);
+
+tError writeWholeFile(IN const char * fileName, IN const uint8_t * pData, uint64_t size);
+
+tError encodePipe(IN const char * coverFileName,
+                  IN const char * dataFileName,
+                  IN const char * outputFileName,
+                  IN const tOptions * pOptions);
+
+tError hideInBitmap(IN_OUT uint8_t * pBitmap, 
+                    uint64_t bitmapSize,
+                    IN const uint8_t * pData, 
+                    uint64_t dataSize,
+                    IN const char * extension,
+                    uint64_t bitsPerChannel,
+                    int alpha,
+                    int compress,
+                    IN const char * passphrase,
+                    IN tThreadPool * pPool);
+
+tError parseBitmapMemory(IN const uint8_t * pBitmap, 
+                         uint64_t bitmapSize,
+                         OUT tBitmapFileHeader * pFileHeader, 
+                         OUT tBitmapInfoHeader * pInfoHeader, 
+                         OUT tPixelLayout * pLayout);
+
+tError probeBitmap(IN const char * bitmapFileName, OUT tProbe * pProbe, 
+                   OUT tPixelLayout * pLayout);
+
+tError ioEngineCreate(OUT tIoEngine * pEngine, uint32_t entries);
+
+tError ioEngineSubmit(IN_OUT tIoEngine * pEngine, IN_OUT tIoRequest * pRequest);
+
+tError ioEngineWait(IN_OUT tIoEngine * pEngine, OUT tIoRequest ** ppRequest);
+
+tError ioEngineDestroy(IN_OUT tIoEngine * pEngine);
+
+tError parseBitmap(IN FILE * fpBitmap, 
+                   OUT tBitmapFileHeader * pFileheader, 
+                   OUT tBitmapInfoHeader * pInfoheader, 
+                   OUT tPixelLayout * pLayout);
+
+tError pixelLayout(IN const tBitmapFileHeader * pFileHeader,
+                   IN const tBitmapInfoHeader * pInfoHeader, 
+                   OUT tPixelLayout * pLayout);
+
+uint64_t bitmapHeaderSize(IN const tBitmapInfoHeader * pInfoHeader);
+
+uint64_t unpackBitmapHeaders(IN const uint8_t * pBytes, 
+                             uint64_t size,
+                             OUT tBitmapFileHeader * pFileHeader, 
+                             OUT tBitmapInfoHeader * pInfoHeader);
+
+tError copyBitmapData(FILE * fpBitmap, uint8_t ** pData, uint64_t dataOffset, 
+                      uint64_t dataSize);
+
+tError loadImageData(IN FILE * fpBitmap, IN const tPixelLayout * pLayout, 
+                     int copyOnWrite, OUT tImageData * pImage);
+
+tError createOutputImage(IN const char * outputFileName,
+                         IN const tImageData * pCoverImage,
+                         OUT tImageData * pOutputImage);
+
+tError releaseImageData(IN_OUT tImageData * pImage);
+
+tError encodeDataFileContents(IN FILE * fpDataFile, 
+                              IN const char * dataFileName,
+                              IN_OUT uint8_t * pData, 
+                              IN const tPixelLayout * pLayout,
+                              IN const tCipher * pCipher,
+                              IN tThreadPool * pPool,
+                              IN_OUT tBuffers * pBuffers);
+
+tError encodeStream(IN FILE * fpBitmap,
+                    IN FILE * fpDataFile,
+                    IN const char * dataFileName,
+                    IN const tBitmapFileHeader * pFileHeader,
+                    IN const tBitmapInfoHeader * pInfoHeader,
+                    IN const tPixelLayout * pLayout,
+                    uint64_t dataSize,
+                    IN const tCipher * pCipher,
+                    IN const char * outputFileName,
+                    IN_OUT tBuffers * pBuffers);
+
+tError encodeInPlace(IN const char * bitmapFileName,
+                     IN FILE * fpDataFile,
+                     IN const char * dataFileName,
+                     IN const tPixelLayout * pLayout,
+                     uint64_t dataSize,
+                     IN const tCipher * pCipher,
+                     IN_OUT tBuffers * pBuffers);
+
+tError cloneFile(IN const char * sourceFileName, IN const char * destinationFileName);
+
+uint64_t streamBlockRows(IN const tPixelLayout * pLayout);
+
+void hiddenSourceCreate(OUT tHiddenSource * pSource,
+                        IN FILE * fpDataFile,
+                        IN const char * dataFileName,
+                        IN const tPixelLayout * pLayout,
+                        uint64_t dataSize,
+                        IN const tCipher * pCipher);
+
+tError readHiddenBytes(IN_OUT tHiddenSource * pSource,
+                       uint64_t position,
+                       OUT uint8_t * pBuffer,
+                       uint64_t count);
+
+const char * fileExtension(IN const char * fileName);
+
+tError reserveBuffers(IN_OUT tBuffers * pBuffers, uint64_t blockSize, uint64_t bytesSize);
+
+tError releaseBuffers(IN_OUT tBuffers * pBuffers);
+
+tError packHeader(OUT uint8_t header[HEADER_SIZE], uint64_t dataSize, uint8_t flags, 
+                  IN const char * extension);
+
+tError unpackHeader(IN const uint8_t header[HEADER_SIZE], OUT uint64_t * pDataSize, 
+                    OUT uint8_t * pFlags, OUT char * pExtension);
+
+void packChecksum(OUT uint8_t checksum[CHECKSUM_SIZE], uint32_t crc);
+
+uint32_t unpackChecksum(IN const uint8_t checksum[CHECKSUM_SIZE]);
+
+tError writeBitmapHeaders(IN FILE * fpOutput,
+                          IN const tBitmapFileHeader * pFileHeader,
+                          IN const tBitmapInfoHeader * pInfoHeader,
+                          IN FILE * fpCover);
+
+tError createOutputBitmap(IN const char * outputFileName,
+                          IN const tBitmapFileHeader * pFileHeader, 
+                          IN const tBitmapInfoHeader *pInfoHeader,
+                          IN const uint8_t * pData,
+                          uint64_t dataSize,
+                          IN FILE * fpCover);
+
+tError createOutputFile(IN const char * outputFileName,
+                        IN char * extension, 
+                        IN uint8_t * pFileData,
+                        uint64_t dataSizeBytes,
+                        IN const tPixelLayout * pLayout,
+                        IN const char * passphrase);
+
+uint64_t compressChunk(IN const uint8_t * pData, uint64_t size, OUT uint8_t * pChunk);
+
+tError chunkSizes(IN const uint8_t * pChunk, OUT uint64_t * pSize, OUT uint64_t * pStored);
+
+tError expandChunk(IN const uint8_t * pChunk, OUT uint8_t * pData);
+
+tError expandMemory(IN const uint8_t * pChunks, uint64_t chunksSize, 
+                    OUT uint8_t ** ppData, OUT uint64_t * pDataSize);
+
+tError cipherCreate(OUT tCipher * pCipher, IN const char * passphrase);
+
+tError cipherOpen(OUT tCipher * pCipher, 
+                  IN const char * passphrase, 
+                  IN const uint8_t prefix[CIPHER_PREFIX_SIZE]);
+
+void cipherApply(IN const tCipher * pCipher, 
+                 uint64_t offset, 
+                 IN_OUT uint8_t * pBytes, 
+                 uint64_t count);
+
+void chachaXorScalar(IN const uint32_t state[16], uint64_t block, IN_OUT uint8_t * pBytes,
+                     uint64_t blocks);
+
+uint32_t crc32c(uint32_t crc, IN const uint8_t * pBytes, uint64_t count);
+
+uint32_t crc32cScalar(uint32_t crc, IN const uint8_t * pBytes, uint64_t count);
+
+tError expanderCreate(OUT tExpander * pExpander, 
+                      IN FILE * fpOutput, 
+                      IN const tPixelLayout * pLayout,
+                      uint64_t dataSize,
+                      IN const char * passphrase);
+
+tError expanderWrite(IN_OUT tExpander * pExpander, IN_OUT uint8_t * pBytes, uint64_t count);
+
+tError expanderFinish(IN_OUT tExpander * pExpander);
+
+tError decodedFileName(IN const char * extension, OUT char outputFileName[OUTPUT_NAME_SIZE]);
+
+tError decodeStream(IN FILE * fpBitmap, 
+                    IN const tPixelLayout * pLayout,
+                    IN const char * outputFileName,
+                    IN const char * passphrase,
+                    int verify,
+                    IN_OUT tBuffers * pBuffers);
+
+tError encodePipeline(IN FILE * fpBitmap,
+                      IN FILE * fpDataFile,
+                      IN const char * dataFileName,
+                      IN const tBitmapFileHeader * pFileHeader,
+                      IN const tBitmapInfoHeader * pInfoHeader,
+                      IN const tPixelLayout * pLayout,
+                      uint64_t dataSize,
+                      IN const tCipher * pCipher,
+                      IN const char * outputFileName,
+                      IN_OUT tBuffers * pBuffers);
+
+tError decodePipeline(IN FILE * fpBitmap, 
+                      IN const tPixelLayout * pLayout,
+                      IN const char * outputFileName,
+                      IN const char * passphrase,
+                      IN_OUT tBuffers * pBuffers);
+
+tError validateSizes(uint64_t bitmapFileSizeBytes,
+                     uint64_t dataOffsetBytes,
+                     uint64_t pixelSizeBytes,
+                     uint64_t filePaddingSizeBytes);
+
+tError fileSize(IN FILE * fpFile, OUT uint64_t * size);
+
+tError extractRange(IN const char * bitmapFileName,
+                    uint64_t offset,
+                    uint64_t length,
+                    IN const char * outputFileName,
+                    IN const char * passphrase,
+                    IN_OUT tBuffers * pBuffers);
+
+tError decodeData(IN const uint8_t * pImageData,
+                  IN const tPixelLayout * pLayout,
+                  uint64_t encodedDataSize, 
+                  uint64_t startOfEncodedDataPixel,
+                  OUT uint8_t * decodedData,
+                  IN tThreadPool * pPool);
+
+tError parseEncodedData(IN const uint8_t * pImageData, 
+                        IN_OUT tPixelLayout * pLayout,
+                        OUT uint64_t * pStartOfEncodedDataPixel, 
+                        OUT char * pExtension, 
+                        OUT uint64_t * pEncodedDataSize);
+
+tError embedRows(IN const tPixelLayout * pLayout, 
+                 IN_OUT uint8_t * pImageData, 
+                 uint64_t position,
+                 IN const uint8_t * pBytes, 
+                 uint64_t count);
+
+tError extractRows(IN const tPixelLayout * pLayout, 
+                   IN const uint8_t * pImageData, 
+                   uint64_t position,
+                   OUT uint8_t * pBytes, 
+                   uint64_t count);
+
+tError embedBlock(IN const tPixelLayout * pLayout, 
+                  IN_OUT uint8_t * pBlock, 
+                  uint64_t firstRow,
+                  uint64_t position,
+                  IN const uint8_t * pBytes, 
+                  uint64_t count);
+
+tError extractLegacy(IN const tPixelLayout * pLayout, 
+                     IN const uint8_t * pImageData, 
+                     uint64_t position,
+                     OUT uint8_t * pBytes, 
+                     uint64_t count);
+
+tError extractBlock(IN const tPixelLayout * pLayout, 
+                    IN const uint8_t * pBlock, 
+                    uint64_t firstRow,
+                    uint64_t position,
+                    OUT uint8_t * pBytes, 
+                    uint64_t count);
+
+const tHidingScheme * hidingScheme(uint64_t bitsPerChannel);
+
+const tHidingScheme * pixelScheme(IN const tPixelLayout * pLayout);
+
+const tHidingScheme * layoutScheme(IN const tPixelLayout * pLayout);
+
+tError chooseLayout(IN_OUT tPixelLayout * pLayout, uint64_t bitsPerChannel, int alpha,
+                    int compress, int encrypt);
+
+uint8_t layoutFlags(IN const tPixelLayout * pLayout);
+
+uint64_t checksumSize(IN const tPixelLayout * pLayout);
+
+uint64_t streamOverhead(IN const tPixelLayout * pLayout);
+
+int supportedBitmap(IN const tBitmapInfoHeader * pInfoHeader);
+
+uint64_t hiddenChannel(IN const tPixelLayout * pLayout, uint64_t position);
+
+uint64_t hiddenBytesInRows(IN const tPixelLayout * pLayout, uint64_t rows);
+
+tError embedRowsParallel(IN tThreadPool * pPool,
+                         IN const tPixelLayout * pLayout, 
+                         IN_OUT uint8_t * pImageData, 
+                         uint64_t position,
+                         IN const uint8_t * pBytes, 
+                         uint64_t count);
+
+tError extractRowsParallel(IN tThreadPool * pPool,
+                           IN const tPixelLayout * pLayout, 
+                           IN const uint8_t * pImageData, 
+                           uint64_t position,
+                           OUT uint8_t * pBytes, 
+                           uint64_t count);
+
+tError threadPoolCreate(OUT tThreadPool * pPool, uint32_t threadCount);
+
+tError threadPoolSubmit(IN tThreadPool * pPool, tTaskFunction function, 
+                        IN void * pArgument);
+
+tError threadPoolWait(IN tThreadPool * pPool);
+
+tError threadPoolDestroy(IN_OUT tThreadPool * pPool);
+
+void embedBytes(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+void embedBytesScalar(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+void extractBytes(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+void extractBytesScalar(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+uint64_t embedBytesSwar(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesSwar(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+void embedBytes1(IN_OUT uint8_t * pChannels, IN const uint8_t * pBytes, uint64_t count);
+
+void extractBytes1(IN const uint8_t * pChannels, OUT uint8_t * pBytes, uint64_t count);
+
+void embedBytes2(IN_OUT uint8_t * pChannels, IN const uint8_t * pBytes, uint64_t count);
+
+void extractBytes2(IN const uint8_t * pChannels, OUT uint8_t * pBytes, uint64_t count);
+
+void embedBytes4(IN_OUT uint8_t * pChannels, IN const uint8_t * pBytes, uint64_t count);
+
+void extractBytes4(IN const uint8_t * pChannels, OUT uint8_t * pBytes, uint64_t count);
+
+void embedBytes8(IN_OUT uint8_t * pChannels, IN const uint8_t * pBytes, uint64_t count);
+
+void extractBytes8(IN const uint8_t * pChannels, OUT uint8_t * pBytes, uint64_t count);
+
+void embedBytesBgra(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+void embedBytesBgraScalar(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+void extractBytesBgra(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+void extractBytesBgraScalar(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+tSimdLevel simdDetect(void);
+
+tSimdLevel simdLevel(void);
+
+tError simdForce(IN const char * levelName);
+
+#if defined(SIMD_KERNELS)
+uint64_t embedBytesSsse3(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesSsse3(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+uint32_t crc32cSse42(uint32_t crc, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t chachaXorSse2(IN const uint32_t state[16], uint64_t block, IN_OUT uint8_t * pBytes,
+                       uint64_t blocks);
+
+uint64_t embedBytesBgraSse2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesBgraSse2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+uint64_t chachaXorAvx2(IN const uint32_t state[16], uint64_t block, IN_OUT uint8_t * pBytes,
+                       uint64_t blocks);
+
+uint64_t embedBytesAvx2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesAvx2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+uint64_t embedBytesBgraAvx2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesBgraAvx2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+uint64_t embedBytesBmi2(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesBmi2(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+
+uint64_t embedBytesAvx512(IN_OUT uint8_t * pPixels, IN const uint8_t * pBytes, uint64_t count);
+
+uint64_t extractBytesAvx512(IN const uint8_t * pPixels, OUT uint8_t * pBytes, uint64_t count);
+#endif
+
+
+#endif
+
+
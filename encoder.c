@@ -0,0 +1,1690 @@
+/**
+ * @file encoder.c 
+ * @brief The command line front end to libbitmapsteg: picks encoding, 
+ *        decoding, probing, verifying, a batch or a server from the 
+ *        arguments, and prints the results and any errors.
+ *
+ * Copyright:
+ *  @author Alan Barr
+ *  @date April 2012
+ *
+ * @section License
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* For accept4 */
+#define _GNU_SOURCE
+
+#include "bitmap_steganography_private.h"
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+
+/** Index to argv for bitmap file. */
+#define BITMAP_FILE                 1
+/** Index to argv for data file to encode into bitmap. */
+#define ENCODE_FILE                 2
+
+/** Prefix of each error message: the source file and line. */
+#define DEBUG_STRING                "%s:%d"
+
+/** Most file names on one line of a batch manifest. */
+#define BATCH_MAX_FIELDS            3
+
+/** Number of jobs each thread of a batch keeps moving through its I/O 
+ *  engine at once. */
+#define IO_ENGINE_JOBS              16
+
+/** Most bytes of files each thread of a batch holds in memory at once. */
+#define IO_ENGINE_BYTES             (256 * 1024 * 1024)
+
+/** Longest request a server accepts, in bytes. */
+#define SERVE_REQUEST_SIZE          4096
+
+/** Request field which stands for the next file descriptor sent with it. */
+#define SERVE_DESCRIPTOR_FIELD      "@"
+
+/** Room for the name a server opens a sent file descriptor by. */
+#define SERVE_DESCRIPTOR_NAME_SIZE  32
+
+/** Short options, as getopt takes them. */
+#define OPTION_STRING               "sj:b:l:apr:ico:d:Pzk:vm:"
+
+/** What the command line asks for, chosen once its options are read. */
+typedef enum {
+    modeUsage,
+    modeBatch,
+    modeServe,
+    modeProbe,
+    modeVerify,
+    modeDecode,
+    modeEncode
+} tMode;
+
+/** One line of a batch manifest. */
+typedef struct {
+    /** The line read from the manifest, which the fields point into. */
+    char * pLine;
+    /** File names: cover, data and output to encode or stego and output to 
+     *  decode. */
+    char * pFields[BATCH_MAX_FIELDS];
+    /** Number of fields used. */
+    int fieldCount;
+    /** Outcome of the job. */
+    tError result;
+} tBatchJob;
+
+/** Jobs shared out between the threads of a batch. */
+typedef struct {
+    tBatchJob * pJobs;
+    uint64_t jobCount;
+    /** Index of the next job to take. */
+    uint64_t nextJob;
+    /** Options each job is run with. */
+    tOptions options;
+} tBatch;
+
+/** A job of a batch moving through an I/O engine: its files are read, then
+ *  the data hidden or recovered, then the result written. */
+typedef struct {
+    /** The job, NULL when the slot is free. */
+    tBatchJob * pJob;
+    /** Files of the job, -1 when not open. */
+    int descriptors[BATCH_MAX_FIELDS];
+    /** Reads of the bitmap and data, then the write of the output. */
+    tIoRequest requests[2];
+    /** Requests not yet done. */
+    int outstanding;
+    /** Non zero once the output is being written. */
+    int writing;
+    /** Kept from one job in the slot to the next: the bitmap is read into 
+     *  pBlock and the data to hide into pBytes. */
+    tBuffers buffers;
+    uint64_t bitmapSize;
+    uint64_t dataSize;
+    /** Data recovered when decoding. */
+    uint8_t * pDecoded;
+    /** First error met. */
+    tError result;
+} tAsyncJob;
+
+/** Threads serving encode and decode requests on a socket, see serveSocket. */
+typedef struct {
+    /** The listening socket. */
+    int listenSocket;
+    /** Options each request is run with. */
+    tOptions options;
+    /** Connection each thread is serving, -1 when it has none. */
+    int connections[THREAD_POOL_MAX_THREADS];
+    /** Number of threads which have started. */
+    uint32_t threadCount;
+    /** Requests served and how many of them failed. */
+    uint64_t requests;
+    uint64_t failed;
+    /** Set when the server is being shut down. */
+    int stopping;
+    pthread_mutex_t lock;
+} tServer;
+
+
+/** Long options, each standing for the short option it returns. */
+static const struct option longOptions[] = {
+    {"verify", no_argument, NULL, 'v'},
+    {NULL, 0, NULL, 0}
+};
+
+/** The short options each tMode uses. Any other option given with it is 
+ *  refused rather than ignored. */
+static const char * const modeOptions[] = {
+    [modeUsage]  = "",
+    [modeBatch]  = "bsjlarPiczkm",
+    [modeServe]  = "dsjlarPiczkm",
+    [modeProbe]  = "pm",
+    [modeVerify] = "vm",
+    [modeDecode] = "sjPrkom",
+    [modeEncode] = "sjlaicPzkom"
+};
+
+
+/** @brief Prints an error the library met to standard error, see 
+ *         setErrorReporter.
+ *  @param fileName Source file the error was met in.
+ *  @param line Line of the source file.
+ *  @param err The error.
+ *  @param errnoValue errno describing the error, or zero. */
+static void printError(IN const char * fileName, int line, tError err, int errnoValue)
+{
+    if (errnoValue != 0)
+    {
+        fprintf(stderr, DEBUG_STRING " error: %s" " errno: %s \n", fileName, line, 
+                errorText(err), strerror(errnoValue));
+    }
+
+    else
+    {
+        fprintf(stderr, DEBUG_STRING " error: %s \n", fileName, line, errorText(err));
+    }
+}
+
+
+/** @brief Handles all the retrieving of encoded information from a bitmap and
+ *         saves it in a file. Bitmap file name is retrieved from argv.
+ *  @param argv[0] - Filename of the bitmap file to decode.
+ *  @param pOptions Options given on the command line.
+ *  @return An error value from enum eErrors. */
+static tError decoding(IN char ** argv, IN const tOptions * pOptions)
+{
+    tError errRtn = errorDefault;
+    tBuffers buffers = {0};
+
+    errRtn = decodeFile(argv[BITMAP_FILE], pOptions->outputFileName, pOptions, &buffers);
+
+    releaseBuffers(&buffers);
+
+    return errRtn;
+}
+
+
+/** @brief Handles all the encoding of data into a bitmap file. The data is 
+ *         pulled from the third argument of argv and placed into the bitmap 
+ *         file which should be the second argument.
+ *  @param argv[0] Bitmap file to copy and hide data in.
+ *  @param argv[1] Data file to be hidden.
+ *  @param pOptions Options given on the command line.
+ *  @return An error value from enum eErrors. */
+static tError encoding(IN char ** argv, IN const tOptions * pOptions)
+{
+    tError errRtn = errorDefault;
+    tBuffers buffers = {0};
+
+    const char * outputFileName = pOptions->outputFileName != NULL ? 
+                                  pOptions->outputFileName : OUTPUT_BITMAP_NAME;
+
+    /* Compressed data is hidden in a whole bitmap held in memory anyway */
+    if (pOptions->compress && 
+        (stdioFileName(argv[BITMAP_FILE]) || stdioFileName(argv[ENCODE_FILE]) || 
+         stdioFileName(outputFileName)))
+    {
+        errRtn = encodePipe(argv[BITMAP_FILE], argv[ENCODE_FILE], outputFileName, 
+                            pOptions);
+    }
+
+    else
+    {
+        errRtn = encodeFile(argv[BITMAP_FILE], argv[ENCODE_FILE], outputFileName, 
+                            pOptions, &buffers);
+    }
+
+    releaseBuffers(&buffers);
+
+    return errRtn;
+}
+
+
+/** @brief Probes each of a list of bitmaps, printing one line for each: the
+ *         result, and if there is data its size, extension, the most data the
+ *         bitmap could hold in the same layout and the layout. A summary line
+ *         follows on standard error, leaving standard output one line per 
+ *         bitmap.
+ *  @param fileNames Names of the bitmaps.
+ *  @param fileCount Number of bitmaps.
+ *  @return An error value from enum eErrors, the first failure if any. */
+static tError probeFiles(IN char ** fileNames, int fileCount)
+{
+    tError errRtn = success;
+    tError probeRtn = errorDefault;
+    tProbe probe;
+    uint64_t failed = 0;
+    struct timespec start;
+    struct timespec end;
+    double seconds = 0;
+    int file = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (file = 0; file < fileCount; file++)
+    {
+        if ((probeRtn = probeFile(fileNames[file], &probe)) == success)
+        {
+            printf("%s probe %s size=%" PRIu64 " extension=%s capacity=%" PRIu64 
+                   " bits=%" PRIu64 " alpha=%" PRIu64 " compressed=%" PRIu64 
+                   " encrypted=%" PRIu64 " checksum=%" PRIu64 "\n", 
+                   errorText(probeRtn), fileNames[file], probe.dataSize, 
+                   probe.extension, probe.capacity, probe.bitsPerChannel, 
+                   probe.alpha, probe.compressed, probe.encrypted,
+                   probe.checksummed);
+        }
+
+        else
+        {
+            printf("%s probe %s\n", errorText(probeRtn), fileNames[file]);
+
+            if (failed++ == 0)
+            {
+                errRtn = probeRtn;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "files=%d failed=%" PRIu64 " seconds=%.3f files_per_second=%.1f\n",
+            fileCount, failed, seconds, seconds > 0 ? fileCount / seconds : 0.0);
+
+    return errRtn;
+}
+
+
+/** @brief Checks the data in each of a list of bitmaps against its checksum,
+ *         printing one line for each with the result and a summary line as 
+ *         probeFiles does. Each bitmap is streamed and nothing is written, so
+ *         no passphrase is needed for encrypted data.
+ *  @param fileNames Names of the bitmaps.
+ *  @param fileCount Number of bitmaps.
+ *  @return An error value from enum eErrors, the first failure if any. 
+ *          errorChecksum if the data doesn't match its checksum or has 
+ *          none. */
+static tError verifyFiles(IN char ** fileNames, int fileCount)
+{
+    tError errRtn = success;
+    tError verifyRtn = errorDefault;
+    tOptions options;
+    tBuffers buffers = {0};
+    uint64_t failed = 0;
+    struct timespec start;
+    struct timespec end;
+    double seconds = 0;
+    int file = 0;
+
+    memset(&options, 0, sizeof(tOptions));
+    options.verify = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (file = 0; file < fileCount; file++)
+    {
+        verifyRtn = decodeFile(fileNames[file], NULL, &options, &buffers);
+
+        printf("%s verify %s\n", errorText(verifyRtn), fileNames[file]);
+
+        if (verifyRtn != success && failed++ == 0)
+        {
+            errRtn = verifyRtn;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "files=%d failed=%" PRIu64 " seconds=%.3f files_per_second=%.1f\n",
+            fileCount, failed, seconds, seconds > 0 ? fileCount / seconds : 0.0);
+
+    releaseBuffers(&buffers);
+
+    return errRtn;
+}
+
+
+/** @brief Splits a line of a batch manifest or a server request into the 
+ *         file names of a job. Anything from a '#' field on is ignored.
+ *  @param pLine The line. The fields are left pointing into it.
+ *  @param pJob Returns the fields. fieldCount is zero for a blank line.
+ *  @return errorManifest if the line is neither blank, "cover data output" 
+ *          nor "stego output", or names STDIO_FILE_NAME, which belongs to the
+ *          batch or server rather than its jobs, otherwise success. */
+static tError parseJobLine(IN_OUT char * pLine, OUT tBatchJob * pJob)
+{
+    tError errRtn = errorDefault;
+    char * pSave = NULL;
+    char * pField = NULL;
+    int stdio = 0;
+
+    memset(pJob, 0, sizeof(tBatchJob));
+    pField = strtok_r(pLine, " \t\r\n", &pSave);
+
+    while (pField != NULL && pField[0] != '#' && pJob->fieldCount < BATCH_MAX_FIELDS)
+    {
+        stdio |= stdioFileName(pField);
+        pJob->pFields[pJob->fieldCount++] = pField;
+        pField = strtok_r(NULL, " \t\r\n", &pSave);
+    }
+
+    if (pJob->fieldCount == 1 || stdio || (pField != NULL && pField[0] != '#'))
+    {
+        errRtn = errorManifest;
+    }
+
+    else
+    {
+        pJob->result = errorDefault;
+        errRtn = success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Frees jobs returned from readManifest.
+ *  @param pJobs The jobs.
+ *  @param jobCount Number of jobs.
+ *  @return An error value from enum eErrors. */
+static tError freeBatchJobs(IN_OUT tBatchJob * pJobs, uint64_t jobCount)
+{
+    uint64_t job = 0;
+
+    for (job = 0; job < jobCount; job++)
+    {
+        free(pJobs[job].pLine);
+    }
+
+    free(pJobs);
+
+    return success;
+}
+
+
+/** @brief Reads a batch manifest. Each line lists the files of one job,
+ *         separated by white space. Blank lines and lines starting with '#' 
+ *         are skipped.
+ *  @param manifestFileName Name of the manifest.
+ *  @param ppJobs Returns the jobs, to be freed with freeBatchJobs.
+ *  @param pJobCount Returns the number of jobs.
+ *  @return An error value from enum eErrors. */
+static tError readManifest(IN const char * manifestFileName, 
+                           OUT tBatchJob ** ppJobs, 
+                           OUT uint64_t * pJobCount)
+{
+    tError errRtn = errorDefault;
+    FILE * fpManifest = NULL;
+    tBatchJob * pJobs = NULL;
+    tBatchJob * pGrown = NULL;
+    uint64_t jobCount = 0;
+    uint64_t jobsAllocated = 0;
+    uint64_t lineNumber = 0;
+    char * pLine = NULL;
+    size_t lineSize = 0;
+    tBatchJob job;
+
+    if ((fpManifest = fopen(manifestFileName, "r")) == NULL)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    while (errRtn == success && getline(&pLine, &lineSize, fpManifest) != -1)
+    {
+        lineNumber++;
+
+        if ((errRtn = parseJobLine(pLine, &job)) != success)
+        {
+            ERROR_PRINT(errRtn);
+            fprintf(stderr, "%s:%" PRIu64 ": expected \"cover data output\" or "
+                    "\"stego output\", naming files other than " STDIO_FILE_NAME "\n", 
+                    manifestFileName, lineNumber);
+        }
+
+        else if (job.fieldCount == 0)
+        {
+            continue;
+        }
+
+        else if (jobCount == jobsAllocated &&
+                 (pGrown = realloc(pJobs, (jobsAllocated * 2 + 16) * 
+                                          sizeof(tBatchJob))) == NULL)
+        {
+            errRtn = errorMalloc;
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            if (jobCount == jobsAllocated)
+            {
+                pJobs = pGrown;
+                jobsAllocated = jobsAllocated * 2 + 16;
+            }
+
+            /* Keep the fields in one allocation with the job */
+            job.pLine = pLine;
+            pJobs[jobCount++] = job;
+            pLine = NULL;
+            lineSize = 0;
+        }
+    }
+
+    free(pLine);
+
+    if (fpManifest != NULL && fclose(fpManifest) != success)
+    {
+        errRtn = errorFclose;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    if (errRtn != success)
+    {
+        freeBatchJobs(pJobs, jobCount);
+        pJobs = NULL;
+        jobCount = 0;
+    }
+
+    *ppJobs = pJobs;
+    *pJobCount = jobCount;
+
+    return errRtn;
+}
+
+
+/** @brief Runs one job of a batch or a server.
+ *  @param pJob The job: stego and output to decode, cover, data and output
+ *         to encode.
+ *  @param pOptions Options to run the job with.
+ *  @param pBuffers Working buffers kept from one job to the next.
+ *  @return An error value from enum eErrors. */
+static tError runJob(IN const tBatchJob * pJob, IN const tOptions * pOptions, 
+                     IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+
+    if (pJob->fieldCount == 2)
+    {
+        errRtn = decodeFile(pJob->pFields[0], pJob->pFields[1], pOptions, pBuffers);
+    }
+
+    else
+    {
+        errRtn = encodeFile(pJob->pFields[0], pJob->pFields[1], pJob->pFields[2], 
+                            pOptions, pBuffers);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Run by each thread of a batch. Takes jobs in turn until none are 
+ *         left, reusing its buffers from one job to the next.
+ *  @param pArgument The tBatch being run. */
+static void batchWorker(void * pArgument)
+{
+    tBatch * pBatch = pArgument;
+    tBuffers buffers = {0};
+    tBatchJob * pJob = NULL;
+    uint64_t job = 0;
+
+    while ((job = __atomic_fetch_add(&pBatch->nextJob, 1, __ATOMIC_RELAXED)) < 
+           pBatch->jobCount)
+    {
+        pJob = &pBatch->pJobs[job];
+        pJob->result = runJob(pJob, &pBatch->options, &buffers);
+    }
+
+    releaseBuffers(&buffers);
+}
+
+
+/** @brief Closes the files of a job moving through an I/O engine, frees its
+ *         buffers and records its result, leaving its slot free.
+ *  @param pAsync The job. */
+static void asyncJobFinish(IN_OUT tAsyncJob * pAsync)
+{
+    tBuffers buffers = pAsync->buffers;
+    int field = 0;
+
+    for (field = 0; field < BATCH_MAX_FIELDS; field++)
+    {
+        if (pAsync->descriptors[field] != -1 && close(pAsync->descriptors[field]) != success &&
+            pAsync->result == success)
+        {
+            pAsync->result = errorFclose;
+            ERROR_ERRNO_PRINT(pAsync->result);
+        }
+    }
+
+    free(pAsync->pDecoded);
+
+    pAsync->pJob->result = pAsync->result;
+    memset(pAsync, 0, sizeof(tAsyncJob));
+    pAsync->buffers = buffers;
+}
+
+
+/** @brief Opens one of the files of a job and submits a read of all of it 
+ *  into the job's buffers.
+ *  @param pEngine The engine to read with.
+ *  @param pAsync The job.
+ *  @param field Which file of the job, 0 for the bitmap and 1 for the data.
+ *  @param pSize Returns the size of the file.
+ *  @return An error value from enum eErrors. */
+static tError asyncJobRead(IN_OUT tIoEngine * pEngine, 
+                           IN_OUT tAsyncJob * pAsync, 
+                           int field,
+                           OUT uint64_t * pSize)
+{
+    tError errRtn = errorDefault;
+    tIoRequest * pRequest = &pAsync->requests[field];
+    struct stat status;
+
+    if ((pAsync->descriptors[field] = open(pAsync->pJob->pFields[field], 
+                                           O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        errRtn = errorFopen;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (fstat(pAsync->descriptors[field], &status) != success)
+    {
+        errRtn = errorFread;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if ((errRtn = reserveBuffers(&pAsync->buffers, field == 0 ? status.st_size : 0,
+                                      field == 0 ? 0 : status.st_size)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        *pSize = status.st_size;
+        pRequest->fd = pAsync->descriptors[field];
+        pRequest->pBuffer = field == 0 ? pAsync->buffers.pBlock : pAsync->buffers.pBytes;
+        pRequest->size = *pSize;
+        pRequest->offset = 0;
+        pRequest->write = 0;
+        pRequest->pTag = pAsync;
+
+        if ((errRtn = ioEngineSubmit(pEngine, pRequest)) == success)
+        {
+            pAsync->outstanding++;
+        }
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Starts a job through an I/O engine by submitting reads of its 
+ *         bitmap and, when encoding, its data.
+ *  @param pEngine The engine.
+ *  @param pAsync A free slot to run the job in.
+ *  @param pJob The job.
+ *  @return An error value from enum eErrors. If no read is outstanding the 
+ *          job has failed and should be finished. */
+static tError asyncJobStart(IN_OUT tIoEngine * pEngine, 
+                            OUT tAsyncJob * pAsync, 
+                            IN tBatchJob * pJob)
+{
+    tBuffers buffers = pAsync->buffers;
+    int field = 0;
+
+    memset(pAsync, 0, sizeof(tAsyncJob));
+    pAsync->buffers = buffers;
+    pAsync->pJob = pJob;
+
+    for (field = 0; field < BATCH_MAX_FIELDS; field++)
+    {
+        pAsync->descriptors[field] = -1;
+    }
+
+    if ((pAsync->result = asyncJobRead(pEngine, pAsync, 0, &pAsync->bitmapSize)) == 
+        success && pJob->fieldCount == 3)
+    {
+        pAsync->result = asyncJobRead(pEngine, pAsync, 1, &pAsync->dataSize);
+    }
+
+    return pAsync->result;
+}
+
+
+/** @brief Moves a job on once its reads or its write are done: hides or 
+ *         recovers the data and submits the write of the output, or 
+ *         finishes the job.
+ *  @param pEngine The engine.
+ *  @param pAsync The job, with nothing outstanding.
+ *  @param pOptions Options the job is run with. */
+static void asyncJobAdvance(IN_OUT tIoEngine * pEngine, 
+                            IN_OUT tAsyncJob * pAsync,
+                            IN const tOptions * pOptions)
+{
+    tBatchJob * pJob = pAsync->pJob;
+    tIoRequest * pRequest = &pAsync->requests[0];
+    int output = pJob->fieldCount - 1;
+    char extension[EXTENSION_SIZE + 1] = {0};
+
+    if (pAsync->result != success || pAsync->writing)
+    {
+        asyncJobFinish(pAsync);
+        return;
+    }
+
+    if (pJob->fieldCount == 3)
+    {
+        pAsync->result = hideInBitmap(pAsync->buffers.pBlock, pAsync->bitmapSize, 
+                                      pAsync->buffers.pBytes, pAsync->dataSize, 
+                                      fileExtension(pJob->pFields[1]), 
+                                      pOptions->bitsPerChannel, pOptions->alpha, 
+                                      pOptions->compress, pOptions->passphrase, NULL);
+        pRequest->pBuffer = pAsync->buffers.pBlock;
+        pRequest->size = pAsync->bitmapSize;
+    }
+
+    else
+    {
+        pAsync->result = decodeMemory(pAsync->buffers.pBlock, pAsync->bitmapSize, 
+                                      pOptions->passphrase, NULL, &pAsync->pDecoded, 
+                                      &pAsync->dataSize, extension);
+        pRequest->pBuffer = pAsync->pDecoded;
+        pRequest->size = pAsync->dataSize;
+    }
+
+    if (pAsync->result != success)
+    {
+        ERROR_PRINT(pAsync->result);
+    }
+
+    else if ((pAsync->descriptors[output] = open(pJob->pFields[output], 
+                                                 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                                 0666)) == -1)
+    {
+        pAsync->result = errorFopen;
+        ERROR_ERRNO_PRINT(pAsync->result);
+    }
+
+    else
+    {
+        pRequest->fd = pAsync->descriptors[output];
+        pRequest->offset = 0;
+        pRequest->write = 1;
+        pRequest->pTag = pAsync;
+
+        if ((pAsync->result = ioEngineSubmit(pEngine, pRequest)) == success)
+        {
+            pAsync->outstanding++;
+            pAsync->writing = 1;
+        }
+    }
+
+    if (pAsync->outstanding == 0)
+    {
+        asyncJobFinish(pAsync);
+    }
+}
+
+
+/** @brief Run by each thread of a batch when whole files are read and 
+ *         written. Keeps up to IO_ENGINE_JOBS jobs moving through an I/O 
+ *         engine, hiding or recovering the data of each as soon as its files
+ *         are read while the reads and writes of the others carry on.
+ *  @param pArgument The tBatch being run. */
+static void batchAsyncWorker(void * pArgument)
+{
+    tError errRtn = errorDefault;
+    tBatch * pBatch = pArgument;
+    tIoEngine engine;
+    tAsyncJob jobs[IO_ENGINE_JOBS];
+    tAsyncJob * pAsync = NULL;
+    tIoRequest * pRequest = NULL;
+    uint64_t job = 0;
+    uint64_t bytes = 0;
+    uint64_t bitmapSize = 0;
+    uint32_t active = 0;
+    uint32_t slot = 0;
+
+    if (ioEngineCreate(&engine, 2 * IO_ENGINE_JOBS) != success)
+    {
+        batchWorker(pArgument);
+        return;
+    }
+
+    memset(jobs, 0, sizeof(jobs));
+    errRtn = success;
+
+    while (errRtn == success)
+    {
+        for (slot = 0; slot < IO_ENGINE_JOBS && (active == 0 || bytes < IO_ENGINE_BYTES); 
+             slot++)
+        {
+            if (jobs[slot].pJob != NULL ||
+                (job = __atomic_fetch_add(&pBatch->nextJob, 1, __ATOMIC_RELAXED)) >= 
+                pBatch->jobCount)
+            {
+                continue;
+            }
+
+            asyncJobStart(&engine, &jobs[slot], &pBatch->pJobs[job]);
+
+            if (jobs[slot].outstanding == 0)
+            {
+                asyncJobFinish(&jobs[slot]);
+            }
+
+            else
+            {
+                active++;
+                bytes += jobs[slot].bitmapSize;
+            }
+        }
+
+        if (active == 0)
+        {
+            break;
+        }
+
+        else if ((errRtn = ioEngineWait(&engine, &pRequest)) != success)
+        {
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            pAsync = pRequest->pTag;
+            bitmapSize = pAsync->bitmapSize;
+
+            if (pRequest->result != success && pAsync->result == success)
+            {
+                pAsync->result = pRequest->result;
+            }
+
+            if (--pAsync->outstanding == 0)
+            {
+                asyncJobAdvance(&engine, pAsync, &pBatch->options);
+            }
+
+            if (pAsync->pJob == NULL)
+            {
+                active--;
+                bytes -= bitmapSize;
+            }
+        }
+    }
+
+    /* The kernel may still be using the buffers of any job left, so they 
+     * are not freed */
+    for (slot = 0; slot < IO_ENGINE_JOBS; slot++)
+    {
+        if (jobs[slot].pJob != NULL)
+        {
+            jobs[slot].pJob->result = errRtn;
+        }
+
+        else
+        {
+            releaseBuffers(&jobs[slot].buffers);
+        }
+    }
+
+    ioEngineDestroy(&engine);
+}
+
+
+/** @brief Runs every job in a manifest on a pool of threads, then prints the
+ *         result of each in manifest order along with the overall rate.
+ *  @param manifestFileName Name of the manifest, see readManifest.
+ *  @param pOptions Options given on the command line. threads sets how many
+ *         jobs run at once, by default one per online CPU.
+ *  @return success if every job succeeded, otherwise the error from the 
+ *          first job to fail. */
+static tError runBatch(IN const char * manifestFileName, IN const tOptions * pOptions)
+{
+    tError errRtn = errorDefault;
+    tThreadPool threadPool;
+    tBatch batch;
+    tTaskFunction worker = batchWorker;
+    uint32_t threads = pOptions->threads;
+    uint32_t thread = 0;
+    uint64_t job = 0;
+    uint64_t failed = 0;
+    struct timespec start;
+    struct timespec end;
+    double seconds = 0;
+
+    memset(&batch, 0, sizeof(tBatch));
+    batch.options = *pOptions;
+    batch.options.pPool = NULL;
+
+    if (threads == 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+        threads = threads > THREAD_POOL_MAX_THREADS ? THREAD_POOL_MAX_THREADS : threads;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if ((errRtn = readManifest(manifestFileName, &batch.pJobs, &batch.jobCount)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        return errRtn;
+    }
+
+    threads = batch.jobCount < threads ? batch.jobCount : threads;
+
+    /* Whole files go through an I/O engine unless the options want them 
+     * streamed or only part of each read or written */
+    if (!pOptions->stream && !pOptions->pipeline && !pOptions->range && 
+        !pOptions->inPlace && !pOptions->clone)
+    {
+        worker = batchAsyncWorker;
+    }
+
+    if (threads > 1 && 
+        (errRtn = threadPoolCreate(&threadPool, threads)) != success)
+    {
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (threads > 1)
+    {
+        for (thread = 0; thread < threads && errRtn == success; thread++)
+        {
+            errRtn = threadPoolSubmit(&threadPool, worker, &batch);
+        }
+
+        threadPoolWait(&threadPool);
+        threadPoolDestroy(&threadPool);
+    }
+
+    else
+    {
+        worker(&batch);
+        errRtn = success;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (job = 0; job < batch.jobCount; job++)
+    {
+        tBatchJob * pJob = &batch.pJobs[job];
+
+        printf("%s %s %s -> %s\n", errorText(pJob->result), 
+               pJob->fieldCount == 2 ? "decode" : "encode", pJob->pFields[0],
+               pJob->pFields[pJob->fieldCount - 1]);
+
+        if (pJob->result != success && failed++ == 0 && errRtn == success)
+        {
+            errRtn = pJob->result;
+        }
+    }
+
+    printf("jobs=%" PRIu64 " failed=%" PRIu64 " seconds=%.3f jobs_per_second=%.1f\n",
+           batch.jobCount, failed, seconds, 
+           seconds > 0 ? batch.jobCount / seconds : 0.0);
+
+    freeBatchJobs(batch.pJobs, batch.jobCount);
+
+    return errRtn;
+}
+
+/** @brief Receives one request on a server connection, along with any file
+ *         descriptors sent with it. Descriptors beyond BATCH_MAX_FIELDS, in
+ *         whichever control message they arrive, are closed here.
+ *  @param connection The connection.
+ *  @param request Returns the request as a string.
+ *  @param descriptors Returns the descriptors sent with the request.
+ *  @param pDescriptorCount Returns the number of descriptors.
+ *  @return errorSocket once the connection is closed, errorRequest if the 
+ *          request or its descriptors did not fit, otherwise success. */
+static tError receiveRequest(int connection, 
+                             OUT char request[SERVE_REQUEST_SIZE + 1],
+                             OUT int descriptors[BATCH_MAX_FIELDS],
+                             OUT int * pDescriptorCount)
+{
+    tError errRtn = errorDefault;
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(BATCH_MAX_FIELDS * sizeof(int))];
+    } control;
+    struct iovec vector;
+    struct msghdr message;
+    struct cmsghdr * pHeader = NULL;
+    ssize_t received = 0;
+    int descriptor = -1;
+    int count = 0;
+    int index = 0;
+    int dropped = 0;
+
+    vector.iov_base = request;
+    vector.iov_len = SERVE_REQUEST_SIZE;
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+    *pDescriptorCount = 0;
+
+    if ((received = recvmsg(connection, &message, MSG_CMSG_CLOEXEC)) < 0)
+    {
+        message.msg_controllen = 0;
+    }
+
+    for (pHeader = CMSG_FIRSTHDR(&message); pHeader != NULL; 
+         pHeader = CMSG_NXTHDR(&message, pHeader))
+    {
+        if (pHeader->cmsg_level != SOL_SOCKET || pHeader->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+
+        count = (pHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for (index = 0; index < count; index++)
+        {
+            memcpy(&descriptor, CMSG_DATA(pHeader) + index * sizeof(int), sizeof(int));
+
+            if (*pDescriptorCount < BATCH_MAX_FIELDS)
+            {
+                descriptors[(*pDescriptorCount)++] = descriptor;
+            }
+
+            else
+            {
+                close(descriptor);
+                dropped = 1;
+            }
+        }
+    }
+
+    if (received <= 0)
+    {
+        /* The caller stops looking at descriptors once the connection ends */
+        for (index = 0; index < *pDescriptorCount; index++)
+        {
+            close(descriptors[index]);
+        }
+
+        *pDescriptorCount = 0;
+        errRtn = errorSocket;
+    }
+
+    else
+    {
+        request[received] = '\0';
+        errRtn = dropped || message.msg_flags & (MSG_TRUNC | MSG_CTRUNC) ? 
+                 errorRequest : success;
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Runs one request received by a server. Each field given as 
+ *         SERVE_DESCRIPTOR_FIELD stands for the next descriptor sent with 
+ *         the request, which is opened again through /proc/self/fd.
+ *  @param request The request, a line as in a batch manifest.
+ *  @param descriptors Descriptors sent with the request.
+ *  @param descriptorCount Number of descriptors.
+ *  @param pOptions Options to run the request with.
+ *  @param pBuffers Working buffers of the thread.
+ *  @return errorRequest if the request is malformed or the descriptors do 
+ *          not match its fields, otherwise the result of the job. */
+static tError serveRequest(IN_OUT char * request, 
+                           IN const int descriptors[BATCH_MAX_FIELDS],
+                           int descriptorCount,
+                           IN const tOptions * pOptions,
+                           IN_OUT tBuffers * pBuffers)
+{
+    tError errRtn = errorDefault;
+    char names[BATCH_MAX_FIELDS][SERVE_DESCRIPTOR_NAME_SIZE];
+    tBatchJob job;
+    int field = 0;
+    int used = 0;
+
+    if (parseJobLine(request, &job) != success || job.fieldCount == 0)
+    {
+        errRtn = errorRequest;
+        ERROR_PRINT(errRtn);
+    }
+
+    else
+    {
+        errRtn = success;
+    }
+
+    for (field = 0; errRtn == success && field < job.fieldCount; field++)
+    {
+        if (strcmp(job.pFields[field], SERVE_DESCRIPTOR_FIELD) != 0)
+        {
+            continue;
+        }
+
+        else if (used == descriptorCount)
+        {
+            errRtn = errorRequest;
+            ERROR_PRINT(errRtn);
+        }
+
+        else
+        {
+            snprintf(names[field], SERVE_DESCRIPTOR_NAME_SIZE, "/proc/self/fd/%d", 
+                     descriptors[used++]);
+            job.pFields[field] = names[field];
+        }
+    }
+
+    if (errRtn == success && used != descriptorCount)
+    {
+        errRtn = errorRequest;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if (errRtn == success)
+    {
+        errRtn = runJob(&job, pOptions, pBuffers);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Run by each thread of a server. Takes connections in turn and 
+ *         answers every request on one until it closes, replying to each 
+ *         with its tError as a uint32_t. The thread's buffers are allocated
+ *         and touched before the first connection so requests find them warm.
+ *  @param pArgument The tServer being run. */
+static void serveWorker(void * pArgument)
+{
+    tServer * pServer = pArgument;
+    tBuffers buffers = {0};
+    char request[SERVE_REQUEST_SIZE + 1];
+    int descriptors[BATCH_MAX_FIELDS];
+    int descriptorCount = 0;
+    int descriptor = 0;
+    int connection = -1;
+    int serving = 0;
+    uint32_t thread = 0;
+    uint32_t reply = 0;
+    tError errRtn = errorDefault;
+
+    pthread_mutex_lock(&pServer->lock);
+    thread = pServer->threadCount++;
+    pthread_mutex_unlock(&pServer->lock);
+
+    if (reserveBuffers(&buffers, STREAM_BLOCK_SIZE, STREAM_BLOCK_SIZE) == success)
+    {
+        memset(buffers.pBlock, 0, buffers.blockSize);
+        memset(buffers.pBytes, 0, buffers.bytesSize);
+    }
+
+    while ((connection = accept4(pServer->listenSocket, NULL, NULL, SOCK_CLOEXEC)) != -1 ||
+           errno == ECONNABORTED)
+    {
+        if (connection == -1)
+        {
+            continue;
+        }
+
+        /* Once stopping, serveSocket can no longer see this connection */
+        pthread_mutex_lock(&pServer->lock);
+        serving = !pServer->stopping;
+        pServer->connections[thread] = serving ? connection : -1;
+        pthread_mutex_unlock(&pServer->lock);
+
+        while (serving && 
+               (errRtn = receiveRequest(connection, request, descriptors, 
+                                        &descriptorCount)) != errorSocket)
+        {
+            if (errRtn == success)
+            {
+                errRtn = serveRequest(request, descriptors, descriptorCount, 
+                                      &pServer->options, &buffers);
+            }
+
+            for (descriptor = 0; descriptor < descriptorCount; descriptor++)
+            {
+                close(descriptors[descriptor]);
+            }
+
+            __atomic_fetch_add(&pServer->requests, 1, __ATOMIC_RELAXED);
+
+            if (errRtn != success)
+            {
+                __atomic_fetch_add(&pServer->failed, 1, __ATOMIC_RELAXED);
+            }
+
+            reply = errRtn;
+            serving = send(connection, &reply, sizeof(uint32_t), MSG_NOSIGNAL) == 
+                      sizeof(uint32_t);
+        }
+
+        pthread_mutex_lock(&pServer->lock);
+        pServer->connections[thread] = -1;
+        pthread_mutex_unlock(&pServer->lock);
+
+        close(connection);
+    }
+
+    releaseBuffers(&buffers);
+}
+
+
+/** @brief Serves requests on a listening socket until SIGINT or SIGTERM, 
+ *         then closes every connection, waits for the requests being run 
+ *         and prints how many were served.
+ *  @param pServer The server, with listenSocket bound.
+ *  @param threads Number of threads to serve with.
+ *  @return An error value from enum eErrors. */
+static tError runServer(IN_OUT tServer * pServer, uint32_t threads)
+{
+    tError errRtn = errorDefault;
+    tThreadPool threadPool;
+    sigset_t stopSignals;
+    sigset_t blocked;
+    sigset_t previous;
+    uint32_t thread = 0;
+    int stopSignal = 0;
+    struct timespec start;
+    struct timespec end;
+    double seconds = 0;
+
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    /* Writing to a closed pipe handed over by a client fails the request
+     * rather than ending the server */
+    blocked = stopSignals;
+    sigaddset(&blocked, SIGPIPE);
+
+    if (listen(pServer->listenSocket, SOMAXCONN) != success)
+    {
+        errRtn = errorSocket;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    /* Set before the threads start so they inherit it */
+    else if (pthread_sigmask(SIG_BLOCK, &blocked, &previous) != success)
+    {
+        errRtn = errorThread;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((errRtn = threadPoolCreate(&threadPool, threads)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    }
+
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (thread = 0; thread < threads && errRtn == success; thread++)
+        {
+            errRtn = threadPoolSubmit(&threadPool, serveWorker, pServer);
+        }
+
+        sigwait(&stopSignals, &stopSignal);
+
+        pthread_mutex_lock(&pServer->lock);
+        pServer->stopping = 1;
+
+        for (thread = 0; thread < threads; thread++)
+        {
+            if (pServer->connections[thread] != -1)
+            {
+                shutdown(pServer->connections[thread], SHUT_RDWR);
+            }
+        }
+
+        pthread_mutex_unlock(&pServer->lock);
+
+        /* Wakes the threads waiting in accept */
+        shutdown(pServer->listenSocket, SHUT_RDWR);
+
+        threadPoolWait(&threadPool);
+        threadPoolDestroy(&threadPool);
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        printf("requests=%" PRIu64 " failed=%" PRIu64 " seconds=%.3f "
+               "requests_per_second=%.1f\n", pServer->requests, pServer->failed, 
+               seconds, seconds > 0 ? pServer->requests / seconds : 0.0);
+    }
+
+    return errRtn;
+}
+
+
+/** @brief Listens on a Unix domain socket and serves encode and decode 
+ *         requests until SIGINT or SIGTERM, saving the start up of a process
+ *         per bitmap. Each request is one message on a SOCK_SEQPACKET 
+ *         connection, a line as in a batch manifest. Fields may be 
+ *         SERVE_DESCRIPTOR_FIELD to use descriptors sent with the message as
+ *         SCM_RIGHTS. Every request is answered with its tError as a 
+ *         uint32_t. Only the owner of the server may connect.
+ *  @param socketName Path to create the socket at. A socket left there by an
+ *         earlier server is replaced.
+ *  @param pOptions Options given on the command line. threads sets how many
+ *         requests are served at once, by default one per online CPU.
+ *  @return An error value from enum eErrors. */
+static tError serveSocket(IN const char * socketName, IN const tOptions * pOptions)
+{
+    tError errRtn = errorDefault;
+    tServer server;
+    struct sockaddr_un address;
+    struct stat status;
+    uint32_t threads = pOptions->threads;
+    uint32_t thread = 0;
+    mode_t mask = 0;
+
+    memset(&server, 0, sizeof(tServer));
+    server.options = *pOptions;
+    server.options.pPool = NULL;
+    /* Streaming keeps each request within the buffers of its thread */
+    server.options.stream = 1;
+    server.listenSocket = -1;
+    pthread_mutex_init(&server.lock, NULL);
+
+    for (thread = 0; thread < THREAD_POOL_MAX_THREADS; thread++)
+    {
+        server.connections[thread] = -1;
+    }
+
+    if (threads == 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+        threads = threads > THREAD_POOL_MAX_THREADS ? THREAD_POOL_MAX_THREADS : threads;
+    }
+
+    memset(&address, 0, sizeof(struct sockaddr_un));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socketName) >= sizeof(address.sun_path))
+    {
+        errRtn = errorSocket;
+        ERROR_PRINT(errRtn);
+    }
+
+    else if ((server.listenSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+    {
+        errRtn = errorSocket;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else if (stat(socketName, &status) == success && S_ISSOCK(status.st_mode) &&
+             unlink(socketName) != success)
+    {
+        errRtn = errorSocket;
+        ERROR_ERRNO_PRINT(errRtn);
+    }
+
+    else
+    {
+        strcpy(address.sun_path, socketName);
+
+        /* Create the socket with owner only permissions */
+        mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+        errRtn = bind(server.listenSocket, (struct sockaddr *)&address, 
+                      sizeof(struct sockaddr_un)) == success ? success : errorSocket;
+        umask(mask);
+
+        if (errRtn != success)
+        {
+            ERROR_ERRNO_PRINT(errRtn);
+        }
+
+        else
+        {
+            errRtn = runServer(&server, threads);
+            unlink(socketName);
+        }
+    }
+
+    if (server.listenSocket != -1)
+    {
+        close(server.listenSocket);
+    }
+
+    pthread_mutex_destroy(&server.lock);
+
+    return errRtn;
+}
+
+
+/** @brief A debug function which prints out the elements of 
+ *         a tBitmapFileHeader structure.
+ *  @param pFileHeader The file header structure to be
+ *         printed. */
+void printFileHeader(IN const tBitmapFileHeader * pFileHeader)
+{
+    printf("\nFILE HEADER\n");
+    printf("type: %u\n"
+           "size: %u\n"
+           "offsetbits: %u\n",
+    pFileHeader->type,
+    pFileHeader->size,
+    pFileHeader->offsetbits);
+}
+
+
+/** @brief A debug function which prints out the elements of 
+ *         a tBitmapInfoHeader structure.
+ *  @param pInfoHeader The info header structure to be
+ *         printed. */
+void printInfoHeader(IN const tBitmapInfoHeader * pInfoHeader)
+{
+    printf("\nINFO HEADER\n");
+    printf("size: %u\n"
+           "width: %u\n"
+           "height: %u\n"
+           "planes: %u\n"
+           "bitsPerPixel: %u\n"
+           "compressionType: %u\n"
+           "imageDataSize: %u\n"
+           "horizontalResolution: %d\n"
+           "verticalResolution: %d\n"
+           "numberOfColours: %u\n"
+           "numberOfImportantColours:%u\n",
+    pInfoHeader->size, pInfoHeader->width, pInfoHeader->height, pInfoHeader->planes,
+    pInfoHeader->bitsPerPixel,pInfoHeader->compressionType, 
+    pInfoHeader->imageDataSize, pInfoHeader->horizontalResolution,
+    pInfoHeader->verticalResolution, pInfoHeader->numberOfColours, 
+    pInfoHeader->numberOfImportantColours);
+}
+
+
+/** @brief Determines whether encoding or decoding a bitmap is desired.
+ *         Options are stripped first. If one argument remains decoding is 
+ *         chosen. If two remain encoding is chosen.
+ *  @param argv[1] Bitmap file to be decoded/encoded.
+ *  @param argv[2] For encoding only - Data file to be encoded. */
+int main(int argc, char ** argv)
+{
+    tError errRtn = errorDefault;
+    tOptions options;
+    tThreadPool threadPool;
+    tMode mode = modeUsage;
+    int option = 0;
+    int badOption = 0;
+    char given[sizeof(OPTION_STRING)] = {0};
+    const char * manifestFileName = NULL;
+    const char * socketName = NULL;
+    const char * passphraseFileName = NULL;
+    char * pPassphrase = NULL;
+    char * pEnd = NULL;
+
+    memset(&options, 0, sizeof(tOptions));
+    setErrorReporter(printError);
+
+    while ((option = getopt_long(argc, argv, OPTION_STRING, longOptions, NULL)) != -1)
+    {
+        if (option != '?' && option != ':' && strchr(given, option) == NULL)
+        {
+            given[strlen(given)] = option;
+        }
+
+        switch (option)
+        {
+            case 's':
+                options.stream = 1;
+                break;
+
+            case 'b':
+                manifestFileName = optarg;
+                break;
+
+            case 'l':
+                options.bitsPerChannel = strtoul(optarg, NULL, 10);
+                badOption |= options.bitsPerChannel == 0 || 
+                             hidingScheme(options.bitsPerChannel) == NULL;
+                break;
+
+            case 'a':
+                options.alpha = 1;
+                break;
+
+            case 'p':
+                options.probe = 1;
+                break;
+
+            case 'v':
+                options.verify = 1;
+                break;
+
+            case 'm':
+                badOption |= simdForce(optarg) != success;
+                break;
+
+            case 'd':
+                socketName = optarg;
+                break;
+
+            case 'o':
+                options.outputFileName = optarg;
+                break;
+
+            case 'c':
+                options.clone = 1;
+                break;
+
+            case 'P':
+                options.pipeline = 1;
+                break;
+
+            case 'z':
+                options.compress = 1;
+                break;
+
+            case 'k':
+                passphraseFileName = optarg;
+                break;
+
+            case 'i':
+                options.inPlace = 1;
+                break;
+
+            case 'r':
+                options.range = 1;
+                options.rangeOffset = strtoull(optarg, &pEnd, 10);
+                badOption |= *pEnd != ':';
+                options.rangeLength = *pEnd == ':' ? strtoull(pEnd + 1, &pEnd, 10) : 0;
+                badOption |= *pEnd != '\0';
+                break;
+
+            case 'j':
+                options.threads = strtoul(optarg, NULL, 10);
+                badOption |= options.threads < 1 || options.threads > THREAD_POOL_MAX_THREADS;
+                break;
+
+            default:
+                badOption = 1;
+                break;
+        }
+    }
+
+    /* Drop the options so the file names sit at BITMAP_FILE and ENCODE_FILE */
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (badOption)
+    {
+        mode = modeUsage;
+    }
+
+    else if (manifestFileName != NULL && argc == 1)
+    {
+        mode = modeBatch;
+    }
+
+    else if (socketName != NULL && argc == 1)
+    {
+        mode = modeServe;
+    }
+
+    else if (options.probe && argc >= 2)
+    {
+        mode = modeProbe;
+    }
+
+    else if (options.verify && argc >= 2)
+    {
+        mode = modeVerify;
+    }
+
+    else if (argc == 2)
+    {
+        mode = modeDecode;
+    }
+
+    else if (argc == 3)
+    {
+        mode = modeEncode;
+    }
+
+    /* Every option given must be one the mode uses */
+    if (strspn(given, modeOptions[mode]) != strlen(given))
+    {
+        mode = modeUsage;
+    }
+
+    if (mode != modeUsage && passphraseFileName != NULL &&
+        (errRtn = readPassphrase(passphraseFileName, &pPassphrase)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        return errRtn;
+    }
+
+    options.passphrase = pPassphrase;
+
+    /* A batch or server shares its threads out between jobs itself */
+    if ((mode == modeDecode || mode == modeEncode) && options.threads > 1 &&
+        (errRtn = threadPoolCreate(&threadPool, options.threads)) != success)
+    {
+        ERROR_PRINT(errRtn);
+        return errRtn;
+    }
+
+    else if ((mode == modeDecode || mode == modeEncode) && options.threads > 1)
+    {
+        options.pPool = &threadPool;
+    }
+
+    if (mode == modeBatch)
+    {
+        errRtn = runBatch(manifestFileName, &options);
+    }
+
+    else if (mode == modeServe)
+    {
+        errRtn = serveSocket(socketName, &options);
+    }
+
+    else if (mode == modeProbe)
+    {
+        errRtn = probeFiles(&argv[BITMAP_FILE], argc - 1);
+    }
+
+    else if (mode == modeVerify)
+    {
+        errRtn = verifyFiles(&argv[BITMAP_FILE], argc - 1);
+    }
+
+    else if (mode == modeDecode)
+    {
+        errRtn = decoding(argv, &options);
+    }
+
+    else if (mode == modeEncode)
+    {
+        errRtn = encoding(argv, &options);
+    }
+
+    else
+    {
+        printf("Useage:\n"
+               "To decode a file pass the BMP file in as an arugment.\n"
+               "To encode a file pass in the destination BMP and data\n"
+               "in that order as arugments.\n"
+               "Options:\n"
+               "  -s  Stream the bitmap a few rows at a time rather than\n"
+               "      holding all of it in memory, when encoding or decoding.\n"
+               "  -j N  Hide or recover the data with N threads.\n"
+               "  -b manifest  Run every job listed in manifest, one per line:\n"
+               "      \"cover data output\" to encode or \"stego output\" to\n"
+               "      decode. -j sets how many jobs run at once.\n"
+               "  -d SOCKET  Serve encode and decode requests on the Unix\n"
+               "      socket SOCKET until interrupted, each a manifest line\n"
+               "      sent as one message, answered with its error value.\n"
+               "      -j sets how many requests are served at once.\n"
+               "  -l BITS  Hide BITS (1, 2, 4 or 8) bits of data in every colour\n"
+               "      byte when encoding, rather than one byte in each pixel.\n"
+               "      Decoding picks the layout up from the bitmap.\n"
+               "  -a  Hide data in the alpha bytes of 32 bit bitmaps too,\n"
+               "      two bits in each byte of a pixel. The -l layouts always\n"
+               "      use them.\n"
+               "  -p  Probe: report the size and extension of the data in\n"
+               "      each bitmap given, and how much it could hold, reading\n"
+               "      only the start of each file.\n"
+               "  -v, --verify  Verify: check the data in each bitmap given\n"
+               "      against the checksum stored after it, without writing\n"
+               "      it out or needing its passphrase.\n"
+               "  -r OFFSET:LENGTH  When decoding, recover only LENGTH bytes\n"
+               "      of the data starting OFFSET bytes in, reading only the\n"
+               "      rows which hold them.\n"
+               "  -i  When encoding, hide the data in the bitmap given rather\n"
+               "      than a copy, rewriting only the rows which hold it.\n"
+               "  -c  When encoding, clone the bitmap to the output (a reflink\n"
+               "      where the filesystem supports it) and rewrite only the\n"
+               "      rows which hold the data.\n"
+               "  -P  Stream the bitmap as -s does, but read, hide or recover,\n"
+               "      and write on three threads at once.\n"
+               "  -z  When encoding, compress the data as it is hidden so\n"
+               "      more fits. The whole bitmap is held in memory, so -s\n"
+               "      and -P don't apply and -i and -c can't be used. The\n"
+               "      output is only written once the data is known to fit.\n"
+               "      Decoding expands it whatever the options.\n"
+               "  -k FILE  Encrypt the data with the passphrase on the first\n"
+               "      line of FILE when encoding, or decrypt it when decoding.\n"
+               "      The key is stretched from the passphrase and a random\n"
+               "      salt, so the same data never encrypts the same way.\n"
+               "  -m LEVEL  Use the kernels for instruction set LEVEL (scalar,\n"
+               "      sse2, ssse3, sse4.2, avx2 or avx512) rather than the\n"
+               "      best the CPU supports, e.g. to test or time them.\n"
+               "  -o FILE  Write the bitmap or data to FILE rather than out.bmp\n"
+               "      or decoded.<ext>.\n"
+               "Any file name given on the command line may be - for\n"
+               "standard input or output, to use the program in a pipeline.\n"
+               "A bitmap read from standard input or written to standard\n"
+               "output is streamed as -s does, or as -P does with -P, so\n"
+               "-i, -c and -r can't be used with it. Data from standard\n"
+               "input is read into memory, as is the bitmap with -z.\n"
+               "Options which don't apply to what is asked for, such as\n"
+               "-l when decoding or -o with -b, are refused.\n");
+    }
+
+    if (options.pPool != NULL)
+    {
+        threadPoolDestroy(options.pPool);
+    }
+
+    free(pPassphrase);
+    
+    /* Standard output may be carrying the result, or a line per bitmap */
+    if (errRtn == success)
+    {
+        fprintf(stdioFileName(options.outputFileName) || mode == modeProbe || 
+                mode == modeVerify ? stderr : stdout, "Success\n");
+    }
+
+    return errRtn;
+}
+